@@ -0,0 +1,265 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+
+#include <vector>
+
+#include "canLogReader.h"
+#include "canLogCache.h"
+
+#define CAN_CACHE_VERSION (1)
+//the cache is written through a stdio buffer of that size
+#define CAN_CACHE_WRITE_BUFFER (1024*1024)
+
+#define FNV_OFFSET (14695981039346656037ULL)
+#define FNV_PRIME  (1099511628211ULL)
+
+
+CanLogCache::CanLogCache()
+{
+   this->map = NULL;
+   this->mapSize = 0;
+   this->recs = NULL;
+   this->recCount = 0;
+   this->rts = 0;
+}
+
+CanLogCache::~CanLogCache()
+{
+   close();
+}
+
+/**
+ * @return name of the cache file of the given log
+ */
+std::string CanLogCache::fileName(const char *logName)
+{
+   return std::string(logName) + ".cev";
+}
+
+static uint64_t fnvHash(uint64_t hash, const uint8_t *data, size_t size)
+{
+   for(size_t i=0; i<size; i++)
+   {
+      hash = (hash ^ data[i]) * FNV_PRIME;
+   }
+   return hash;
+}
+
+/**
+ * Fills the source log fields of the cache header: size, modification time and
+ * the hash of the first and the last CAN_CACHE_HASH_BYTES of the log.
+ *
+ * @return POSIX error code or 0 on success
+ */
+static int logKey(const char *logName, canCacheHeader *key)
+{
+   int fd = ::open(logName, O_RDONLY);
+   if(-1 == fd)
+   {
+      return errno;
+   }
+   struct stat st;
+   if(0 != fstat(fd, &st))
+   {
+      int err = errno;
+      ::close(fd);
+      return err;
+   }
+   key->logSize = st.st_size;
+   key->mtimeSec = st.st_mtim.tv_sec;
+   key->mtimeNsec = st.st_mtim.tv_nsec;
+
+   std::vector<uint8_t> buf(CAN_CACHE_HASH_BYTES);
+   uint64_t hash = FNV_OFFSET;
+   uint64_t head = (key->logSize < CAN_CACHE_HASH_BYTES) ? key->logSize : CAN_CACHE_HASH_BYTES;
+   uint64_t tail = key->logSize - head;
+   if(tail > CAN_CACHE_HASH_BYTES)
+   {
+      tail = CAN_CACHE_HASH_BYTES;
+   }
+   int err = 0;
+   if((head > 0) && ((ssize_t)head != pread(fd, &buf[0], head, 0)))
+   {
+      err = EIO;
+   }
+   hash = fnvHash(hash, &buf[0], head);
+   if((0 == err) && (tail > 0) && ((ssize_t)tail != pread(fd, &buf[0], tail, key->logSize - tail)))
+   {
+      err = EIO;
+   }
+   hash = fnvHash(hash, &buf[0], tail);
+   key->hash = hash;
+   ::close(fd);
+   return err;
+}
+
+/**
+ * Maps the cache of the given log.
+ *
+ * @return POSIX error code or 0 on success, ENOENT if there is no cache, ESTALE if it doesn't match the log
+ */
+int CanLogCache::open(const char *logName)
+{
+   close();
+
+   std::string name = fileName(logName);
+   int fd = ::open(name.c_str(), O_RDONLY);
+   if(-1 == fd)
+   {
+      return errno;
+   }
+
+   canCacheHeader header;
+   canCacheHeader key;
+   struct stat st;
+   if((0 != fstat(fd, &st)) || (sizeof(header) != pread(fd, &header, sizeof(header), 0))
+      || (0 != memcmp(header.id, "ECEV", 4)) || (CAN_CACHE_VERSION != header.version)
+      || (header.count > (uint64_t)st.st_size / sizeof(canCacheRecord))
+      || ((uint64_t)st.st_size != sizeof(header) + header.count * sizeof(canCacheRecord))
+      || (0 != logKey(logName, &key)) || (key.logSize != header.logSize) || (key.mtimeSec != header.mtimeSec)
+      || (key.mtimeNsec != header.mtimeNsec) || (key.hash != header.hash))
+   {
+      ::close(fd);
+      return ESTALE;
+   }
+
+   void *addr = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+   int err = errno;
+   ::close(fd);
+   if(MAP_FAILED == addr)
+   {
+      fprintf(stderr, "mmap(%s) failed(%s)\n", name.c_str(), strerror(err));
+      return err;
+   }
+   this->map = addr;
+   this->mapSize = st.st_size;
+   this->recs = (const canCacheRecord *)((const char *)addr + sizeof(header));
+   this->recCount = header.count;
+   this->rts = header.rts;
+   return 0;
+}
+
+/**
+ * Parses the log and writes its cache, the cache is replaced atomically, so
+ * a concurrent open() sees either the old or the complete new one.
+ *
+ * @return POSIX error code or 0 on success
+ */
+int CanLogCache::build(const char *logName)
+{
+   canCacheHeader header;
+   memset(&header, 0, sizeof(header));
+   memcpy(header.id, "ECEV", 4);
+   header.version = CAN_CACHE_VERSION;
+   //the key is taken before parsing, so a log changed meanwhile leaves a stale cache
+   int err = logKey(logName, &header);
+   if(0 != err)
+   {
+      return err;
+   }
+
+   CanLogReader log;
+   err = log.open(logName);
+   if(0 != err)
+   {
+      return err;
+   }
+   header.rts = log.timeBase();
+
+   std::string name = fileName(logName);
+   char suffix[32];
+   snprintf(suffix, sizeof(suffix), ".%d", (int)getpid());
+   std::string tmpName = name + suffix;
+   FILE *fp = fopen(tmpName.c_str(), "wb");
+   if(NULL == fp)
+   {
+      err = errno;
+      fprintf(stderr, "Unable to open the file %s(%s)\n", tmpName.c_str(), strerror(err));
+      return err;
+   }
+   setvbuf(fp, NULL, _IOFBF, CAN_CACHE_WRITE_BUFFER);
+
+   if(1 != fwrite(&header, sizeof(header), 1, fp))
+   {
+      err = errno;
+   }
+   canCacheRecord rec;
+   while(0 == err)
+   {
+      err = log.next(rec.ts, rec.event);
+      if(0 != err)
+      {
+         err = (ENODATA == err) ? 0 : err;
+         break;
+      }
+      if(1 != fwrite(&rec, sizeof(rec), 1, fp))
+      {
+         err = errno;
+         break;
+      }
+      header.count++;
+   }
+   if((0 == err) && ((0 != fseek(fp, 0, SEEK_SET)) || (1 != fwrite(&header, sizeof(header), 1, fp))))
+   {
+      err = errno;
+   }
+   if((0 != fclose(fp)) && (0 == err))
+   {
+      err = errno;
+   }
+   if((0 == err) && (0 != rename(tmpName.c_str(), name.c_str())))
+   {
+      err = errno;
+   }
+   if(0 != err)
+   {
+      fprintf(stderr, "Unable to write the CAN log cache %s(%s)\n", name.c_str(), strerror(err));
+      unlink(tmpName.c_str());
+   }
+   return err;
+}
+
+void CanLogCache::close()
+{
+   if(NULL != this->map)
+   {
+      munmap(this->map, this->mapSize);
+      this->map = NULL;
+   }
+   this->mapSize = 0;
+   this->recs = NULL;
+   this->recCount = 0;
+   this->rts = 0;
+}
+
+/**
+ * Finds the first record not earlier than the given time.
+ *
+ * @return record number, count() if all records are earlier
+ */
+size_t CanLogCache::find(const timeval &ts) const
+{
+   uint64_t target = (uint64_t)ts.tv_sec * 1000000 + ts.tv_usec;
+   size_t lo = 0;
+   size_t hi = this->recCount;
+   while(lo < hi)
+   {
+      size_t mid = lo + (hi - lo) / 2;
+      if(this->recs[mid].ts < target)
+      {
+         lo = mid + 1;
+      }
+      else
+      {
+         hi = mid;
+      }
+   }
+   return lo;
+}
@@ -0,0 +1,67 @@
+#ifndef _CAN_LOG_CACHE__
+#define _CAN_LOG_CACHE__
+
+#include <stdint.h>
+#include <stddef.h>
+#include <sys/time.h>
+
+#include <string>
+
+#include "eventlog.h"
+
+/**
+ * Parsed CAN text log cache(@see canCacheHeader in "eventlog.h"). It is built from
+ * the text log once and memory mapped by the later opens, so the log is not parsed
+ * again on every playback session.
+ */
+class CanLogCache
+{
+public:
+   CanLogCache();
+   ~CanLogCache();
+
+   /**
+    * Maps the cache of the given log.
+    *
+    * @return POSIX error code or 0 on success, ENOENT if there is no cache, ESTALE if it doesn't match the log
+    */
+   int open(const char *logName);
+
+   /**
+    * Parses the log and writes its cache, the cache is replaced atomically, so
+    * a concurrent open() sees either the old or the complete new one.
+    *
+    * @return POSIX error code or 0 on success
+    */
+   static int build(const char *logName);
+
+   void close();
+
+   /**
+    * Finds the first record not earlier than the given time.
+    *
+    * @return record number, count() if all records are earlier
+    */
+   size_t find(const timeval &ts) const;
+
+   const canCacheRecord *records() const { return recs; }
+   size_t count() const { return recCount; }
+   uint64_t timeBase() const { return rts; }
+
+   /**
+    * @return name of the cache file of the given log
+    */
+   static std::string fileName(const char *logName);
+
+private:
+   CanLogCache(const CanLogCache &);
+   CanLogCache &operator=(const CanLogCache &);
+
+   void *map;
+   size_t mapSize;
+   const canCacheRecord *recs;
+   size_t recCount;
+   uint64_t rts;
+};
+
+#endif // _CAN_LOG_CACHE__
@@ -8,54 +8,126 @@
 #include "eventlog.h"
 #include "canLogFile.h"
 
+//seek: the rest of the log is scanned line by line once the bisected range is that small
+#define CAN_SEEK_SCAN_BYTES (64*1024)
+
 
 int CanLogFile::open(const char* fname)
 {
-   this->fp = fopen(fname , "r");
-   if (this->fp == NULL)
+   close();
+
+   int err = this->cache.open(fname);
+   if((0 != err) && this->buildEnabled && (0 == CanLogCache::build(fname)))
    {
-      fprintf(stderr, "Unable to open the file %s(%s)\n", fname , strerror(errno));
-      return errno;
+      err = this->cache.open(fname);
    }
+   if(0 == err)
+   {
+      this->cached = true;
+      this->cachePos = 0;
+      return 0;
+   }
+   return this->log.open(fname);
+}
 
-   char buf[256];
-   uint64_t rts = 0u;
-   uint64_t baseTs = 0u;
-   while(fgets(buf, sizeof(buf), this->fp) != NULL)
+/**
+ * Starts reading over from the first packet.
+ *
+ * @return POSIX error code or 0 on success
+ */
+int CanLogFile::rewind()
+{
+   if(this->cached)
    {
-      if(0==strncmp(buf, "rts: ", 5))
+      this->cachePos = 0;
+      return 0;
+   }
+   this->log.setPosition(this->log.dataOffset());
+   return 0;
+}
+
+/**
+ * Positions the file so the next read() returns the first packet not earlier
+ * than the given time(or end of file). The text log is sorted by time, so the
+ * range containing the time is bisected by file offsets first and only the last
+ * CAN_SEEK_SCAN_BYTES are scanned line by line.
+ *
+ * @return POSIX error code or 0 on success
+ */
+int CanLogFile::seek(const timeval &ts)
+{
+   if(this->cached)
+   {
+      this->cachePos = this->cache.find(ts);
+      return 0;
+   }
+
+   uint64_t target = (uint64_t)ts.tv_sec * 1000000 + ts.tv_usec;
+   canEvent ev;
+
+   //lo is the log start or an offset followed by a packet earlier than target
+   uint64_t lo = this->log.dataOffset();
+   uint64_t hi = this->log.size();
+   while(hi - lo > CAN_SEEK_SCAN_BYTES)
+   {
+      uint64_t mid = lo + (hi - lo) / 2;
+      this->log.setPosition(mid);
+      uint64_t pktts;
+      //skip the line the offset points into
+      int err = this->log.skipLine();
+      if(0 == err)
       {
-         int count = sscanf(buf,"rts: %lu  ts: %lu", &rts, &baseTs);
-         if(2 != count)
-         {
-            fprintf(stderr, "Wrong RTS specification string: (%s)", buf);
-            fclose(this->fp);
-            this->fp = NULL;
-            return EIO;
-         }
-         this->timeBase = rts;
-         break;
+         err = this->log.next(pktts, ev);
+      }
+      if((ENODATA != err) && (0 != err))
+      {
+         return err;
+      }
+      if((ENODATA == err) || (pktts >= target))
+      {
+         hi = mid;
+      }
+      else
+      {
+         lo = mid;
       }
    }
 
-   if(0u == this->timeBase)
+   this->log.setPosition(lo);
+   if(lo != this->log.dataOffset())
    {
-      fprintf(stderr, "Failed to init can dump timebase!\n");
-      fclose(this->fp);
-      this->fp = NULL;
-      return EIO;
+      int err = this->log.skipLine();
+      if(0 != err)
+      {
+         return (ENODATA == err) ? 0 : err;
+      }
+   }
+
+   for(;;)
+   {
+      uint64_t pos = this->log.position();
+      uint64_t pktts;
+      int err = this->log.next(pktts, ev);
+      if(0 != err)
+      {
+         return (ENODATA == err) ? 0 : err;
+      }
+
+      if(pktts >= target)
+      {
+         //read() skips the non packet lines before it
+         this->log.setPosition(pos);
+         return 0;
+      }
    }
-   return 0;
 }
 
 void CanLogFile::close()
 {
-   if(NULL != this->fp)
-   {
-      fclose(this->fp);
-      this->fp = NULL;
-      this->timeBase = 0u;
-   }
+   this->log.close();
+   this->cache.close();
+   this->cached = false;
+   this->cachePos = 0;
 }
 
 CanLogFile::~CanLogFile()
@@ -64,61 +136,52 @@ CanLogFile::~CanLogFile()
 }
 
 
-CanLogFile::CanLogFile()
+CanLogFile::CanLogFile(bool buildCache)
 {
-   this->timeBase = 0u;
-   this->fp = NULL;
+   memset(&this->event, 0, sizeof(this->event));
+   this->buildEnabled = buildCache;
+   this->cached = false;
+   this->cachePos = 0;
 }
 
 /**
- * Reads the next packet.
+ * Reads the next packet without copying it: data points to the parsed event
+ * owned by the file, which stays valid until the next read, seek() or rewind().
  * If end of file is reached the 0 is returned.
  *
- * @return amount of read data or -1 on error (errno is set to the error code)
+ * @return amount of data or -1 on error (errno is set to the error code)
  */
-int CanLogFile::read(packetType &type, timeval &ts, char *data, const int size)
+int CanLogFile::readView(packetType &type, timeval &ts, const char *&data)
 {
-   if(size < (int)sizeof(canEvent))
-   {
-      errno = EINVAL;
-      return -1;
-   }
    type = PACKET_TYPE_CAN;
 
-   canEvent *pkt = (canEvent *)(data);
-   uint32_t canData[8];
-
-   char buf[256];
-   while(fgets(buf, sizeof(buf), this->fp) != NULL)
+   if(this->cached)
    {
-      if(0==strncmp(buf, "ts: ", 4))//ts: 000000007938   084   [8]  66 D2 66 AE 04 50 71 E9
+      if(this->cachePos >= this->cache.count())
       {
-         uint64_t pktts;
-         int count = sscanf(buf,"ts: %lu %x [%u] %x %x %x %x %x %x %x %x", &pktts, &pkt->id, &pkt->len
-                            ,canData, canData+1, canData+2, canData+3, canData+4, canData+5, canData+6, canData+7 );
-         if(11 != count)
-         {
-            fprintf(stderr, "Wrong line format: (%s)", buf);
-            continue;
-         }
-         uint64_t  msgTimestamp = pktts + this->timeBase;
-         ldiv_t parsedTime = ldiv(msgTimestamp, 1e6);
-
-         for(int i=0; i<8; i++)
-         {
-            pkt->data[i] = (uint8_t)canData[i];
-         }
-
-         ts.tv_sec = parsedTime.quot;
-         ts.tv_usec = parsedTime.rem;
-         return sizeof(canEvent);
+         return 0;
       }
+      const canCacheRecord *rec = &this->cache.records()[this->cachePos++];
+      ts.tv_sec = rec->ts / 1000000;
+      ts.tv_usec = rec->ts % 1000000;
+      data = (const char *)&rec->event;
+      return sizeof(canEvent);
    }
 
-   if(feof(this->fp))
+   uint64_t msgTimestamp;
+   int err = this->log.next(msgTimestamp, this->event);
+   if(0 != err)
    {
-      return 0;
+      if(ENODATA == err)
+      {
+         return 0;
+      }
+      errno = err;
+      return -1;
    }
 
-   return -1;
+   ts.tv_sec = msgTimestamp / 1000000;
+   ts.tv_usec = msgTimestamp % 1000000;
+   data = (const char *)&this->event;
+   return sizeof(canEvent);
 }
@@ -6,27 +6,42 @@
 #include <stdio.h>
 
 #include "logFile.h"
+#include "canLogReader.h"
+#include "canLogCache.h"
 
 
+/**
+ * CAN text log reader. The log is parsed into its cache(@see CanLogCache) by the first open,
+ * the later opens map the cache instead of parsing the text. The text is read directly if
+ * the cache can't be written next to the log or buildCache is false(a valid cache is still used).
+ */
 class CanLogFile : public ILogFile
 {
 public:
-   CanLogFile();
+   CanLogFile(bool buildCache = true);
    ~CanLogFile();
    /**
-    * Reads the next packet.
+    * Reads the next packet without copying it: data points to the parsed event
+    * owned by the file, which stays valid until the next read, seek() or rewind().
     * If end of file is reached the 0 is returned.
     *
-    * @return amount of read data or -1 on error (errno is set to the error code)
+    * @return amount of data or -1 on error (errno is set to the error code)
     */
-   int read(packetType &type, timeval &ts, char *data, const int size);
+   int readView(packetType &type, timeval &ts, const char *&data);
+   bool persistentView() const { return cached; }
 
+   int rewind();
+   int seek(const timeval &ts);
    int open(const char* fname);
    void close();
 
 private:
-   FILE *fp;
-   uint64_t  timeBase;//rts value form log header(rts: 1458726428015650 ts: 2659501121)
+   CanLogReader log;
+   canEvent event;    //the last parsed packet
+   CanLogCache cache;
+   bool buildEnabled; //a missing or stale cache is written by open()
+   bool cached;       //the packets are read from the cache
+   size_t cachePos;   //the next cache record
 };
 
 #endif // _CAN_LOG_FILE__
@@ -0,0 +1,292 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+
+#include "canLogReader.h"
+#include "canLogParallelReader.h"
+
+
+CanLogParallelReader::CanLogParallelReader()
+{
+   this->map = NULL;
+   this->fileSize = 0;
+   this->rts = 0;
+   this->stop = false;
+   this->scheduled = 0;
+   this->current = 0;
+   this->ready = false;
+   this->pos = 0;
+   pthread_mutex_init(&this->lock, NULL);
+   pthread_cond_init(&this->cond, NULL);
+}
+
+CanLogParallelReader::~CanLogParallelReader()
+{
+   close();
+   pthread_cond_destroy(&this->cond);
+   pthread_mutex_destroy(&this->lock);
+}
+
+/**
+ * Opens the log, reads its header and starts the parser threads.
+ *
+ * @return POSIX error code or 0 on success
+ */
+int CanLogParallelReader::open(const char *fname, int threads)
+{
+   close();
+
+   //the header is read the same way the single threaded reader does it
+   CanLogReader header;
+   int err = header.open(fname);
+   if(0 != err)
+   {
+      return err;
+   }
+   this->rts = header.timeBase();
+   uint64_t first = header.dataOffset();
+   header.close();
+
+   int fd = ::open(fname, O_RDONLY);
+   if(-1 == fd)
+   {
+      fprintf(stderr, "Unable to open the file %s(%s)\n", fname, strerror(errno));
+      return errno;
+   }
+   struct stat st;
+   if(0 != fstat(fd, &st))
+   {
+      err = errno;
+      fprintf(stderr, "fstat(%s) failed(%s)\n", fname, strerror(err));
+      ::close(fd);
+      return err;
+   }
+   this->fileSize = st.st_size;
+   if(this->fileSize > first)
+   {
+      void *addr = mmap(NULL, this->fileSize, PROT_READ, MAP_SHARED, fd, 0);
+      if(MAP_FAILED == addr)
+      {
+         err = errno;
+         fprintf(stderr, "mmap(%s) failed(%s)\n", fname, strerror(err));
+         ::close(fd);
+         return err;
+      }
+      madvise(addr, this->fileSize, MADV_SEQUENTIAL);
+      this->map = (char *)addr;
+   }
+   ::close(fd);
+
+   //the chunks start right after a newline
+   this->bounds.clear();
+   this->bounds.push_back(first);
+   uint64_t offset = first + CAN_LOG_PARALLEL_CHUNK;
+   while(offset < this->fileSize)
+   {
+      const char *newline = (const char *)memchr(this->map + offset, '\n', this->fileSize - offset);
+      if(NULL == newline)
+      {
+         break;
+      }
+      uint64_t bound = newline + 1 - this->map;
+      if(bound >= this->fileSize)
+      {
+         break;
+      }
+      this->bounds.push_back(bound);
+      offset = bound + CAN_LOG_PARALLEL_CHUNK;
+   }
+   if(this->fileSize > first)
+   {
+      this->bounds.push_back(this->fileSize);
+   }
+
+   if(threads < 1)
+   {
+      threads = 1;
+   }
+   this->runs.resize(threads * CAN_LOG_PARALLEL_AHEAD);
+   for(size_t i=0; i<this->runs.size(); i++)
+   {
+      this->runs[i].done = false;
+      this->runs[i].err = 0;
+   }
+   this->stop = false;
+   this->scheduled = 0;
+   this->current = 0;
+   this->ready = false;
+   this->pos = 0;
+
+   for(int i=0; i<threads; i++)
+   {
+      pthread_t tid;
+      err = pthread_create(&tid, NULL, thread, this);
+      if(0 != err)
+      {
+         fprintf(stderr, "pthread_create() failed(%s)\n", strerror(err));
+         break;
+      }
+      this->threads.push_back(tid);
+   }
+   if(this->threads.empty())
+   {
+      close();
+      return err;
+   }
+   return 0;
+}
+
+void CanLogParallelReader::close()
+{
+   pthread_mutex_lock(&this->lock);
+   this->stop = true;
+   pthread_cond_broadcast(&this->cond);
+   pthread_mutex_unlock(&this->lock);
+   for(size_t i=0; i<this->threads.size(); i++)
+   {
+      pthread_join(this->threads[i], NULL);
+   }
+   this->threads.clear();
+
+   if(NULL != this->map)
+   {
+      munmap(this->map, this->fileSize);
+      this->map = NULL;
+   }
+   this->bounds.clear();
+   this->runs.clear();
+}
+
+/**
+ * Parses the chunk lines into the packets run.
+ *
+ * @return POSIX error code or 0 on success
+ */
+int CanLogParallelReader::parse(size_t chunk, std::vector<canPacket> &packets)
+{
+   const char *p = this->map + this->bounds[chunk];
+   const char *end = this->map + this->bounds[chunk + 1];
+   packets.clear();
+   while(p < end)
+   {
+      const char *newline = (const char *)memchr(p, '\n', end - p);
+      const char *lineEnd = (NULL != newline) ? newline : end;
+
+      canPacket pkt;
+      canLogLine kind = canLogParseLine(p, lineEnd, pkt.ts, pkt.ev);
+      if(CAN_LOG_LINE_PACKET == kind)
+      {
+         pkt.ts += this->rts;
+         packets.push_back(pkt);
+      }
+      else if(CAN_LOG_LINE_MALFORMED == kind)
+      {
+         fprintf(stderr, "Wrong line format: (%.*s)\n", (int)(lineEnd - p), p);
+      }
+      p = lineEnd + 1;
+   }
+   return 0;
+}
+
+/**
+ * Parser thread: takes the chunks in order as long as they fit the window ahead
+ * of the chunk being read.
+ */
+void *CanLogParallelReader::thread(void *arg)
+{
+   CanLogParallelReader *ctx = (CanLogParallelReader *)arg;
+
+   pthread_mutex_lock(&ctx->lock);
+   while(!ctx->stop)
+   {
+      size_t chunk = ctx->scheduled;
+      if((chunk + 1 >= ctx->bounds.size()) || (chunk >= ctx->current + ctx->runs.size()))
+      {
+         pthread_cond_wait(&ctx->cond, &ctx->lock);
+         continue;
+      }
+      ctx->scheduled++;
+      chunkRun *run = &ctx->runs[chunk % ctx->runs.size()];
+      pthread_mutex_unlock(&ctx->lock);
+
+      int err = ctx->parse(chunk, run->packets);
+
+      pthread_mutex_lock(&ctx->lock);
+      run->err = err;
+      run->done = true;
+      pthread_cond_broadcast(&ctx->cond);
+   }
+   pthread_mutex_unlock(&ctx->lock);
+   return NULL;
+}
+
+/**
+ * Drops the pages of the read chunk, so the resident set stays bounded on any log size.
+ */
+void CanLogParallelReader::release(size_t chunk)
+{
+   static const uint64_t pageMask = ~(uint64_t)(sysconf(_SC_PAGESIZE) - 1);
+   uint64_t from = this->bounds[chunk] & pageMask;
+   uint64_t to = this->bounds[chunk + 1] & pageMask;
+   if(to > from)
+   {
+      madvise(this->map + from, to - from, MADV_DONTNEED);
+   }
+}
+
+/**
+ * Returns the next packet, waiting for its chunk to be parsed if needed.
+ *
+ * @param ts - the packet time(usec since the epoch)
+ * @return POSIX error code or 0 on success, ENODATA if end of file is reached
+ */
+int CanLogParallelReader::next(uint64_t &ts, canEvent &ev)
+{
+   for(;;)
+   {
+      if(this->current + 1 >= this->bounds.size())
+      {
+         return ENODATA;
+      }
+
+      chunkRun *run = &this->runs[this->current % this->runs.size()];
+      if(!this->ready)
+      {
+         pthread_mutex_lock(&this->lock);
+         while(!run->done)
+         {
+            pthread_cond_wait(&this->cond, &this->lock);
+         }
+         pthread_mutex_unlock(&this->lock);
+         if(0 != run->err)
+         {
+            return run->err;
+         }
+         this->ready = true;
+      }
+
+      if(this->pos < run->packets.size())
+      {
+         const canPacket &pkt = run->packets[this->pos++];
+         ts = pkt.ts;
+         ev = pkt.ev;
+         return 0;
+      }
+
+      //the run is read up, its slot is free for the chunk at the end of the window
+      release(this->current);
+      pthread_mutex_lock(&this->lock);
+      run->done = false;
+      this->current++;
+      pthread_cond_broadcast(&this->cond);
+      pthread_mutex_unlock(&this->lock);
+      this->ready = false;
+      this->pos = 0;
+   }
+}
@@ -0,0 +1,87 @@
+#ifndef _CAN_LOG_PARALLEL_READER__
+#define _CAN_LOG_PARALLEL_READER__
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include <pthread.h>
+
+#include <vector>
+
+#include "eventlog.h"
+
+//the mapped log is split into chunks of about this size at line boundaries
+#define CAN_LOG_PARALLEL_CHUNK (16*1024*1024)
+//amount of chunks parsed ahead of the one being read, per thread
+#define CAN_LOG_PARALLEL_AHEAD (2)
+
+/**
+ * CAN text log reader which parses the log on several threads: the log is memory
+ * mapped and split into chunks at line boundaries, the threads parse the chunks into
+ * runs of packets and the runs are returned in the log order, so the packets come
+ * exactly in the order CanLogReader reads them. Only a bounded window of chunks
+ * is parsed ahead of the reader, so the memory use doesn't depend on the log size.
+ */
+class CanLogParallelReader
+{
+public:
+   CanLogParallelReader();
+   ~CanLogParallelReader();
+
+   /**
+    * Opens the log, reads its header and starts the parser threads.
+    *
+    * @return POSIX error code or 0 on success
+    */
+   int open(const char *fname, int threads);
+   void close();
+
+   /**
+    * Returns the next packet, waiting for its chunk to be parsed if needed.
+    *
+    * @param ts - the packet time(usec since the epoch)
+    * @return POSIX error code or 0 on success, ENODATA if end of file is reached
+    */
+   int next(uint64_t &ts, canEvent &ev);
+
+   uint64_t timeBase() const { return rts; }
+
+private:
+   CanLogParallelReader(const CanLogParallelReader &);
+   CanLogParallelReader &operator=(const CanLogParallelReader &);
+
+   struct canPacket
+   {
+      uint64_t ts;
+      canEvent ev;
+   };
+
+   struct chunkRun
+   {
+      std::vector<canPacket> packets;
+      bool done;
+      int err;
+   };
+
+   static void *thread(void *arg);
+   int parse(size_t chunk, std::vector<canPacket> &packets);
+   void release(size_t chunk);
+
+   char *map;
+   uint64_t fileSize;
+   uint64_t rts;
+   std::vector<uint64_t> bounds;   //chunk i spans bounds[i]..bounds[i + 1]
+   std::vector<chunkRun> runs;     //chunk i is parsed into runs[i % runs.size()]
+   std::vector<pthread_t> threads;
+   pthread_mutex_t lock;
+   pthread_cond_t cond;
+   //protected by lock
+   bool stop;
+   size_t scheduled;  //the next chunk to be taken by a thread
+   size_t current;    //the chunk being read
+   //used by the reader only
+   bool ready;        //the current run is parsed
+   size_t pos;        //the next packet of the current run
+};
+
+#endif // _CAN_LOG_PARALLEL_READER__
@@ -0,0 +1,387 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "canLogReader.h"
+
+//hex digit values, 0xFF marks the other characters
+static const uint8_t hexDigits[256] =
+{
+   0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+   0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+   0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+   0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+   0xFF, 0x0A, 0x0B, 0x0C, 0x0D, 0x0E, 0x0F, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+   0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+   0xFF, 0x0A, 0x0B, 0x0C, 0x0D, 0x0E, 0x0F, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+   0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+   0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+   0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+   0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+   0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+   0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+   0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+   0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+   0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+};
+
+static inline bool isSpace(char c)
+{
+   return (' ' == c) || ((c >= '\t') && (c <= '\r'));
+}
+
+/**
+ * Skips the white space and the given literal like a scanf() format does.
+ *
+ * @return position following the literal or NULL if it doesn't match
+ */
+static inline const char *parseLiteral(const char *p, const char *end, const char *literal, size_t len)
+{
+   while((p < end) && isSpace(*p))
+   {
+      p++;
+   }
+   if(((size_t)(end - p) < len) || (0 != memcmp(p, literal, len)))
+   {
+      return NULL;
+   }
+   return p + len;
+}
+
+/**
+ * Parses an unsigned decimal like %lu does, 8 digits are converted at once.
+ *
+ * @return position following the number or NULL if there is no number
+ */
+static inline const char *parseDec(const char *p, const char *end, uint64_t &value)
+{
+   while((p < end) && isSpace(*p))
+   {
+      p++;
+   }
+   const char *start = p;
+   uint64_t v = 0;
+   while(end - p >= 8)
+   {
+      uint64_t word;
+      memcpy(&word, p, sizeof(word));
+      //all 8 bytes are '0'..'9'
+      if((0 != ((word & 0xF0F0F0F0F0F0F0F0ull) ^ 0x3030303030303030ull))
+         || (0 != (((word + 0x0606060606060606ull) & 0xF0F0F0F0F0F0F0F0ull) ^ 0x3030303030303030ull)))
+      {
+         break;
+      }
+      word -= 0x3030303030303030ull;
+      word = (word * 10) + (word >> 8);
+      word = (((word & 0x000000FF000000FFull) * (100 + (1000000ull << 32)))
+              + (((word >> 16) & 0x000000FF000000FFull) * (1 + (10000ull << 32)))) >> 32;
+      v = v * 100000000 + word;
+      p += 8;
+   }
+   while((p < end) && ((uint8_t)(*p - '0') <= 9))
+   {
+      v = v * 10 + (uint8_t)(*p - '0');
+      p++;
+   }
+   if(p == start)
+   {
+      return NULL;
+   }
+   value = v;
+   return p;
+}
+
+/**
+ * Parses an unsigned hex like %x does.
+ *
+ * @return position following the number or NULL if there is no number
+ */
+static inline const char *parseHex(const char *p, const char *end, uint32_t &value)
+{
+   while((p < end) && isSpace(*p))
+   {
+      p++;
+   }
+   if((end - p > 2) && ('0' == p[0]) && ('x' == (p[1] | 0x20)) && (0xFF != hexDigits[(uint8_t)p[2]]))
+   {
+      p += 2;
+   }
+   const char *start = p;
+   uint32_t v = 0;
+   uint8_t digit;
+   while((p < end) && (0xFF != (digit = hexDigits[(uint8_t)*p])))
+   {
+      v = (v << 4) | digit;
+      p++;
+   }
+   if(p == start)
+   {
+      return NULL;
+   }
+   value = v;
+   return p;
+}
+
+/**
+ * Parses a line of a CAN text log, both dialects are recognized:
+ *    ts: 000000007938   084   [8]  66 D2 66 AE 04 50 71 E9
+ *    ts: 000000092770   ID:  47 LEN:8 DATA:20 00 00 00 00 00 00 00
+ * The fields are parsed like sscanf() %lu/%x/%u conversions do, but without the
+ * format interpretation: decimals are converted 8 digits at once and hex digits
+ * with a lookup table.
+ *
+ * @param end - the line end(the newline is not required)
+ * @param ts - the packet log time(usec)
+ */
+canLogLine canLogParseLine(const char *line, const char *end, uint64_t &ts, canEvent &ev)
+{
+   if((end - line < 4) || (0 != memcmp(line, "ts: ", 4)))
+   {
+      return CAN_LOG_LINE_OTHER;
+   }
+
+   uint64_t len;
+   uint32_t value;
+   const char *p = parseDec(line + 4, end, ts);
+   const char *id = (NULL != p) ? parseLiteral(p, end, "ID:", 3) : NULL;
+   if(NULL != id)
+   {
+      //ts: 000000092770   ID:  47 LEN:8 DATA:20 00 00 00 00 00 00 00
+      p = parseHex(id, end, ev.id);
+      p = (NULL != p) ? parseLiteral(p, end, "LEN:", 4) : NULL;
+      p = (NULL != p) ? parseDec(p, end, len) : NULL;
+      p = (NULL != p) ? parseLiteral(p, end, "DATA:", 5) : NULL;
+   }
+   else
+   {
+      //ts: 000000007938   084   [8]  66 D2 66 AE 04 50 71 E9
+      p = (NULL != p) ? parseHex(p, end, ev.id) : NULL;
+      p = (NULL != p) ? parseLiteral(p, end, "[", 1) : NULL;
+      p = (NULL != p) ? parseDec(p, end, len) : NULL;
+      p = (NULL != p) ? parseLiteral(p, end, "]", 1) : NULL;
+   }
+   for(int i=0; (NULL != p) && (i < 8); i++)
+   {
+      p = parseHex(p, end, value);
+      ev.data[i] = (uint8_t)value;
+   }
+   if(NULL == p)
+   {
+      return CAN_LOG_LINE_MALFORMED;
+   }
+   ev.len = (uint32_t)len;
+   return CAN_LOG_LINE_PACKET;
+}
+
+CanLogReader::CanLogReader()
+{
+   this->fd = -1;
+   this->blockOffset = 0;
+   this->blockPos = 0;
+   this->blockLen = 0;
+   this->probe = false;
+   this->fileSize = 0;
+   this->firstLine = 0;
+   this->rts = 0;
+}
+
+CanLogReader::~CanLogReader()
+{
+   close();
+}
+
+/**
+ * Opens the log and reads its header up to the rts time base.
+ *
+ * @return POSIX error code or 0 on success
+ */
+int CanLogReader::open(const char *fname)
+{
+   close();
+   this->fd = ::open(fname, O_RDONLY);
+   if(-1 == this->fd)
+   {
+      fprintf(stderr, "Unable to open the file %s(%s)\n", fname, strerror(errno));
+      return errno;
+   }
+
+   struct stat st;
+   if(0 != fstat(this->fd, &st))
+   {
+      int err = errno;
+      fprintf(stderr, "fstat(%s) failed(%s)\n", fname, strerror(err));
+      close();
+      return err;
+   }
+   this->fileSize = st.st_size;
+   this->block.resize(CAN_LOG_BLOCK_SIZE);
+   this->blockOffset = 0;
+   this->blockPos = 0;
+   this->blockLen = 0;
+   this->rts = 0;
+
+   const char *line;
+   const char *end;
+   while(0 == nextLine(line, end))
+   {
+      if((end - line >= 5) && (0 == memcmp(line, "rts: ", 5)))
+      {
+         uint64_t baseTs;
+         const char *p = parseDec(line + 5, end, this->rts);
+         p = (NULL != p) ? parseLiteral(p, end, "ts:", 3) : NULL;
+         if((NULL == p) || (NULL == parseDec(p, end, baseTs)))
+         {
+            fprintf(stderr, "Wrong RTS specification string: (%.*s)\n", (int)(end - line), line);
+            close();
+            return EIO;
+         }
+         this->firstLine = position();
+         break;
+      }
+   }
+
+   if(0u == this->rts)
+   {
+      fprintf(stderr, "Failed to init can dump timebase!\n");
+      close();
+      return EIO;
+   }
+   return 0;
+}
+
+void CanLogReader::close()
+{
+   if(-1 != this->fd)
+   {
+      ::close(this->fd);
+      this->fd = -1;
+   }
+}
+
+/**
+ * Moves the read position to the given file offset, the block is kept
+ * if the offset falls into it.
+ */
+void CanLogReader::setPosition(uint64_t offset)
+{
+   if((offset >= this->blockOffset) && (offset <= this->blockOffset + this->blockLen))
+   {
+      this->blockPos = offset - this->blockOffset;
+      return;
+   }
+   this->blockOffset = offset;
+   this->blockPos = 0;
+   this->blockLen = 0;
+   this->probe = true;
+}
+
+/**
+ * Locates the next line in the block, the block is refilled from the file if it
+ * holds no complete line. A line longer than the block is returned by parts.
+ *
+ * @param end - the line end, the newline is excluded
+ * @return POSIX error code or 0 on success, ENODATA if end of file is reached
+ */
+int CanLogReader::nextLine(const char *&line, const char *&end)
+{
+   for(;;)
+   {
+      const char *start = &this->block[0] + this->blockPos;
+      size_t avail = this->blockLen - this->blockPos;
+      const char *newline = (const char *)memchr(start, '\n', avail);
+      if(NULL != newline)
+      {
+         line = start;
+         end = newline;
+         this->blockPos += newline - start + 1;
+         return 0;
+      }
+
+      if(0 != this->blockPos)
+      {
+         memmove(&this->block[0], start, avail);
+         this->blockOffset += this->blockPos;
+         this->blockPos = 0;
+         this->blockLen = avail;
+      }
+
+      ssize_t got = 0;
+      if(this->blockLen < this->block.size())
+      {
+         size_t want = this->block.size() - this->blockLen;
+         if(this->probe && (want > CAN_LOG_PROBE_SIZE))
+         {
+            want = CAN_LOG_PROBE_SIZE;
+         }
+         this->probe = false;
+         got = pread(this->fd, &this->block[this->blockLen], want, this->blockOffset + this->blockLen);
+         if(-1 == got)
+         {
+            if(EINTR == errno)
+            {
+               continue;
+            }
+            int err = errno;
+            fprintf(stderr, "pread() failed(%s)\n", strerror(err));
+            return err;
+         }
+      }
+      if(0 == got)
+      {
+         //the last line without a newline or a part of a too long line
+         if(0 == this->blockLen)
+         {
+            return ENODATA;
+         }
+         line = &this->block[0];
+         end = line + this->blockLen;
+         this->blockPos = this->blockLen;
+         return 0;
+      }
+      this->blockLen += got;
+   }
+}
+
+/**
+ * Skips the rest of the current line, used after setPosition() into the middle of a line.
+ *
+ * @return POSIX error code or 0 on success, ENODATA if end of file is reached
+ */
+int CanLogReader::skipLine()
+{
+   const char *line;
+   const char *end;
+   return nextLine(line, end);
+}
+
+/**
+ * Reads up to the next packet line, the other lines are skipped and the malformed ones reported.
+ *
+ * @param ts - the packet time(usec since the epoch)
+ * @return POSIX error code or 0 on success, ENODATA if end of file is reached
+ */
+int CanLogReader::next(uint64_t &ts, canEvent &ev)
+{
+   const char *line;
+   const char *end;
+   int err;
+   while(0 == (err = nextLine(line, end)))
+   {
+      canLogLine kind = canLogParseLine(line, end, ts, ev);
+      if(CAN_LOG_LINE_PACKET == kind)
+      {
+         ts += this->rts;
+         return 0;
+      }
+      if(CAN_LOG_LINE_MALFORMED == kind)
+      {
+         fprintf(stderr, "Wrong line format: (%.*s)\n", (int)(end - line), line);
+      }
+   }
+   return err;
+}
@@ -0,0 +1,97 @@
+#ifndef _CAN_LOG_READER__
+#define _CAN_LOG_READER__
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include <vector>
+
+#include "eventlog.h"
+
+//the text log is read by blocks of this size, lines are parsed in place
+#define CAN_LOG_BLOCK_SIZE (1024*1024)
+//the first read after a jump is that small, seek() bisection reads a line or two per probe
+#define CAN_LOG_PROBE_SIZE (4096)
+
+enum canLogLine
+{
+   CAN_LOG_LINE_PACKET = 0, //the packet is parsed
+   CAN_LOG_LINE_OTHER,      //not a packet line
+   CAN_LOG_LINE_MALFORMED   //a packet line of unknown format
+};
+
+/**
+ * Parses a line of a CAN text log, both dialects are recognized:
+ *    ts: 000000007938   084   [8]  66 D2 66 AE 04 50 71 E9
+ *    ts: 000000092770   ID:  47 LEN:8 DATA:20 00 00 00 00 00 00 00
+ * The fields are parsed like sscanf() %lu/%x/%u conversions do, but without the
+ * format interpretation: decimals are converted 8 digits at once and hex digits
+ * with a lookup table.
+ *
+ * @param end - the line end(the newline is not required)
+ * @param ts - the packet log time(usec)
+ */
+canLogLine canLogParseLine(const char *line, const char *end, uint64_t &ts, canEvent &ev);
+
+/**
+ * Buffered reader of a CAN text log: the log is read by large blocks with pread()
+ * and the lines are located with memchr(), so no line is copied.
+ */
+class CanLogReader
+{
+public:
+   CanLogReader();
+   ~CanLogReader();
+
+   /**
+    * Opens the log and reads its header up to the rts time base.
+    *
+    * @return POSIX error code or 0 on success
+    */
+   int open(const char *fname);
+   void close();
+
+   /**
+    * Reads up to the next packet line, the other lines are skipped and the malformed ones reported.
+    *
+    * @param ts - the packet time(usec since the epoch)
+    * @return POSIX error code or 0 on success, ENODATA if end of file is reached
+    */
+   int next(uint64_t &ts, canEvent &ev);
+
+   /**
+    * Skips the rest of the current line, used after setPosition() into the middle of a line.
+    *
+    * @return POSIX error code or 0 on success, ENODATA if end of file is reached
+    */
+   int skipLine();
+
+   /**
+    * Moves the read position to the given file offset, the block is kept
+    * if the offset falls into it.
+    */
+   void setPosition(uint64_t offset);
+   uint64_t position() const { return blockOffset + blockPos; }
+
+   uint64_t size() const { return fileSize; }
+   uint64_t dataOffset() const { return firstLine; }
+   uint64_t timeBase() const { return rts; }
+
+private:
+   CanLogReader(const CanLogReader &);
+   CanLogReader &operator=(const CanLogReader &);
+
+   int nextLine(const char *&line, const char *&end);
+
+   int fd;
+   std::vector<char> block;
+   uint64_t blockOffset; //file offset of the block start
+   size_t blockPos;      //read position within the block
+   size_t blockLen;      //amount of valid data in the block
+   bool probe;           //the block was dropped by setPosition()
+   uint64_t fileSize;
+   uint64_t firstLine;   //offset of the line following the rts header
+   uint64_t rts;         //rts value form log header(rts: 1458726428015650 ts: 2659501121)
+};
+
+#endif // _CAN_LOG_READER__
@@ -16,60 +16,130 @@
 #include "multiLogReader.h"
 
 
+//time to wait for a sender thread to free a slot once its ring is full
+#define READER_BACKOFF_USEC (1000)
+
+//helper variable to control log evens playback loop
+static bool playbackActive = false;
+
 /**
- * Calculate time difference in microseconds
+ * Cached event as it is stored in dumpPlayer::cache followed by its data, padded
+ * to the record alignment.
  */
-static uint32_t timeDiffUsec(struct timeval *a, struct timeval *b)
+struct cacheRecord
 {
-   struct timeval res;
-   timersub(a, b, &res);
+   packetType type;
+   timeval ts;
+   int size;
+};
 
-   return  res.tv_sec * 1e6 + res.tv_usec;
+/**
+ * @return size of the cached event: the record and the data padded, so the next record is aligned
+ */
+static size_t cacheRecordSize(int size)
+{
+   return (sizeof(cacheRecord) + size + alignof(cacheRecord) - 1) & ~(alignof(cacheRecord) - 1);
 }
 
 /**
- * Calculate time difference in microseconds
+ * Appends the event to the in-memory copy of the log.
+ *
+ * @return false if the cache would exceed its limit
  */
-static uint32_t timeDiffUsec(struct timespec *a, struct timespec *b)
+static bool cacheAppend(dumpPlayer *ctx, packetType type, const timeval &ts, const char *data, int size)
 {
-   struct timeval aUsec = {a->tv_sec, a->tv_nsec/1000};
-   struct timeval bUsec = {b->tv_sec, b->tv_nsec/1000};
+   size_t pos = ctx->cache.size();
+   if(pos + cacheRecordSize(size) > ctx->cacheLimit)
+   {
+      return false;
+   }
+   ctx->cache.resize(pos + cacheRecordSize(size));
 
-   return timeDiffUsec(&aUsec, &bUsec);
+   cacheRecord *rec = (cacheRecord *)&ctx->cache[pos];
+   rec->type = type;
+   rec->ts = ts;
+   rec->size = size;
+   memcpy(&ctx->cache[pos + sizeof(cacheRecord)], data, size);
+   return true;
 }
 
-//helper variable to control log evens playback loop
-static bool playbackActive = false;
-
 /**
- * Reads events from the event log and sends it with appropriate
- * player(CAN or RTP). Calculates time difference to the next event and
- * sleep for this timeout.
+ * Returns the view of the event at the given position of the in-memory copy
+ * of the log and advances the position.
  *
- * Once end of file is reached the player rewinds log and start from the
- * begging.
+ * @return amount of data or 0 if end of the cache is reached
  */
-static void *dumpPlayerbackThread(void *arg)
+static int cacheRead(dumpPlayer *ctx, size_t &pos, packetType &type, timeval &ts, const char *&data)
 {
-   dumpPlayer *ctx = (dumpPlayer *)arg;
+   if(pos >= ctx->cache.size())
+   {
+      return 0;
+   }
+   const cacheRecord *rec = (const cacheRecord *)&ctx->cache[pos];
+   type = rec->type;
+   ts = rec->ts;
+   data = &ctx->cache[pos + sizeof(cacheRecord)];
+   pos += cacheRecordSize(rec->size);
+   return rec->size;
+}
 
-   std::vector<ILogFile*> fileList;
-   fileList.push_back(&ctx->canLog);
-   fileList.push_back(&ctx->rtpLog);
+/**
+ * Shifts the timestamp by the given amount of microseconds.
+ */
+static void timevalAddUsec(timeval *ts, int64_t usec)
+{
+   int64_t t = (int64_t)ts->tv_sec * 1000000 + ts->tv_usec + usec;
+   ts->tv_sec = t / 1000000;
+   ts->tv_usec = t % 1000000;
+}
 
-   MultiLogReader reader(fileList);
+/**
+ * Reads and decodes events from the event logs ahead of the playback and
+ * dispatches them into the ring of the bus(CAN or RTP) they are sent with,
+ * so file I/O and parsing never delay a send deadline. The events are dispatched
+ * in the log order, so while the ring of the next event is full the other rings
+ * aren't refilled: they keep their buses playing for up to DUMP_PLAYER_RING_SIZE events.
+ * The events of a dead bus are dropped and counted.
+ *
+ * Once end of file is reached and rewind is enabled the log is started over
+ * from the begging: events of the next loop are shifted by the log duration
+ * plus the mean gap between events, so the playback goes on without a pause.
+ * The first loop is kept in memory if it fits the cache limit and the
+ * following loops are played from there.
+ *
+ * Events are taken as views of the reader(or cache) storage and copied once,
+ * straight into the ring slot.
+ */
+static void *dumpPlayerReaderThread(void *arg)
+{
+   dumpPlayer *ctx = (dumpPlayer *)arg;
+   MultiLogReader *reader = ctx->reader;
 
    packetType type;
-   char data[2000];
-   timeval prevTs = {0, 0};
    timeval ts;
-
-   struct timespec startTimestap;
-   struct timespec endTimestap;
+   const char *data;
+   bool first = true;
+   timeval lastTs = {0, 0};
+   uint64_t loopEvents = 0;       //events of the first loop
+   int64_t loopShift = 0;         //usec, added to the timestamps of the current loop
+   int64_t loopPeriod = 0;
+   uint32_t loop = 0;
+   bool caching = (0 != ctx->cacheLimit);
+   size_t cachePos = 0;
+   ctx->cache.clear();
 
    while(playbackActive)
    {
-      int err = reader.read(type, ts,  data, sizeof(data));
+      int err;
+      bool fromCache = caching && (0 != loop);
+      if(fromCache)
+      {
+         err = cacheRead(ctx, cachePos, type, ts, data);
+      }
+      else
+      {
+         err = reader->readView(type, ts, data);
+      }
       if(-1 == err)
       {
          fprintf(stderr, "reader.read() failed(%i)\n", errno);
@@ -77,73 +147,703 @@ static void *dumpPlayerbackThread(void *arg)
       }
       if(0 == err)
       {
-         //@TODO process rewind
+         if(!ctx->rewind || (0 == loopEvents))
+         {
+            break;
+         }
+         if(0 == loop)
+         {
+            timeval duration;
+            timersub(&lastTs, &ctx->logStart, &duration);
+            int64_t usec = (int64_t)duration.tv_sec * 1000000 + duration.tv_usec;
+            loopPeriod = usec + ((loopEvents > 1) ? usec / (int64_t)(loopEvents - 1) : 1);
+            ctx->loopPeriod.store(loopPeriod);
+            if(caching)
+            {
+               printf("Log is cached in memory(%zu bytes), loops are played without file I/O\n", ctx->cache.size());
+            }
+         }
+         loop++;
+         loopShift += loopPeriod;
+         if(caching)
+         {
+            cachePos = 0;
+         }
+         else
+         {
+            err = ctx->startTsValid ? reader->seek(ctx->startTs) : reader->rewind();
+            if(0 != err)
+            {
+               fprintf(stderr, "reader.rewind() failed(%s)\n", strerror(err));
+               break;
+            }
+         }
+         continue;
+      }
+      int size = err;
+
+      if((type >= PACKET_TYPE_MAX) || !ctx->buses[type].active)
+      {
+         fprintf(stderr,"Unknown packet type(%u)\n", type);
+         continue;
+      }
+      if(size > EVENT_LOG_MAX_PACKET_SIZE)
+      {
+         fprintf(stderr,"Packet is too large(%i)\n", size);
+         continue;
+      }
+      if(0 == loop)
+      {
+         if(first)
+         {
+            ctx->logStart = ts;
+            first = false;
+         }
+         lastTs = ts;
+         loopEvents++;
+         if(caching && !cacheAppend(ctx, type, ts, data, size))
+         {
+            printf("Log exceeds the cache size(%zu bytes), loops are read from the files\n", ctx->cacheLimit);
+            std::vector<char>().swap(ctx->cache);
+            caching = false;
+         }
+      }
+      else
+      {
+         timevalAddUsec(&ts, loopShift);
+      }
+
+      dumpPlayerBus *bus = &ctx->buses[type];
+      EventRing *ring = bus->ring;
+      ringEvent *slot;
+      while((NULL == (slot = ring->slot())) && playbackActive && !bus->dead.load())
+      {
+         //a full ring means the buses have enough events to start with
+         ctx->prefilled.store(true);
+         usleep(READER_BACKOFF_USEC);
+      }
+      if(!playbackActive)
+      {
          break;
       }
-      int len = err;
+      if(bus->dead.load())
+      {
+         //nothing drains the ring of the bus any more
+         bus->dropped++;
+         continue;
+      }
 
-      clock_gettime(CLOCK_MONOTONIC, &endTimestap);
-      int timespend = timeDiffUsec(&endTimestap, &startTimestap);
-      if((0 != prevTs.tv_sec) && (0 != prevTs.tv_usec))
+      slot->type = type;
+      slot->ts = ts;
+      slot->loop = loop;
+      if((PACKET_TYPE_RTP == type) && (size > (int)sizeof(rtpHeader)) && !fromCache && reader->persistentView())
+      {
+         //only the header is rewritten by the sender, the payload goes from the page cache to the socket
+         slot->size = sizeof(rtpHeader);
+         slot->tail = data + sizeof(rtpHeader);
+         slot->tailSize = size - sizeof(rtpHeader);
+         memcpy(slot->data, data, sizeof(rtpHeader));
+      }
+      else
       {
-         int time2nextEvent = timeDiffUsec(&ts, &prevTs);
-         int time2sleep = time2nextEvent - timespend;
+         slot->size = size;
+         slot->tail = NULL;
+         slot->tailSize = 0;
+         memcpy(slot->data, data, size);
+      }
+      ring->push();
+   }
 
-         if(1 < time2sleep)
-            usleep(time2sleep);
+   if(0 != loop)
+   {
+      printf("Log was played %u times over\n", loop);
+   }
+   for(int i=0; i<PACKET_TYPE_MAX; i++)
+   {
+      if(ctx->buses[i].active && (0 != ctx->buses[i].dropped))
+      {
+         printf("%s bus stopped, %llu of its events were dropped\n", ctx->buses[i].name
+                , (unsigned long long)ctx->buses[i].dropped);
       }
-      clock_gettime(CLOCK_MONOTONIC, &startTimestap);
+   }
 
-      if(PACKET_TYPE_RTP == type)
+   for(int i=0; i<PACKET_TYPE_MAX; i++)
+   {
+      if(ctx->buses[i].active)
+      {
+         ctx->buses[i].ring->finish();
+      }
+   }
+   ctx->prefilled.store(true);
+
+   return 0;
+}
+
+/**
+ * Lets the sender know that the event starts a new loop of the log.
+ */
+static void busFollowLoop(dumpPlayerBus *bus, const ringEvent *ev)
+{
+   if(ev->loop != bus->loop)
+   {
+      bus->loop = ev->loop;
+      if(NULL != bus->rewind)
+      {
+         bus->rewind(bus->sender);
+      }
+   }
+}
+
+/**
+ * Queues the front event and the following ones which are due within the batch
+ * window from it, so they are sent with a single syscall at the front event deadline.
+ *
+ * @return amount of queued events or -1 on error
+ */
+static int busQueueBatch(dumpPlayerBus *bus, ringEvent *front)
+{
+   bool paced = (PLAYBACK_WAIT_NONE != bus->clock.mode);
+
+   struct timespec first;
+   playbackClockDeadline(&bus->clock, &front->ts, &first);
+   struct timespec deadline = first;
+
+   int count = 0;
+   ringEvent *ev = front;
+   while(NULL != ev)
+   {
+      busFollowLoop(bus, ev);
+      int err = bus->queue(bus->sender, ev, paced ? &deadline : NULL);
+      if(ENOBUFS == err)
+      {
+         break;
+      }
+      if(0 != err)
+      {
+         fprintf(stderr,"%s: queue failed(%s)\n", bus->name, strerror(err));
+         return -1;
+      }
+      count++;
+
+      ev = bus->ring->peek(count);
+      if(NULL != ev)
+      {
+         playbackClockDeadline(&bus->clock, &ev->ts, &deadline);
+         if(timespecDiffNsec(&deadline, &first) > bus->batchWindow)
+         {
+            break;
+         }
+      }
+   }
+
+   return count;
+}
+
+/**
+ * @return true if the deadline of the event has already passed
+ */
+static bool busEventLate(dumpPlayerBus *bus, const ringEvent *ev)
+{
+   if(PLAYBACK_WAIT_NONE == bus->clock.mode)
+   {
+      //every event is due at once
+      return true;
+   }
+   struct timespec deadline, now;
+   playbackClockDeadline(&bus->clock, &ev->ts, &deadline);
+   clock_gettime(CLOCK_MONOTONIC, &now);
+   return timespecDiffNsec(&now, &deadline) > 0;
+}
+
+/**
+ * Pops decoded events from the bus ring and sends it with the bus sender.
+ * Each event is sent at the absolute deadline computed by the bus clock from
+ * the time base shared by all buses, so wakeup errors never accumulate and
+ * a stalled bus delays the other ones only once their rings are played out.
+ */
+static void *dumpPlayerBusThread(void *arg)
+{
+   dumpPlayerBus *bus = (dumpPlayerBus *)arg;
+   dumpPlayer *ctx = bus->player;
+
+   //the start barrier is only entered once every bus thread is created, then every bus
+   //passes both barrier waits even if the playback is stopped meanwhile
+   pthread_mutex_lock(&ctx->gateLock);
+   while(!ctx->gateOpen)
+   {
+      pthread_cond_wait(&ctx->gateCond, &ctx->gateLock);
+   }
+   bool cancelled = ctx->gateCancelled;
+   pthread_mutex_unlock(&ctx->gateLock);
+   if(cancelled)
+   {
+      return 0;
+   }
+
+   rtProfileThreadInit(&ctx->rt, bus->name, stdout);
+   playbackClockInit(&bus->clock, &ctx->timebase, ctx->waitMode);
+   bus->clock.lead = bus->lead;
+   if(PLAYBACK_WAIT_HYBRID == ctx->waitMode)
+   {
+      int64_t slack = playbackClockCalibrate(&bus->clock);
+      printf("%s: calibrated wakeup slack: %.1f usec\n", bus->name, slack/1e3);
+   }
+
+   //let the reader prefill the rings, then the last bus ready captures the common epoch
+   while(playbackActive && !ctx->prefilled.load())
+   {
+      usleep(READER_BACKOFF_USEC);
+   }
+   if(PTHREAD_BARRIER_SERIAL_THREAD == pthread_barrier_wait(&ctx->startBarrier))
+   {
+      playbackTimebaseStart(&ctx->timebase, &ctx->logStart);
+   }
+   pthread_barrier_wait(&ctx->startBarrier);
+   bus->ring->resetStats();
+
+   while(playbackActive)
+   {
+      ringEvent *ev = bus->ring->front();
+      if(NULL == ev)
       {
-         err = rtpSenderSend(&ctx->rtpSend, data, len);
-         if(0 != err)
+         //the bus has nothing to send yet(sparse log or the reader is behind), the thread sleeps
+         ev = bus->ring->wait();
+         if(NULL == ev)
          {
-            fprintf(stderr,"rtpSenderSend() failed(%s)\n", strerror(err));
             break;
          }
+         if(busEventLate(bus, ev))
+         {
+            //underrun: the reader didn't provide the event before its deadline
+            bus->ring->underruns++;
+         }
       }
-      else if (PACKET_TYPE_CAN == type)
+
+      int err = playbackClockWait(&bus->clock, &ev->ts);
+      if(0 != err)
       {
-         err = canSenderSend(&ctx->canSend, data, len);
-         if(0 != err)
+         break;
+      }
+      busFollowLoop(bus, ev);
+
+      //the batch is queued once the wait is over, so a pause never leaves stale launch times in it
+      int count = 1;
+      if(bus->batchWindow > 0)
+      {
+         count = busQueueBatch(bus, ev);
+         if(count < 0)
          {
-            fprintf(stderr,"canSenderSend() failed(%s)\n", strerror(err));
             break;
          }
+         err = bus->flush(bus->sender);
+      }
+      else if(PLAYBACK_WAIT_NONE != bus->clock.mode)
+      {
+         struct timespec deadline;
+         playbackClockDeadline(&bus->clock, &ev->ts, &deadline);
+         err = bus->send(bus->sender, ev, &deadline);
       }
       else
       {
-         fprintf(stderr,"Unknown packet type(%u)\n", type);
-         continue;
+         err = bus->send(bus->sender, ev, NULL);
+      }
+      if(0 != err)
+      {
+         fprintf(stderr,"%s: send failed(%s)\n", bus->name, strerror(err));
+         break;
+      }
+
+      for(int i=0; i<count; i++)
+      {
+         const ringEvent *sent = bus->ring->peek(0);
+         playbackClockAccount(&bus->clock, sent->size + sent->tailSize);
+         bus->ring->pop();
+      }
+   }
+
+   //the reader drops the events of the bus from now on
+   bus->dead.store(true);
+
+   flockfile(stdout);
+   printf("%s bus:\n", bus->name);
+   playbackClockReport(&bus->clock, stdout);
+   printf("Prefetch ring: capacity %i, depth min %i max %i, underruns %llu\n"
+          , bus->ring->capacity(), bus->ring->minDepth, bus->ring->maxDepth
+          , (unsigned long long)bus->ring->underruns);
+   if(NULL != bus->report)
+   {
+      bus->report(bus->sender, stdout);
+   }
+   funlockfile(stdout);
+
+   return 0;
+}
+
+static int rtpBusSend(void *sender, ringEvent *ev, const struct timespec *deadline)
+{
+   return rtpSenderSend((rtpSender *)sender, ev->data, ev->size, ev->tail, ev->tailSize, deadline);
+}
+
+static int rtpBusQueue(void *sender, ringEvent *ev, const struct timespec *deadline)
+{
+   return rtpSenderQueue((rtpSender *)sender, ev->data, ev->size, ev->tail, ev->tailSize, deadline);
+}
+
+static int rtpBusFlush(void *sender)
+{
+   return rtpSenderFlush((rtpSender *)sender);
+}
+
+static void rtpBusReport(void *sender, FILE *out)
+{
+   rtpSenderReport((rtpSender *)sender, out);
+}
+
+static void rtpBusRewind(void *sender)
+{
+   rtpSenderRewind((rtpSender *)sender);
+}
+
+static int canBusSend(void *sender, ringEvent *ev, const struct timespec *deadline)
+{
+   return canSenderSend((canSender *)sender, ev->data, ev->size);
+}
+
+/**
+ * Bind the bus to its sender and create its ring.
+ */
+static void busInit(dumpPlayer *ctx, packetType type, const char *name
+                    , int (*send)(void *sender, ringEvent *ev, const struct timespec *deadline)
+                    , void *sender)
+{
+   dumpPlayerBus *bus = &ctx->buses[type];
+   bus->name = name;
+   bus->send = send;
+   bus->sender = sender;
+   bus->player = ctx;
+   bus->queue = NULL;
+   bus->flush = NULL;
+   bus->batchWindow = 0;
+   bus->lead = 0;
+   bus->report = NULL;
+   bus->rewind = NULL;
+   bus->loop = 0;
+   bus->ring = new EventRing(DUMP_PLAYER_RING_SIZE);
+   if(0 != ctx->rt.priority)
+   {
+      bus->ring->prefault();
+   }
+   bus->active = true;
+}
+
+/**
+ * Creates the bus thread with the real-time profile. If the profile can't be
+ * applied(no CAP_SYS_NICE or RLIMIT_RTPRIO) the thread is created with the
+ * default scheduling, so the playback still works.
+ *
+ * @return POSIX error code or 0 on success
+ */
+static int busCreateThread(dumpPlayer *ctx, dumpPlayerBus *bus, int index)
+{
+   pthread_attr_t attr;
+   int err = pthread_attr_init(&attr);
+   if(0 != err)
+   {
+      return err;
+   }
+
+   err = rtProfileThreadAttr(&ctx->rt, index, &attr);
+   if(0 == err)
+   {
+      err = pthread_create(&bus->thread, &attr, dumpPlayerBusThread, bus);
+      if(0 != err)
+      {
+         fprintf(stderr,"%s: real-time thread creation failed(%s), default scheduling is used\n"
+                 , bus->name, strerror(err));
+      }
+   }
+   pthread_attr_destroy(&attr);
+
+   if(0 != err)
+   {
+      err = pthread_create(&bus->thread, NULL, dumpPlayerBusThread, bus);
+   }
+   return err;
+}
+
+/**
+ * @return true if the RTP packet starts an H.264 keyframe: SPS or IDR slice
+ * as a single NAL unit, the first unit of STAP-A or the first fragment of FU-A
+ */
+static bool isKeyframe(const char *data, int size)
+{
+   const uint8_t *pkt = (const uint8_t *)data;
+   if(size < (int)sizeof(rtpHeader))
+   {
+      return false;
+   }
+   const rtpHeader *rtp = (const rtpHeader *)data;
+   int offset = sizeof(rtpHeader) + rtp->cc * 4;
+   if(rtp->x && (offset + 4 <= size))
+   {
+      offset += 4 + ((pkt[offset + 2] << 8) | pkt[offset + 3]) * 4;
+   }
+   if(offset + 2 > size)
+   {
+      return false;
+   }
+
+   int nalType = pkt[offset] & 0x1F;
+   if(24 == nalType) //STAP-A: 16 bit size precedes the first unit
+   {
+      if(offset + 4 > size)
+      {
+         return false;
+      }
+      nalType = pkt[offset + 3] & 0x1F;
+   }
+   else if(28 == nalType) //FU-A: start bit and the type of the fragmented unit
+   {
+      if(0 == (pkt[offset + 1] & 0x80))
+      {
+         return false;
+      }
+      nalType = pkt[offset + 1] & 0x1F;
+   }
+   return (5 == nalType) || (7 == nalType);
+}
+
+static int64_t timevalDiffUsec(const timeval *a, const timeval *b)
+{
+   return ((int64_t)a->tv_sec - b->tv_sec) * 1000000 + ((int64_t)a->tv_usec - b->tv_usec);
+}
+
+/**
+ * Positions the logs the given time(usec) after the log start, the RTP stream is
+ * snapped to the nearest H.264 keyframe within DUMP_PLAYER_KEYFRAME_WINDOW and
+ * the CAN log is positioned at the same time. Offset 0 starts from the log
+ * beginning as is. Loops(rewind) restart from the same position.
+ * Should be called before dumpPlayerStart().
+ *
+ * @return POSIX error code or 0 on success
+ */
+int dumpPlayerSeek(dumpPlayer *ctx, int64_t offset, dumpPlayerPosition *pos)
+{
+   struct timespec before, after;
+   clock_gettime(CLOCK_MONOTONIC, &before);
+
+   MultiLogReader *reader = ctx->reader;
+   memset(pos, 0, sizeof(dumpPlayerPosition));
+   ctx->startTsValid = false;
+
+   packetType type;
+   timeval ts;
+   const char *data;
+   int err = reader->rewind();
+   if(0 != err)
+   {
+      return err;
+   }
+   int size = reader->readView(type, ts, data);
+   if(size <= 0)
+   {
+      return (0 == size) ? ENODATA : errno;
+   }
+   timeval logStart = ts;
+   timeval startTs = logStart;
+
+   if(0 != offset)
+   {
+      timeval target = logStart;
+      timevalAddUsec(&target, offset);
+      timeval from = target;
+      timevalAddUsec(&from, -DUMP_PLAYER_KEYFRAME_WINDOW);
+
+      err = reader->seek(from);
+      if(0 != err)
+      {
+         return err;
+      }
+
+      startTs = target;
+      int64_t bestDistance = -1;
+      while((size = reader->readView(type, ts, data)) > 0)
+      {
+         int64_t distance = timevalDiffUsec(&ts, &target);
+         if(distance > DUMP_PLAYER_KEYFRAME_WINDOW)
+         {
+            break;
+         }
+         if((PACKET_TYPE_RTP == type) && isKeyframe(data, size))
+         {
+            int64_t absDistance = (distance < 0) ? -distance : distance;
+            if((bestDistance < 0) || (absDistance < bestDistance))
+            {
+               bestDistance = absDistance;
+               startTs = ts;
+            }
+            if(distance >= 0)
+            {
+               //the following keyframes are farther
+               break;
+            }
+         }
+      }
+      if(size < 0)
+      {
+         return errno;
+      }
+      if(bestDistance < 0)
+      {
+         printf("No keyframe within %.1f sec around %.3f sec, the playback starts from there as is\n"
+                , DUMP_PLAYER_KEYFRAME_WINDOW/1e6, offset/1e6);
+      }
+
+      ctx->startTs = startTs;
+      ctx->startTsValid = true;
+   }
+
+   //the first RTP packet to be sent is reported in RTP-Info
+   err = ctx->startTsValid ? reader->seek(startTs) : reader->rewind();
+   while((0 == err) && ((size = reader->readView(type, ts, data)) > 0))
+   {
+      if(timevalDiffUsec(&ts, &startTs) > DUMP_PLAYER_KEYFRAME_WINDOW)
+      {
+         break;
+      }
+      if(PACKET_TYPE_RTP == type)
+      {
+         const rtpHeader *rtp = (const rtpHeader *)data;
+         pos->rtpValid = true;
+         pos->seq = ntohs(rtp->seq);
+         pos->rtpTime = ntohl(rtp->ts);
+         break;
       }
-      prevTs = ts;
+   }
+   if(0 == err)
+   {
+      err = ctx->startTsValid ? reader->seek(startTs) : reader->rewind();
+   }
+   if(0 != err)
+   {
+      return err;
    }
 
+   pos->npt = timevalDiffUsec(&startTs, &logStart) / 1e6;
+   ctx->startNpt = pos->npt;
+   clock_gettime(CLOCK_MONOTONIC, &after);
+   printf("Seek to %.3f sec(keyframe at %.3f sec) took %.3f msec\n"
+          , offset/1e6, pos->npt, timespecDiffNsec(&after, &before)/1e6);
    return 0;
 }
 
 /**
- * Enable events playback and create the playback thread.
+ * Lets the bus threads waiting for the start gate go on, or leave if the start is cancelled.
+ */
+static void dumpPlayerOpenGate(dumpPlayer *ctx, bool cancelled)
+{
+   pthread_mutex_lock(&ctx->gateLock);
+   ctx->gateOpen = true;
+   ctx->gateCancelled = cancelled;
+   pthread_cond_broadcast(&ctx->gateCond);
+   pthread_mutex_unlock(&ctx->gateLock);
+}
+
+/**
+ * Enable events playback and create the reader and bus sender threads.
+ * If a thread can't be created the threads started so far are stopped and joined.
  *
  * @return POSIX error code or 0 on success
  */
 int dumpPlayerStart(dumpPlayer *ctx)
 {
+   int busCount = 0;
+   for(int i=0; i<PACKET_TYPE_MAX; i++)
+   {
+      if(ctx->buses[i].active)
+      {
+         busCount++;
+      }
+   }
+
+   playbackTimebaseInit(&ctx->timebase, ctx->speed);
+   ctx->prefilled.store(false);
+   for(int i=0; i<PACKET_TYPE_MAX; i++)
+   {
+      ctx->buses[i].dead.store(false);
+      ctx->buses[i].dropped = 0;
+   }
+   ctx->loopPeriod.store(0);
+   int err = pthread_barrier_init(&ctx->startBarrier, NULL, busCount);
+   if(0 != err)
+   {
+      fprintf(stderr,"pthread_barrier_init() failed(%s)\n", strerror(err));
+      return err;
+   }
+   pthread_mutex_init(&ctx->gateLock, NULL);
+   pthread_cond_init(&ctx->gateCond, NULL);
+   ctx->gateOpen = false;
+   ctx->gateCancelled = false;
+
    playbackActive = true;
 
-   int err = pthread_create(&ctx->playbackThread, NULL, dumpPlayerbackThread, ctx);
+   err = pthread_create(&ctx->readerThread, NULL, dumpPlayerReaderThread, ctx);
    if(0 != err)
    {
       fprintf(stderr,"pthread_create() failed(%s)\n", strerror(err));
+      playbackActive = false;
+      pthread_cond_destroy(&ctx->gateCond);
+      pthread_mutex_destroy(&ctx->gateLock);
+      pthread_barrier_destroy(&ctx->startBarrier);
+      playbackTimebaseDeinit(&ctx->timebase);
       return err;
    }
 
-   return err;
+   int started = 0;
+   for(int i=0; i<PACKET_TYPE_MAX; i++)
+   {
+      dumpPlayerBus *bus = &ctx->buses[i];
+      if(!bus->active)
+      {
+         continue;
+      }
+      err = busCreateThread(ctx, bus, started);
+      if(0 != err)
+      {
+         fprintf(stderr,"pthread_create() failed(%s)\n", strerror(err));
+         break;
+      }
+      started++;
+   }
+
+   if(0 != err)
+   {
+      //the started buses leave at the gate without entering the start barrier
+      playbackActive = false;
+      dumpPlayerOpenGate(ctx, true);
+      playbackTimebaseStop(&ctx->timebase);
+      pthread_join(ctx->readerThread, NULL);
+      for(int i=0; (i<PACKET_TYPE_MAX) && (started > 0); i++)
+      {
+         if(ctx->buses[i].active)
+         {
+            pthread_join(ctx->buses[i].thread, NULL);
+            started--;
+         }
+      }
+      pthread_cond_destroy(&ctx->gateCond);
+      pthread_mutex_destroy(&ctx->gateLock);
+      pthread_barrier_destroy(&ctx->startBarrier);
+      playbackTimebaseDeinit(&ctx->timebase);
+      return err;
+   }
+
+   dumpPlayerOpenGate(ctx, false);
+   return 0;
 }
 
 /**
- * Disable events playback and join the playback thread.
+ * Disable events playback and join the reader and bus sender threads.
  *
  * @return POSIX error code or 0 on success
  */
@@ -152,11 +852,66 @@ int dumpPlayerStop(dumpPlayer *ctx)
    if(playbackActive)
    {
       playbackActive = false;
-      pthread_join(ctx->playbackThread, NULL);
+      //releases the buses waiting for an event deadline, resume or an event in the ring
+      playbackTimebaseStop(&ctx->timebase);
+      for(int i=0; i<PACKET_TYPE_MAX; i++)
+      {
+         if(ctx->buses[i].active)
+         {
+            ctx->buses[i].ring->finish();
+         }
+      }
+      for(int i=0; i<PACKET_TYPE_MAX; i++)
+      {
+         if(ctx->buses[i].active)
+         {
+            pthread_join(ctx->buses[i].thread, NULL);
+         }
+      }
+      pthread_join(ctx->readerThread, NULL);
+      pthread_cond_destroy(&ctx->gateCond);
+      pthread_mutex_destroy(&ctx->gateLock);
+      pthread_barrier_destroy(&ctx->startBarrier);
+      playbackTimebaseDeinit(&ctx->timebase);
    }
    return 0;
 }
 
+/**
+ * Freezes the playback at the current event. The reader keeps the rings
+ * filled, so nothing has to be read once the playback is resumed.
+ */
+void dumpPlayerPause(dumpPlayer *ctx)
+{
+   if(playbackActive)
+   {
+      playbackTimebasePause(&ctx->timebase);
+   }
+}
+
+/**
+ * Resumes the paused playback from the event it was paused at: the schedule
+ * is shifted by the paused time, so no event is skipped or sent in a burst.
+ * The position is reported with the npt only, the RTP stream continues
+ * with the following sequence number. With rewind the npt is the position
+ * within the current loop.
+ */
+void dumpPlayerResume(dumpPlayer *ctx, dumpPlayerPosition *pos)
+{
+   memset(pos, 0, sizeof(dumpPlayerPosition));
+   if(playbackActive)
+   {
+      playbackTimebaseResume(&ctx->timebase);
+      int64_t elapsed = playbackTimebaseElapsed(&ctx->timebase);
+      int64_t period = ctx->loopPeriod.load() * 1000;
+      if(period > 0)
+      {
+         elapsed %= period;
+      }
+      pos->npt = ctx->startNpt + elapsed / 1e9;
+   }
+}
+
 /**
  * Opens the event log file and checks its header.
  * Also creates and configures CAN and RTP message players.
@@ -166,6 +921,20 @@ int dumpPlayerStop(dumpPlayer *ctx)
 int dumpPlayerInit(dumpPlayer *ctx, dumpPlayerCfg *cfg)
 {
    ctx->rewind = cfg->rewind;
+   ctx->cacheLimit = (size_t)cfg->cacheSize * 1024 * 1024;
+   ctx->startTsValid = false;
+   ctx->startNpt = 0;
+   ctx->waitMode = cfg->waitMode;
+   //there is no time scale to keep RTP timestamps consistent with in the unthrottled mode
+   ctx->speed = (PLAYBACK_WAIT_NONE == cfg->waitMode) ? 1.0 : cfg->speed;
+   if(NULL != cfg->rt)
+   {
+      ctx->rt = *cfg->rt;
+   }
+   else
+   {
+      memset(&ctx->rt, 0, sizeof(ctx->rt));
+   }
 
    int err = ctx->canLog.open(cfg->CANfname);
    if(0 != err)
@@ -174,20 +943,31 @@ int dumpPlayerInit(dumpPlayer *ctx, dumpPlayerCfg *cfg)
       return err;
    }
 
-   err = ctx->rtpLog.open(cfg->RTPfname);
+   //a raw capture is played as is, the RTP packets are filtered out of it while reading
+   bool capture = PcapLogFile::probe(cfg->RTPfname);
+   ctx->rtpFile = capture ? (ILogFile *)&ctx->captureLog : (ILogFile *)&ctx->rtpLog;
+   err = ctx->rtpFile->open(cfg->RTPfname);
    if(0 != err)
    {
       fprintf(stderr, "rtpLog.open(%s) failed(%s)\n", cfg->RTPfname, strerror(err));
       ctx->canLog.close();
       return err;
    }
+   const eventLogInfo *info = capture ? NULL : ctx->rtpLog.info();
+   if(NULL != info)
+   {
+      printf("%s: %.3f sec, %llu RTP packets(%llu bytes), %llu CAN packets, %u streams\n", cfg->RTPfname
+             , ((int64_t)info->lastSec - (int64_t)info->firstSec) + ((int64_t)info->lastUsec - (int64_t)info->firstUsec) / 1e6
+             , (unsigned long long)info->count[PACKET_TYPE_RTP], (unsigned long long)info->bytes[PACKET_TYPE_RTP]
+             , (unsigned long long)info->count[PACKET_TYPE_CAN], info->streamCount);
+   }
 
-   err = rtpSenderInit(&ctx->rtpSend, cfg->addr, cfg->port, cfg->ssrc);
+   err = rtpSenderInit(&ctx->rtpSend, cfg->addr, cfg->port, cfg->ssrc, ctx->speed, 0 != cfg->txtimeLead);
    if(0 != err)
    {
       fprintf(stderr, "rtpSenderInit() failed(%s)\n", strerror(err));
       ctx->canLog.close();
-      ctx->rtpLog.close();
+      ctx->rtpFile->close();
       return err;
    }
 
@@ -196,11 +976,29 @@ int dumpPlayerInit(dumpPlayer *ctx, dumpPlayerCfg *cfg)
    {
       fprintf(stderr, "canSenderInit() failed(%s)\n", strerror(err));
       ctx->canLog.close();
-      ctx->rtpLog.close();
+      ctx->rtpFile->close();
       rtpSenderDeinit(&ctx->rtpSend);
       return err;
    }
 
+   busInit(ctx, PACKET_TYPE_CAN, "CAN", canBusSend, &ctx->canSend);
+   busInit(ctx, PACKET_TYPE_RTP, "RTP", rtpBusSend, &ctx->rtpSend);
+   dumpPlayerBus *rtpBus = &ctx->buses[PACKET_TYPE_RTP];
+   rtpBus->queue = rtpBusQueue;
+   rtpBus->flush = rtpBusFlush;
+   rtpBus->batchWindow = (int64_t)cfg->batchWindow * 1000;
+   if(ctx->rtpSend.txtime && (PLAYBACK_WAIT_NONE != ctx->waitMode))
+   {
+      rtpBus->lead = (int64_t)cfg->txtimeLead * 1000;
+   }
+   rtpBus->report = rtpBusReport;
+   rtpBus->rewind = rtpBusRewind;
+
+   ctx->files.clear();
+   ctx->files.push_back(&ctx->canLog);
+   ctx->files.push_back(ctx->rtpFile);
+   ctx->reader = new MultiLogReader(ctx->files);
+
    return 0;
 }
 
@@ -211,6 +1009,16 @@ void dumpPlayerDeinit(dumpPlayer *ctx)
 {
    ctx->canLog.close();
    ctx->rtpLog.close();
+   ctx->captureLog.close();
    rtpSenderDeinit(&ctx->rtpSend);
    canSenderDeinit(&ctx->canSend);
+   delete ctx->reader;
+   ctx->reader = NULL;
+
+   for(int i=0; i<PACKET_TYPE_MAX; i++)
+   {
+      delete ctx->buses[i].ring;
+      ctx->buses[i].ring = NULL;
+      ctx->buses[i].active = false;
+   }
 }
@@ -9,24 +9,94 @@
 
 #include <pthread.h>
 
+#include <atomic>
+#include <vector>
+
 #include "canLogFile.h"
 #include "mixedLogFile.h"
+#include "pcapLogFile.h"
+#include "multiLogReader.h"
 
 #include "rtpSender.h"
 #include "canSender.h"
+#include "playbackClock.h"
+#include "eventRing.h"
+#include "rtProfile.h"
+
+//amount of events decoded ahead of the playback for each bus
+#define DUMP_PLAYER_RING_SIZE (1024)
+//seek: the nearest RTP keyframe is searched within the window(usec) around the requested time
+#define DUMP_PLAYER_KEYFRAME_WINDOW (5000000)
+
+struct dumpPlayer;
 
 /**
- * Player of evens log described in "eventlog.h". It contains a processor
- *  for RTP and CAN message types. Playback is done in a separate thread(playbackThread).
+ * Output bus(CAN, RTP, ...): the sender with its own thread, ring of decoded events
+ * and the playback clock. The events are dispatched by a single reader, which waits
+ * once the ring of the next event is full, so a stalled bus delays the other ones
+ * only after they played all the events of their rings(up to DUMP_PLAYER_RING_SIZE).
+ * Once the thread of a bus exits(send error) the bus is dead and the reader drops its
+ * events, so the other buses play on.
  */
 typedef struct
+{
+   const char *name;
+   //deadline is the CLOCK_MONOTONIC time the event is due, NULL if unthrottled
+   int (*send)(void *sender, ringEvent *ev, const struct timespec *deadline);
+   //optional batching: events due within batchWindow are queued and flushed at once
+   int (*queue)(void *sender, ringEvent *ev, const struct timespec *deadline);
+   int (*flush)(void *sender);
+   int64_t batchWindow;  //nsec, 0 - send events one by one
+   int64_t lead;         //nsec, events are handed to a self-pacing sender(SO_TXTIME) ahead of the deadline
+   void (*report)(void *sender, FILE *out); //optional sender statistics
+   void (*rewind)(void *sender);            //optional, called once the log is started over
+   uint32_t loop;       //loop of the last sent event
+   void *sender;
+   EventRing *ring;
+   playbackClock clock; //bus lateness statistics
+   pthread_t thread;
+   bool active;         //the bus is initialized and has a thread while playing
+   std::atomic<bool> dead; //the bus thread exited, its events are dropped
+   uint64_t dropped;    //reader: events of the dead bus
+   struct dumpPlayer *player;
+}dumpPlayerBus;
+
+/**
+ * Player of evens log described in "eventlog.h". It contains a processor
+ *  for RTP and CAN message types. Events are read and decoded ahead of time by
+ *  the reader thread(readerThread) and dispatched to the bus rings, each bus is
+ *  played by its own thread against the common time base.
+ */
+typedef struct dumpPlayer
 {
    CanLogFile canLog;
    MixedLogFile rtpLog;
-   pthread_t playbackThread;
+   PcapLogFile captureLog;               //the RTP log is a raw pcap/pcapng capture
+   ILogFile *rtpFile;                    //rtpLog or captureLog
+   std::vector<ILogFile*> files;         //logs merged by the reader
+   MultiLogReader *reader;
+   pthread_t readerThread;
+   dumpPlayerBus buses[PACKET_TYPE_MAX]; //indexed by packetType
+   pthread_barrier_t startBarrier;       //buses capture the common epoch together
+   pthread_mutex_t gateLock;             //the bus threads wait for the start gate until all of them are created
+   pthread_cond_t gateCond;
+   bool gateOpen;                        //protected by gateLock
+   bool gateCancelled;                   //protected by gateLock: a bus thread wasn't created, the buses leave
+   std::atomic<bool> prefilled;          //the reader has filled the rings to start playback
+   timeval logStart;                     //timestamp of the first event
+   playbackTimebase timebase;
    rtpSender rtpSend;
    canSender canSend;
+   playbackWaitMode waitMode;
+   double speed;
+   rtProfile rt;                         //scheduling of the bus threads
    int rewind;
+   size_t cacheLimit;                    //logs up to the size(bytes) are looped from memory, 0 - disabled
+   std::vector<char> cache;              //events of the first loop(cacheRecord + data)
+   timeval startTs;                      //log time the playback and every loop start from
+   bool startTsValid;                    //false - from the log beginning
+   double startNpt;                      //startTs as sec from the log start
+   std::atomic<int64_t> loopPeriod;      //rewind: usec between the starts of the loops, 0 - not known yet
 }dumpPlayer;
 
 typedef struct
@@ -39,6 +109,12 @@ typedef struct
    const char* canDeviceName; //like can0
    canFrameType canType; //standard or extended CAN frames
    int rewind;       //if 1 - the log is rewind once end of file is reached
+   int cacheSize;    //rewind: logs up to the size(MB) are kept in memory, so loops do no file I/O, 0 - disabled
+   playbackWaitMode waitMode; //how the bus threads wait for the next event
+   double speed;     //playback speed factor, ignored for PLAYBACK_WAIT_NONE
+   int batchWindow;  //RTP: packets due within the window(usec) are sent with a single syscall, 0 - disabled
+   int txtimeLead;   //RTP: hand packets to the kernel(usec) ahead of the deadline with SO_TXTIME, 0 - disabled
+   const rtProfile *rt; //real-time profile of the bus threads, NULL - default scheduling
 }dumpPlayerCfg;
 
 /**
@@ -50,19 +126,51 @@ typedef struct
 int dumpPlayerInit(dumpPlayer *ctx, dumpPlayerCfg *cfg);
 
 /**
- * Enable events playback and create the playback thread.
+ * Position the playback starts from, as reported to the RTSP client.
+ */
+typedef struct
+{
+   double npt;       //sec from the log start
+   bool rtpValid;    //there is an RTP packet to start with
+   uint16_t seq;     //RTP sequence number of the first packet
+   uint32_t rtpTime; //RTP timestamp of the first packet
+}dumpPlayerPosition;
+
+/**
+ * Positions the logs the given time(usec) after the log start, the RTP stream is
+ * snapped to the nearest H.264 keyframe within DUMP_PLAYER_KEYFRAME_WINDOW and
+ * the CAN log is positioned at the same time. Offset 0 starts from the log
+ * beginning as is. Loops(rewind) restart from the same position.
+ * Should be called before dumpPlayerStart().
+ *
+ * @return POSIX error code or 0 on success
+ */
+int dumpPlayerSeek(dumpPlayer *ctx, int64_t offset, dumpPlayerPosition *pos);
+
+/**
+ * Enable events playback and create the reader and bus sender threads.
  *
  * @return POSIX error code or 0 on success
  */
 int dumpPlayerStart(dumpPlayer *ctx);
 
 /**
- * Disable events playback and join the playback thread.
+ * Disable events playback and join the reader and bus sender threads.
  *
  * @return POSIX error code or 0 on success
  */
 int dumpPlayerStop(dumpPlayer *ctx);
 
+/**
+ * Freezes the playback at the current event.
+ */
+void dumpPlayerPause(dumpPlayer *ctx);
+
+/**
+ * Resumes the paused playback from the event it was paused at and reports the position.
+ */
+void dumpPlayerResume(dumpPlayer *ctx, dumpPlayerPosition *pos);
+
 /**
  * Close events log file handle and release CAN/RTP players.
  */
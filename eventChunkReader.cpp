@@ -0,0 +1,290 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+
+#include <unistd.h>
+#include <zlib.h>
+
+#include "eventChunkReader.h"
+
+
+EventChunkReader::EventChunkReader()
+{
+   this->fd = -1;
+   this->running = false;
+   this->stop = false;
+   this->epoch = 0;
+   this->first = 0;
+   this->produced = 0;
+   this->consumed = 0;
+   pthread_mutex_init(&this->lock, NULL);
+   pthread_cond_init(&this->cond, NULL);
+}
+
+EventChunkReader::~EventChunkReader()
+{
+   close();
+   pthread_cond_destroy(&this->cond);
+   pthread_mutex_destroy(&this->lock);
+}
+
+/**
+ * Reads exactly size bytes at the given offset.
+ *
+ * @return POSIX error code or 0 on success
+ */
+static int readAt(int fd, void *buf, size_t size, uint64_t offset)
+{
+   while(size > 0)
+   {
+      ssize_t got = pread(fd, buf, size, offset);
+      if(-1 == got)
+      {
+         if(EINTR == errno)
+         {
+            continue;
+         }
+         return errno;
+      }
+      if(0 == got)
+      {
+         return EIO;
+      }
+      buf = (char *)buf + got;
+      size -= got;
+      offset += got;
+   }
+   return 0;
+}
+
+/**
+ * Loads the directory of the log opened as fd and starts the decompression thread.
+ *
+ * @return POSIX error code or 0 on success
+ */
+int EventChunkReader::open(int fd, uint64_t fileSize, uint64_t dataOffset)
+{
+   close();
+
+   eventChunkFooter footer;
+   if((fileSize < dataOffset + sizeof(footer))
+      || (0 != readAt(fd, &footer, sizeof(footer), fileSize - sizeof(footer)))
+      || (0 != memcmp(footer.id, "ECHK", 4)) || (1 != footer.version)
+      || (footer.directoryOffset < dataOffset) || (footer.count > fileSize / sizeof(eventChunkEntry))
+      || (footer.directoryOffset + footer.count * sizeof(eventChunkEntry) != fileSize - sizeof(footer)))
+   {
+      fprintf(stderr, "Chunk directory of the compressed log is missing or broken\n");
+      return EINVAL;
+   }
+
+   this->directory.resize(footer.count);
+   if(!this->directory.empty())
+   {
+      int err = readAt(fd, &this->directory[0], footer.count * sizeof(eventChunkEntry), footer.directoryOffset);
+      if(0 != err)
+      {
+         fprintf(stderr, "Unable to read the chunk directory(%s)\n", strerror(err));
+         this->directory.clear();
+         return err;
+      }
+   }
+
+   uLong maxPacked = 0;
+   for(size_t i=0; i<this->directory.size(); i++)
+   {
+      const eventChunkEntry &e = this->directory[i];
+      if((e.offset < dataOffset) || (e.offset + e.compressedSize > footer.directoryOffset)
+         || (e.size > EVENT_LOG_CHUNK_SIZE) || (e.compressedSize > compressBound(e.size)))
+      {
+         fprintf(stderr, "Malformed chunk %llu in the directory\n", (unsigned long long)i);
+         this->directory.clear();
+         return EINVAL;
+      }
+      if(e.compressedSize > maxPacked)
+      {
+         maxPacked = e.compressedSize;
+      }
+   }
+
+   this->packed.resize(maxPacked);
+   for(int i=0; i<EVENT_CHUNK_READER_DEPTH; i++)
+   {
+      this->slots[i].data.resize(EVENT_LOG_CHUNK_SIZE);
+      this->slots[i].size = 0;
+      this->slots[i].err = 0;
+   }
+
+   this->fd = fd;
+   this->stop = false;
+   this->first = this->directory.size();
+   this->produced = 0;
+   this->consumed = 0;
+   int err = pthread_create(&this->tid, NULL, thread, this);
+   if(0 != err)
+   {
+      fprintf(stderr, "pthread_create() failed(%s)\n", strerror(err));
+      this->fd = -1;
+      this->directory.clear();
+      return err;
+   }
+   this->running = true;
+   return 0;
+}
+
+/**
+ * Stops the decompression thread, the file descriptor is owned by the caller.
+ */
+void EventChunkReader::close()
+{
+   if(this->running)
+   {
+      pthread_mutex_lock(&this->lock);
+      this->stop = true;
+      pthread_cond_broadcast(&this->cond);
+      pthread_mutex_unlock(&this->lock);
+      pthread_join(this->tid, NULL);
+      this->running = false;
+   }
+   this->fd = -1;
+   this->directory.clear();
+}
+
+/**
+ * Finds the last chunk starting earlier than the given time, so all the packets
+ * not earlier than it are in the chunk or after it.
+ *
+ * @return chunk number, 0 if the time precedes all chunks
+ */
+size_t EventChunkReader::find(const timeval &ts) const
+{
+   size_t lo = 0;
+   size_t hi = this->directory.size();
+   //the first chunk starting not earlier than ts
+   while(lo < hi)
+   {
+      size_t mid = (lo + hi) / 2;
+      const eventChunkEntry &e = this->directory[mid];
+      bool earlier = (e.sec < (uint64_t)ts.tv_sec) || ((e.sec == (uint64_t)ts.tv_sec) && (e.usec < (uint64_t)ts.tv_usec));
+      if(earlier)
+      {
+         lo = mid + 1;
+      }
+      else
+      {
+         hi = mid;
+      }
+   }
+   return (0 == lo) ? 0 : lo - 1;
+}
+
+/**
+ * Restarts the decompression from the given chunk, the data returned by next()
+ * before becomes invalid.
+ */
+void EventChunkReader::start(size_t chunk)
+{
+   pthread_mutex_lock(&this->lock);
+   this->epoch++;
+   this->first = (chunk < this->directory.size()) ? chunk : this->directory.size();
+   this->produced = 0;
+   this->consumed = 0;
+   pthread_cond_broadcast(&this->cond);
+   pthread_mutex_unlock(&this->lock);
+}
+
+/**
+ * Returns the next chunk records, waiting for its decompression if needed.
+ * The data stays valid until the next call or start().
+ *
+ * @return POSIX error code or 0 on success, ENODATA if there are no more chunks
+ */
+int EventChunkReader::next(const char *&data, size_t &size)
+{
+   pthread_mutex_lock(&this->lock);
+   if(this->first + this->consumed >= this->directory.size())
+   {
+      pthread_mutex_unlock(&this->lock);
+      return ENODATA;
+   }
+   while(this->consumed == this->produced)
+   {
+      pthread_cond_wait(&this->cond, &this->lock);
+   }
+   chunkSlot *slot = &this->slots[this->consumed % EVENT_CHUNK_READER_DEPTH];
+   this->consumed++;
+   //the slot held before is free for the thread now
+   pthread_cond_broadcast(&this->cond);
+   pthread_mutex_unlock(&this->lock);
+
+   if(0 != slot->err)
+   {
+      return slot->err;
+   }
+   data = &slot->data[0];
+   size = slot->size;
+   return 0;
+}
+
+/**
+ * Decompresses the chunk into the slot.
+ *
+ * @return POSIX error code or 0 on success
+ */
+int EventChunkReader::decompress(size_t chunk, chunkSlot *slot)
+{
+   const eventChunkEntry &e = this->directory[chunk];
+   int err = readAt(this->fd, &this->packed[0], e.compressedSize, e.offset);
+   if(0 != err)
+   {
+      fprintf(stderr, "Unable to read chunk %llu(%s)\n", (unsigned long long)chunk, strerror(err));
+      return err;
+   }
+
+   uLongf size = slot->data.size();
+   int zerr = uncompress((Bytef *)&slot->data[0], &size, (const Bytef *)&this->packed[0], e.compressedSize);
+   if((Z_OK != zerr) || (size != e.size))
+   {
+      fprintf(stderr, "Chunk %llu is corrupted(%s)\n", (unsigned long long)chunk, (Z_OK != zerr) ? zError(zerr) : "size mismatch");
+      return EIO;
+   }
+   slot->size = size;
+   return 0;
+}
+
+/**
+ * Decompression thread: keeps the slots ahead of the reader filled, the slot
+ * held by the reader is never overwritten.
+ */
+void *EventChunkReader::thread(void *arg)
+{
+   EventChunkReader *ctx = (EventChunkReader *)arg;
+
+   pthread_mutex_lock(&ctx->lock);
+   while(!ctx->stop)
+   {
+      if((ctx->first + ctx->produced >= ctx->directory.size())
+         || (ctx->produced - ctx->consumed >= EVENT_CHUNK_READER_DEPTH - 1))
+      {
+         pthread_cond_wait(&ctx->cond, &ctx->lock);
+         continue;
+      }
+
+      uint32_t epoch = ctx->epoch;
+      size_t chunk = ctx->first + ctx->produced;
+      chunkSlot *slot = &ctx->slots[ctx->produced % EVENT_CHUNK_READER_DEPTH];
+      pthread_mutex_unlock(&ctx->lock);
+
+      int err = ctx->decompress(chunk, slot);
+
+      pthread_mutex_lock(&ctx->lock);
+      if(epoch == ctx->epoch)
+      {
+         slot->err = err;
+         ctx->produced++;
+         pthread_cond_broadcast(&ctx->cond);
+      }
+   }
+   pthread_mutex_unlock(&ctx->lock);
+   return NULL;
+}
@@ -0,0 +1,93 @@
+#ifndef _EVENT_CHUNK_READER__
+#define _EVENT_CHUNK_READER__
+
+#include <stdint.h>
+#include <time.h>
+#include <sys/time.h>
+
+#include <pthread.h>
+
+#include <vector>
+
+#include "eventlog.h"
+
+//amount of decompressed chunks, the background thread keeps DEPTH - 1 of them ready
+//ahead of the one being read
+#define EVENT_CHUNK_READER_DEPTH (4)
+
+/**
+ * Reader of the chunks of a block compressed events log(@see EVENT_LOG_COMPRESSED).
+ * The chunk directory is loaded by open(), the chunks are decompressed by a background
+ * thread ahead of the reader, so the reading thread only waits for a chunk if the
+ * decompression can't keep up with it.
+ */
+class EventChunkReader
+{
+public:
+   EventChunkReader();
+   ~EventChunkReader();
+
+   /**
+    * Loads the directory of the log opened as fd and starts the decompression thread.
+    *
+    * @return POSIX error code or 0 on success
+    */
+   int open(int fd, uint64_t fileSize, uint64_t dataOffset);
+   void close();
+
+   /**
+    * Finds the last chunk starting earlier than the given time, so all the packets
+    * not earlier than it are in the chunk or after it.
+    *
+    * @return chunk number, 0 if the time precedes all chunks
+    */
+   size_t find(const timeval &ts) const;
+
+   /**
+    * Restarts the decompression from the given chunk, the data returned by next()
+    * before becomes invalid.
+    */
+   void start(size_t chunk);
+
+   /**
+    * Returns the next chunk records, waiting for its decompression if needed.
+    * The data stays valid until the next call or start().
+    *
+    * @return POSIX error code or 0 on success, ENODATA if there are no more chunks
+    */
+   int next(const char *&data, size_t &size);
+
+   size_t count() const { return directory.size(); }
+
+private:
+   EventChunkReader(const EventChunkReader &);
+   EventChunkReader &operator=(const EventChunkReader &);
+
+   struct chunkSlot
+   {
+      std::vector<char> data;
+      size_t size;
+      int err; //decompression error
+   };
+
+   static void *thread(void *arg);
+   int decompress(size_t chunk, chunkSlot *slot);
+
+   int fd;
+   std::vector<eventChunkEntry> directory;
+   chunkSlot slots[EVENT_CHUNK_READER_DEPTH];
+   std::vector<char> packed;  //compressed chunk, used by the thread only
+   pthread_t tid;
+   bool running;
+   pthread_mutex_t lock;
+   pthread_cond_t cond;
+   //protected by lock: chunk first + n is decompressed into slots[n % DEPTH],
+   //the reader holds the slot of chunk first + consumed - 1
+   bool stop;
+   uint32_t epoch;     //incremented by start() to drop the work in progress
+   size_t first;
+   size_t produced;
+   size_t consumed;
+};
+
+#endif // _EVENT_CHUNK_READER__
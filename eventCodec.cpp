@@ -0,0 +1,200 @@
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+
+#include "eventCodec.h"
+
+/**
+ * @return amount of written bytes
+ */
+static inline int putVarint(uint8_t *out, uint64_t value)
+{
+   int n = 0;
+   while(value >= 0x80)
+   {
+      out[n++] = (uint8_t)(value | 0x80);
+      value >>= 7;
+   }
+   out[n++] = (uint8_t)value;
+   return n;
+}
+
+/**
+ * @return amount of read bytes, 0 if the varint doesn't fit into avail bytes or is too long
+ */
+static inline int getVarint(const uint8_t *in, size_t avail, uint64_t &value)
+{
+   if(avail >= 8)
+   {
+      //up to 8 bytes are decoded at once without branching on the length
+      uint64_t word;
+      memcpy(&word, in, sizeof(word));
+      uint64_t stop = ~word & 0x8080808080808080ull;
+      if(0 != stop)
+      {
+         int bits = __builtin_ctzll(stop) + 1;
+         if(bits < 64)
+         {
+            word &= (1ull << bits) - 1;
+         }
+         value = (word & 0x7Full) | ((word >> 1) & 0x3F80ull) | ((word >> 2) & 0x1FC000ull)
+               | ((word >> 3) & 0xFE00000ull) | ((word >> 4) & 0x7F0000000ull) | ((word >> 5) & 0x3F800000000ull)
+               | ((word >> 6) & 0x1FC0000000000ull) | ((word >> 7) & 0xFE000000000000ull);
+         return bits / 8;
+      }
+   }
+
+   int max = (avail < 10) ? (int)avail : 10;
+   uint64_t v = 0;
+   for(int n=0; n < max; n++)
+   {
+      v |= (uint64_t)(in[n] & 0x7F) << (7 * n);
+      if(0 == (in[n] & 0x80))
+      {
+         value = v;
+         return n + 1;
+      }
+   }
+   return 0;
+}
+
+/**
+ * Encodes the packet as a record into out, which should have room for
+ * EVENT_LOG_V2_MAX_RECORD bytes. CAN packets should hold a canEvent.
+ *
+ * @param absolute - store the timestamp as is instead of the difference from prevNs
+ * @return size of the record or -1 if the packet can't be encoded(errno is set to the error code)
+ */
+int eventCodecEncode(uint8_t *out, packetType type, int64_t tsNs, int64_t prevNs, bool absolute
+                     , const char *data, int size)
+{
+   if(((int)type > EVENT_LOG_V2_TYPE_MASK) || (size < 0) || (size > EVENT_LOG_MAX_PACKET_SIZE))
+   {
+      errno = EINVAL;
+      return -1;
+   }
+
+   uint8_t tag = (uint8_t)type;
+   int n = 1;
+   if(absolute)
+   {
+      tag |= EVENT_LOG_V2_ABSOLUTE;
+      n += putVarint(out + n, (uint64_t)tsNs);
+   }
+   else
+   {
+      int64_t delta = tsNs - prevNs;
+      n += putVarint(out + n, ((uint64_t)delta << 1) ^ (uint64_t)(delta >> 63));
+   }
+
+   if(PACKET_TYPE_CAN == type)
+   {
+      if(size < (int)sizeof(canEvent))
+      {
+         errno = EINVAL;
+         return -1;
+      }
+      const canEvent *can = (const canEvent *)data;
+      uint32_t len = (can->len > sizeof(can->data)) ? sizeof(can->data) : can->len;
+      tag |= (uint8_t)(len << EVENT_LOG_V2_CAN_LEN_SHIFT);
+      n += putVarint(out + n, can->id);
+      memcpy(out + n, can->data, len);
+      n += len;
+   }
+   else
+   {
+      n += putVarint(out + n, (uint64_t)size);
+      memcpy(out + n, data, size);
+      n += size;
+   }
+
+   out[0] = tag;
+   return n;
+}
+
+/**
+ * Decodes the record at in. CAN packets are expanded into can and data points
+ * to it, the data of other packets points into the record.
+ *
+ * @param tsNs - the previous record timestamp on input, the record one on output
+ * @return size of the record, 0 if avail bytes don't hold the whole record or -1 if it is malformed
+ */
+int eventCodecDecode(const uint8_t *in, size_t avail, packetType &type, int64_t &tsNs
+                     , const char *&data, int &size, canEvent *can)
+{
+   if(0 == avail)
+   {
+      return 0;
+   }
+   uint8_t tag = in[0];
+   size_t n = 1;
+
+   uint64_t value;
+   int len = getVarint(in + n, avail - n, value);
+   if(0 == len)
+   {
+      return ((avail - n) < 10) ? 0 : -1;
+   }
+   n += len;
+   int64_t ts = tsNs;
+   if(tag & EVENT_LOG_V2_ABSOLUTE)
+   {
+      ts = (int64_t)value;
+   }
+   else
+   {
+      ts += (int64_t)(value >> 1) ^ -(int64_t)(value & 1);
+   }
+
+   type = (packetType)(tag & EVENT_LOG_V2_TYPE_MASK);
+   len = getVarint(in + n, avail - n, value);
+   if(0 == len)
+   {
+      return ((avail - n) < 10) ? 0 : -1;
+   }
+   n += len;
+
+   if(PACKET_TYPE_CAN == type)
+   {
+      uint32_t canLen = (tag >> EVENT_LOG_V2_CAN_LEN_SHIFT) & EVENT_LOG_V2_CAN_LEN_MASK;
+      if((canLen > sizeof(can->data)) || (value > UINT32_MAX))
+      {
+         return -1;
+      }
+      if(avail - n < canLen)
+      {
+         return 0;
+      }
+      can->id = (uint32_t)value;
+      can->len = canLen;
+      if(8 == canLen)
+      {
+         memcpy(can->data, in + n, 8);
+      }
+      else
+      {
+         memset(can->data, 0, sizeof(can->data));
+         memcpy(can->data, in + n, canLen);
+      }
+      n += canLen;
+      data = (const char *)can;
+      size = sizeof(canEvent);
+   }
+   else
+   {
+      if(value > EVENT_LOG_MAX_PACKET_SIZE)
+      {
+         return -1;
+      }
+      if(avail - n < value)
+      {
+         return 0;
+      }
+      data = (const char *)(in + n);
+      size = (int)value;
+      n += value;
+   }
+
+   tsNs = ts;
+   return (int)n;
+}
@@ -0,0 +1,35 @@
+#ifndef _EVENT_CODEC_H
+#define _EVENT_CODEC_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "eventlog.h"
+
+/**
+ * Encoder and decoder of the ELOG v2 records described in "eventlog.h".
+ * Timestamps are nanoseconds since the epoch, the previous record timestamp is
+ * kept by the caller.
+ */
+
+/**
+ * Encodes the packet as a record into out, which should have room for
+ * EVENT_LOG_V2_MAX_RECORD bytes. CAN packets should hold a canEvent.
+ *
+ * @param absolute - store the timestamp as is instead of the difference from prevNs
+ * @return size of the record or -1 if the packet can't be encoded(errno is set to the error code)
+ */
+int eventCodecEncode(uint8_t *out, packetType type, int64_t tsNs, int64_t prevNs, bool absolute
+                     , const char *data, int size);
+
+/**
+ * Decodes the record at in. CAN packets are expanded into can and data points
+ * to it, the data of other packets points into the record.
+ *
+ * @param tsNs - the previous record timestamp on input, the record one on output
+ * @return size of the record, 0 if avail bytes don't hold the whole record or -1 if it is malformed
+ */
+int eventCodecDecode(const uint8_t *in, size_t avail, packetType &type, int64_t &tsNs
+                     , const char *&data, int &size, canEvent *can);
+
+#endif // _EVENT_CODEC_H
@@ -0,0 +1,201 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "eventIndex.h"
+
+
+EventIndex::EventIndex()
+{
+   this->sinceCheckpoint = 0;
+}
+
+void EventIndex::clear()
+{
+   this->entries.clear();
+   this->sinceCheckpoint = 0;
+}
+
+/**
+ * @return name of the index file of the given log
+ */
+std::string EventIndex::fileName(const char *logName)
+{
+   return std::string(logName) + ".idx";
+}
+
+/**
+ * Writer: accounts the packet written at the given offset, it becomes
+ * a checkpoint if enough packets or log time passed since the last one.
+ *
+ * @return true if the packet is a checkpoint
+ */
+bool EventIndex::add(const timeval &ts, uint64_t offset)
+{
+   bool checkpoint = this->entries.empty() || (this->sinceCheckpoint >= EVENT_INDEX_RECORDS);
+   if(!checkpoint)
+   {
+      const eventIndexEntry &last = this->entries.back();
+      int64_t elapsed = ((int64_t)ts.tv_sec - (int64_t)last.sec) * 1000000 + ((int64_t)ts.tv_usec - (int64_t)last.usec);
+      checkpoint = (elapsed >= EVENT_INDEX_USEC);
+   }
+
+   if(checkpoint)
+   {
+      eventIndexEntry entry;
+      entry.sec = ts.tv_sec;
+      entry.usec = ts.tv_usec;
+      entry.offset = offset;
+      this->entries.push_back(entry);
+      this->sinceCheckpoint = 0;
+   }
+   this->sinceCheckpoint++;
+   return checkpoint;
+}
+
+/**
+ * Writer: saves the index for the log of the given size.
+ *
+ * @return POSIX error code or 0 on success
+ */
+int EventIndex::save(const char *fname, uint64_t logSize)
+{
+   FILE *fp = fopen(fname, "wb");
+   if(NULL == fp)
+   {
+      fprintf(stderr, "Unable to open the file %s(%s)\n", fname, strerror(errno));
+      return errno;
+   }
+
+   int err = write(fp, logSize);
+   if((0 != fclose(fp)) && (0 == err))
+   {
+      err = errno;
+   }
+   if(0 != err)
+   {
+      fprintf(stderr, "Unable to write the file %s(%s)\n", fname, strerror(err));
+   }
+   return err;
+}
+
+/**
+ * Writer: writes the index for the log of the given size at the current position of fp.
+ *
+ * @return POSIX error code or 0 on success
+ */
+int EventIndex::write(FILE *fp, uint64_t logSize)
+{
+   eventIndexHeader header = { {'E','I','D','X'}, 1, logSize, this->entries.size()};
+   bool ok = (1 == fwrite(&header, sizeof(header), 1, fp));
+   if(ok && !this->entries.empty())
+   {
+      ok = (this->entries.size() == fwrite(&this->entries[0], sizeof(eventIndexEntry), this->entries.size(), fp));
+   }
+   return ok ? 0 : errno;
+}
+
+/**
+ * Reader: loads the index and checks that it belongs to the log of the given size.
+ *
+ * @return POSIX error code or 0 on success, ENOENT if there is no index, ESTALE if it doesn't match the log
+ */
+int EventIndex::load(const char *fname, uint64_t logSize)
+{
+   clear();
+
+   int fd = ::open(fname, O_RDONLY);
+   if(-1 == fd)
+   {
+      return errno;
+   }
+   int err = read(fd, 0, logSize);
+   ::close(fd);
+   return err;
+}
+
+/**
+ * Reader: loads the index stored at the given offset of the file opened as fd.
+ *
+ * @return POSIX error code or 0 on success, ESTALE if it doesn't match the log
+ */
+int EventIndex::read(int fd, uint64_t offset, uint64_t logSize)
+{
+   clear();
+
+   struct stat st;
+   if(0 != fstat(fd, &st))
+   {
+      return errno;
+   }
+
+   eventIndexHeader header;
+   if((uint64_t)st.st_size < offset + sizeof(header))
+   {
+      return EIO;
+   }
+   if(sizeof(header) != pread(fd, &header, sizeof(header), offset))
+   {
+      return EIO;
+   }
+   if((0 != memcmp(header.id, "EIDX", 4)) || (1 != header.version))
+   {
+      return EINVAL;
+   }
+   if(header.logSize != logSize)
+   {
+      return ESTALE;
+   }
+   if(header.count > (st.st_size - offset - sizeof(header)) / sizeof(eventIndexEntry))
+   {
+      return EIO;
+   }
+
+   this->entries.resize(header.count);
+   size_t size = header.count * sizeof(eventIndexEntry);
+   if(!this->entries.empty() && ((ssize_t)size != pread(fd, &this->entries[0], size, offset + sizeof(header))))
+   {
+      clear();
+      return EIO;
+   }
+   return 0;
+}
+
+/**
+ * Reader: finds the last checkpoint earlier than the given time, so all the packets
+ * not earlier than it are at the checkpoint or after it(a checkpoint of the same time
+ * may follow the first packets of that time).
+ *
+ * @return file offset of the checkpoint packet or -1 if the time doesn't follow any checkpoint
+ */
+int64_t EventIndex::find(const timeval &ts) const
+{
+   int lo = 0;
+   int hi = (int)this->entries.size();
+   //the first entry not earlier than ts
+   while(lo < hi)
+   {
+      int mid = (lo + hi) / 2;
+      const eventIndexEntry &e = this->entries[mid];
+      bool earlier = (e.sec < (uint64_t)ts.tv_sec) || ((e.sec == (uint64_t)ts.tv_sec) && (e.usec < (uint64_t)ts.tv_usec));
+      if(earlier)
+      {
+         lo = mid + 1;
+      }
+      else
+      {
+         hi = mid;
+      }
+   }
+
+   if(0 == lo)
+   {
+      return -1;
+   }
+   return (int64_t)this->entries[lo - 1].offset;
+}
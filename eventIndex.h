@@ -0,0 +1,83 @@
+#ifndef _EVENT_INDEX__
+#define _EVENT_INDEX__
+
+#include <stdint.h>
+#include <time.h>
+#include <stdio.h>
+#include <sys/time.h>
+
+#include <string>
+#include <vector>
+
+#include "eventlog.h"
+
+/**
+ * Sparse time index(timestamp -> file offset) of an events log described in "eventlog.h".
+ * It is built by the log writer with add() and saved next to the log, the log reader
+ * loads it to jump to the nearest checkpoint before a timestamp instead of parsing
+ * every packet before it.
+ */
+class EventIndex
+{
+public:
+   EventIndex();
+
+   /**
+    * Writer: accounts the packet written at the given offset, it becomes
+    * a checkpoint if enough packets or log time passed since the last one.
+    *
+    * @return true if the packet is a checkpoint
+    */
+   bool add(const timeval &ts, uint64_t offset);
+
+   /**
+    * Writer: saves the index for the log of the given size.
+    *
+    * @return POSIX error code or 0 on success
+    */
+   int save(const char *fname, uint64_t logSize);
+
+   /**
+    * Writer: writes the index for the log of the given size at the current position of fp.
+    *
+    * @return POSIX error code or 0 on success
+    */
+   int write(FILE *fp, uint64_t logSize);
+
+   /**
+    * Reader: loads the index and checks that it belongs to the log of the given size.
+    *
+    * @return POSIX error code or 0 on success, ENOENT if there is no index, ESTALE if it doesn't match the log
+    */
+   int load(const char *fname, uint64_t logSize);
+
+   /**
+    * Reader: loads the index stored at the given offset of the file opened as fd.
+    *
+    * @return POSIX error code or 0 on success, ESTALE if it doesn't match the log
+    */
+   int read(int fd, uint64_t offset, uint64_t logSize);
+
+   /**
+    * Reader: finds the last checkpoint earlier than the given time, so all the packets
+    * not earlier than it are at the checkpoint or after it(a checkpoint of the same time
+    * may follow the first packets of that time).
+    *
+    * @return file offset of the checkpoint packet or -1 if the time doesn't follow any checkpoint
+    */
+   int64_t find(const timeval &ts) const;
+
+   int size() const { return (int)entries.size(); }
+   void clear();
+
+   /**
+    * @return name of the index file of the given log
+    */
+   static std::string fileName(const char *logName);
+
+private:
+   std::vector<eventIndexEntry> entries;
+   uint32_t sinceCheckpoint; //packets added since the last checkpoint
+};
+
+#endif // _EVENT_INDEX__
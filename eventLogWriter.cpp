@@ -0,0 +1,360 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <zlib.h>
+#include <arpa/inet.h>
+
+#include "eventLogWriter.h"
+#include "eventCodec.h"
+
+
+EventLogWriter::EventLogWriter()
+{
+   this->fp = NULL;
+   this->buffer = NULL;
+   this->version = 1;
+   this->offset = 0;
+   this->lastNs = 0;
+   this->err = 0;
+   this->level = 0;
+   memset(&this->chunkEntry, 0, sizeof(this->chunkEntry));
+   memset(&this->info, 0, sizeof(this->info));
+}
+
+EventLogWriter::~EventLogWriter()
+{
+   close();
+}
+
+/**
+ * Creates the log and writes its header.
+ *
+ * @param version - 1(eventLogPacket headed packets) or 2(compact records)
+ * @param level - zlib compression level(1..9) of the chunks, 0 - the log is not compressed
+ * @return POSIX error code or 0 on success
+ */
+int EventLogWriter::open(const char *fname, uint32_t version, int level)
+{
+   if((1 != version) && (2 != version))
+   {
+      fprintf(stderr, "Unsupported events log version(%u)\n", version);
+      return EINVAL;
+   }
+   if((level < 0) || (level > 9))
+   {
+      fprintf(stderr, "Unsupported compression level(%i)\n", level);
+      return EINVAL;
+   }
+
+   this->fp = fopen(fname, "w+b");
+   if(NULL == this->fp)
+   {
+      fprintf(stderr, "Unable to open the file %s(%s)\n", fname, strerror(errno));
+      return errno;
+   }
+   if(0 == posix_memalign((void **)&this->buffer, sysconf(_SC_PAGESIZE), EVENT_LOG_WRITE_BUFFER))
+   {
+      setvbuf(this->fp, this->buffer, _IOFBF, EVENT_LOG_WRITE_BUFFER);
+   }
+   else
+   {
+      this->buffer = NULL;
+   }
+
+   this->fileName = fname;
+   this->version = version;
+   this->index.clear();
+   this->lastNs = 0;
+   this->err = 0;
+   this->level = level;
+   this->chunk.clear();
+   this->directory.clear();
+
+   memset(&this->info, 0, sizeof(this->info));
+
+   eventLogHeader header = { {'E','L','O','G'}, version | EVENT_LOG_INFO | ((0 != level) ? EVENT_LOG_COMPRESSED : 0)};
+   if((1 != fwrite(&header, sizeof(header), 1, this->fp))
+      || (1 != fwrite(&this->info, sizeof(this->info), 1, this->fp)))
+   {
+      this->err = errno;
+   }
+   this->offset = sizeof(header) + sizeof(this->info);
+   return this->err;
+}
+
+/**
+ * Appends the packet, packets should be written in time order.
+ *
+ * @return POSIX error code or 0 on success
+ */
+int EventLogWriter::write(packetType type, const timeval &ts, const char *data, int size)
+{
+   if(0 != this->level)
+   {
+      int err = append(type, ts, data, size);
+      if(0 == err)
+      {
+         account(type, ts, data, size);
+      }
+      return err;
+   }
+
+   bool checkpoint = this->index.add(ts, this->offset);
+
+   if(1 == this->version)
+   {
+      eventLogPacket logPacket;
+      memset(&logPacket, 0, sizeof(logPacket));
+      logPacket.type = type;
+      logPacket.sec = ts.tv_sec;
+      logPacket.usec = ts.tv_usec;
+      logPacket.len = size;
+
+      if((1 != fwrite(&logPacket, sizeof(logPacket), 1, this->fp))
+         || ((0 != size) && (1 != fwrite(data, size, 1, this->fp))))
+      {
+         this->err = errno;
+         return this->err;
+      }
+      this->offset += sizeof(logPacket) + size;
+      account(type, ts, data, size);
+      return 0;
+   }
+
+   uint8_t record[EVENT_LOG_V2_MAX_RECORD];
+   int64_t tsNs = ((int64_t)ts.tv_sec * 1000000 + ts.tv_usec) * 1000;
+   int len = eventCodecEncode(record, type, tsNs, this->lastNs, checkpoint, data, size);
+   if(-1 == len)
+   {
+      fprintf(stderr, "Packet of type %u and size %i can't be encoded\n", type, size);
+      return errno;
+   }
+   if(1 != fwrite(record, len, 1, this->fp))
+   {
+      this->err = errno;
+      return this->err;
+   }
+   this->lastNs = tsNs;
+   this->offset += len;
+   account(type, ts, data, size);
+   return 0;
+}
+
+/**
+ * Accounts the written packet in the summary, RTP streams are told apart by SSRC.
+ */
+void EventLogWriter::account(packetType type, const timeval &ts, const char *data, int size)
+{
+   eventLogInfo &info = this->info;
+   if((0 == info.count[PACKET_TYPE_CAN]) && (0 == info.count[PACKET_TYPE_RTP]))
+   {
+      info.firstSec = ts.tv_sec;
+      info.firstUsec = ts.tv_usec;
+   }
+   info.lastSec = ts.tv_sec;
+   info.lastUsec = ts.tv_usec;
+   if(type >= PACKET_TYPE_MAX)
+   {
+      return;
+   }
+   info.count[type]++;
+   info.bytes[type] += size;
+
+   uint32_t id = 0;
+   uint32_t payloadType = 0;
+   if(PACKET_TYPE_RTP == type)
+   {
+      if(size < (int)sizeof(rtpHeader))
+      {
+         return;
+      }
+      rtpHeader rtp;
+      memcpy(&rtp, data, sizeof(rtp));
+      id = ntohl(rtp.ssrc);
+      payloadType = rtp.pt;
+   }
+
+   uint32_t i = 0;
+   while((i < info.streamCount)
+         && ((info.streams[i].type != (uint32_t)type) || (info.streams[i].id != id) || (info.streams[i].payloadType != payloadType)))
+   {
+      i++;
+   }
+   if(i == info.streamCount)
+   {
+      if(EVENT_LOG_MAX_STREAMS == i)
+      {
+         return;
+      }
+      info.streams[i].type = type;
+      info.streams[i].id = id;
+      info.streams[i].payloadType = payloadType;
+      info.streamCount++;
+   }
+   info.streams[i].count++;
+   info.streams[i].bytes += size;
+}
+
+/**
+ * Compressed log: appends the record to the chunk being filled, the chunk is
+ * compressed and written once the record doesn't fit into it.
+ *
+ * @return POSIX error code or 0 on success
+ */
+int EventLogWriter::append(packetType type, const timeval &ts, const char *data, int size)
+{
+   if(0 != this->err)
+   {
+      return this->err;
+   }
+   if((size < 0) || (size > EVENT_LOG_MAX_PACKET_SIZE))
+   {
+      fprintf(stderr, "Packet of type %u and size %i can't be written\n", type, size);
+      return EINVAL;
+   }
+
+   uint8_t record[sizeof(eventLogPacket) + EVENT_LOG_MAX_PACKET_SIZE];
+   int64_t tsNs = ((int64_t)ts.tv_sec * 1000000 + ts.tv_usec) * 1000;
+   int len;
+   for(;;)
+   {
+      if(1 == this->version)
+      {
+         eventLogPacket logPacket;
+         memset(&logPacket, 0, sizeof(logPacket));
+         logPacket.type = type;
+         logPacket.sec = ts.tv_sec;
+         logPacket.usec = ts.tv_usec;
+         logPacket.len = size;
+         memcpy(record, &logPacket, sizeof(logPacket));
+         memcpy(record + sizeof(logPacket), data, size);
+         len = sizeof(logPacket) + size;
+      }
+      else
+      {
+         //the first record of a chunk is absolute, so every chunk is decoded on its own
+         len = eventCodecEncode(record, type, tsNs, this->lastNs, this->chunk.empty(), data, size);
+         if(-1 == len)
+         {
+            fprintf(stderr, "Packet of type %u and size %i can't be encoded\n", type, size);
+            return errno;
+         }
+      }
+
+      if(this->chunk.size() + len <= EVENT_LOG_CHUNK_SIZE)
+      {
+         break;
+      }
+      int err = flushChunk();
+      if(0 != err)
+      {
+         return err;
+      }
+   }
+
+   if(this->chunk.empty())
+   {
+      this->chunkEntry.sec = ts.tv_sec;
+      this->chunkEntry.usec = ts.tv_usec;
+   }
+   this->chunk.insert(this->chunk.end(), (const char *)record, (const char *)record + len);
+   this->lastNs = tsNs;
+   return 0;
+}
+
+/**
+ * Compresses and writes the chunk being filled.
+ *
+ * @return POSIX error code or 0 on success
+ */
+int EventLogWriter::flushChunk()
+{
+   if(this->chunk.empty())
+   {
+      return 0;
+   }
+
+   uLongf packedSize = compressBound(this->chunk.size());
+   this->packed.resize(packedSize);
+   int zerr = compress2((Bytef *)&this->packed[0], &packedSize, (const Bytef *)&this->chunk[0], this->chunk.size(), this->level);
+   if(Z_OK != zerr)
+   {
+      fprintf(stderr, "Chunk compression failed(%s)\n", zError(zerr));
+      this->err = (Z_MEM_ERROR == zerr) ? ENOMEM : EINVAL;
+      return this->err;
+   }
+   if(1 != fwrite(&this->packed[0], packedSize, 1, this->fp))
+   {
+      this->err = errno;
+      return this->err;
+   }
+
+   this->chunkEntry.offset = this->offset;
+   this->chunkEntry.compressedSize = packedSize;
+   this->chunkEntry.size = this->chunk.size();
+   this->directory.push_back(this->chunkEntry);
+   this->offset += packedSize;
+   this->chunk.clear();
+   return 0;
+}
+
+/**
+ * Closes the log: writes its index(the chunk directory of a compressed log) after
+ * the records and fills the summary in.
+ *
+ * @return POSIX error code or 0 on success(including all previous writes)
+ */
+int EventLogWriter::close()
+{
+   if(NULL == this->fp)
+   {
+      return 0;
+   }
+
+   if((0 != this->level) && (0 == this->err) && (0 == flushChunk()))
+   {
+      this->info.dataEnd = this->offset;
+      this->info.indexOffset = this->offset;
+      eventChunkFooter footer = {this->offset, this->directory.size(), {'E','C','H','K'}, 1};
+      if((!this->directory.empty()
+          && (this->directory.size() != fwrite(&this->directory[0], sizeof(eventChunkEntry), this->directory.size(), this->fp)))
+         || (1 != fwrite(&footer, sizeof(footer), 1, this->fp)))
+      {
+         this->err = errno;
+      }
+      this->offset += this->directory.size() * sizeof(eventChunkEntry) + sizeof(footer);
+   }
+   else if((0 == this->level) && (0 == this->err))
+   {
+      this->info.dataEnd = this->offset;
+      this->info.indexOffset = this->offset;
+      this->err = this->index.write(this->fp, this->info.dataEnd);
+      this->offset += sizeof(eventIndexHeader) + this->index.size() * sizeof(eventIndexEntry);
+   }
+
+   //the summary is known now, it replaces the placeholder written by open()
+   if((0 == this->err)
+      && ((0 != fseek(this->fp, sizeof(eventLogHeader), SEEK_SET))
+          || (1 != fwrite(&this->info, sizeof(this->info), 1, this->fp))))
+   {
+      this->err = errno;
+   }
+
+   int err = this->err;
+   if((0 != fclose(this->fp)) && (0 == err))
+   {
+      err = errno;
+   }
+   this->fp = NULL;
+   free(this->buffer);
+   this->buffer = NULL;
+   if(0 != err)
+   {
+      fprintf(stderr, "Unable to write the file %s(%s)\n", this->fileName.c_str(), strerror(err));
+   }
+   return err;
+}
@@ -0,0 +1,83 @@
+#ifndef _EVENT_LOG_WRITER__
+#define _EVENT_LOG_WRITER__
+
+#include <stdint.h>
+#include <stdio.h>
+#include <time.h>
+#include <sys/time.h>
+
+#include <string>
+#include <vector>
+
+#include "eventlog.h"
+#include "eventIndex.h"
+
+//the log is written through a page aligned stdio buffer of that size, so the records
+//reach the file with a few large writes
+#define EVENT_LOG_WRITE_BUFFER (4*1024*1024)
+
+/**
+ * Writes a self-describing events log described in "eventlog.h"(@see EVENT_LOG_INFO)
+ * of the given version together with its time index or block compressed with
+ * the chunk directory instead of the index.
+ */
+class EventLogWriter
+{
+public:
+   EventLogWriter();
+   ~EventLogWriter();
+
+   /**
+    * Creates the log and writes its header.
+    *
+    * @param version - 1(eventLogPacket headed packets) or 2(compact records)
+    * @param level - zlib compression level(1..9) of the chunks, 0 - the log is not compressed
+    * @return POSIX error code or 0 on success
+    */
+   int open(const char *fname, uint32_t version, int level = 0);
+
+   /**
+    * Appends the packet, packets should be written in time order.
+    *
+    * @return POSIX error code or 0 on success
+    */
+   int write(packetType type, const timeval &ts, const char *data, int size);
+
+   /**
+    * Closes the log: writes its index(the chunk directory of a compressed log) after
+    * the records and fills the summary in.
+    *
+    * @return POSIX error code or 0 on success(including all previous writes)
+    */
+   int close();
+
+   uint64_t size() const { return offset; }
+   int checkpoints() const { return index.size(); }
+   int chunks() const { return (int)directory.size(); }
+   const eventLogInfo &summary() const { return info; }
+
+private:
+   EventLogWriter(const EventLogWriter &);
+   EventLogWriter &operator=(const EventLogWriter &);
+
+   int append(packetType type, const timeval &ts, const char *data, int size);
+   int flushChunk();
+   void account(packetType type, const timeval &ts, const char *data, int size);
+
+   FILE *fp;
+   char *buffer;    //the stdio buffer of fp
+   std::string fileName;
+   uint32_t version;
+   EventIndex index;
+   uint64_t offset; //size of the written log
+   int64_t lastNs;  //v2: timestamp of the last record
+   int err;         //the first write error
+   eventLogInfo info;
+   int level;       //compression level, 0 - not compressed
+   std::vector<char> chunk;    //records of the chunk being filled
+   std::vector<char> packed;   //the compressed chunk
+   eventChunkEntry chunkEntry; //directory entry of the chunk being filled
+   std::vector<eventChunkEntry> directory;
+};
+
+#endif // _EVENT_LOG_WRITER__
@@ -0,0 +1,186 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "eventRing.h"
+
+
+EventRing::EventRing(int capacity)
+{
+   uint32_t size = 1;
+   while((int)size < capacity)
+   {
+      size <<= 1;
+   }
+
+   this->mask = size - 1;
+   this->slots = new ringEvent[size];
+   this->head.store(0);
+   this->tail.store(0);
+   this->done.store(false);
+   this->waiting.store(false);
+   pthread_mutex_init(&this->lock, NULL);
+   pthread_cond_init(&this->cond, NULL);
+   resetStats();
+}
+
+EventRing::~EventRing()
+{
+   pthread_cond_destroy(&this->cond);
+   pthread_mutex_destroy(&this->lock);
+   delete[] this->slots;
+}
+
+/**
+ * Wakes the consumer sleeping in wait().
+ */
+void EventRing::wake()
+{
+   pthread_mutex_lock(&this->lock);
+   pthread_cond_signal(&this->cond);
+   pthread_mutex_unlock(&this->lock);
+}
+
+/**
+ * Producer: returns a free slot to fill or NULL if the ring is full.
+ */
+ringEvent *EventRing::slot()
+{
+   uint32_t h = this->head.load(std::memory_order_relaxed);
+   uint32_t t = this->tail.load(std::memory_order_acquire);
+   if(h - t > this->mask)
+   {
+      return NULL;
+   }
+   return &this->slots[h & this->mask];
+}
+
+/**
+ * Producer: publishes the slot returned by slot().
+ */
+void EventRing::push()
+{
+   uint32_t h = this->head.load(std::memory_order_relaxed);
+   //sequentially consistent with the waiting flag of wait(), so either the producer
+   //sees the consumer going to sleep or the consumer sees the new event
+   this->head.store(h + 1);
+   if(this->waiting.load())
+   {
+      wake();
+   }
+}
+
+/**
+ * Marks that no more events will be pushed and wakes the waiting consumer,
+ * also used to release the consumer once the playback is stopped.
+ */
+void EventRing::finish()
+{
+   this->done.store(true);
+   if(this->waiting.load())
+   {
+      wake();
+   }
+}
+
+/**
+ * Consumer: sleeps until the ring isn't empty or finish() is called.
+ *
+ * @return the oldest event or NULL if the ring is finished and empty
+ */
+ringEvent *EventRing::wait()
+{
+   pthread_mutex_lock(&this->lock);
+   this->waiting.store(true);
+   while((this->head.load() == this->tail.load(std::memory_order_relaxed)) && !this->done.load())
+   {
+      pthread_cond_wait(&this->cond, &this->lock);
+   }
+   this->waiting.store(false);
+   pthread_mutex_unlock(&this->lock);
+   return front();
+}
+
+/**
+ * Consumer: returns the oldest event or NULL if the ring is empty.
+ */
+ringEvent *EventRing::front()
+{
+   uint32_t t = this->tail.load(std::memory_order_relaxed);
+   uint32_t h = this->head.load(std::memory_order_acquire);
+   if(h == t)
+   {
+      return NULL;
+   }
+
+   int d = (int)(h - t);
+   if(d < this->minDepth)
+   {
+      this->minDepth = d;
+   }
+   if(d > this->maxDepth)
+   {
+      this->maxDepth = d;
+   }
+
+   return &this->slots[t & this->mask];
+}
+
+/**
+ * Consumer: returns the event following the front one by the given distance
+ * or NULL if there is no such event yet. Doesn't affect the statistics.
+ */
+ringEvent *EventRing::peek(int distance)
+{
+   uint32_t t = this->tail.load(std::memory_order_relaxed);
+   uint32_t h = this->head.load(std::memory_order_acquire);
+   if((uint32_t)distance >= h - t)
+   {
+      return NULL;
+   }
+   return &this->slots[(t + distance) & this->mask];
+}
+
+/**
+ * Consumer: releases the event returned by front().
+ */
+void EventRing::pop()
+{
+   uint32_t t = this->tail.load(std::memory_order_relaxed);
+   this->tail.store(t + 1, std::memory_order_release);
+}
+
+/**
+ * @return true if finish() was called and all events are consumed
+ */
+bool EventRing::finished()
+{
+   //done has to be checked first, the producer may push the last events right before finish()
+   bool d = this->done.load(std::memory_order_acquire);
+   return d && (0 == depth());
+}
+
+/**
+ * Touches every slot, so no page fault happens once the playback is started.
+ */
+void EventRing::prefault()
+{
+   memset((void *)this->slots, 0, sizeof(ringEvent) * (this->mask + 1));
+}
+
+int EventRing::depth()
+{
+   uint32_t h = this->head.load(std::memory_order_acquire);
+   uint32_t t = this->tail.load(std::memory_order_acquire);
+   return (int)(h - t);
+}
+
+/**
+ * Resets the consumer statistics, called once the ring is prefilled.
+ */
+void EventRing::resetStats()
+{
+   this->underruns = 0;
+   this->minDepth = (int)this->mask + 1;
+   this->maxDepth = 0;
+}
@@ -0,0 +1,126 @@
+#ifndef _EVENT_RING__
+#define _EVENT_RING__
+
+#include <stdint.h>
+#include <time.h>
+#include <sys/time.h>
+
+#include <pthread.h>
+
+#include <atomic>
+
+#include "eventlog.h"
+
+/**
+ * Decoded event as it is stored in the ring.
+ */
+struct ringEvent
+{
+   packetType type;
+   timeval ts;
+   uint32_t loop; //how many times the log was started over before the event
+   int size;
+   //if set, data holds only the first size bytes of the packet(the header to be rewritten)
+   //and the rest of it is sent straight from this persistent view(mapped log)
+   const char *tail;
+   int tailSize;
+   char data[EVENT_LOG_MAX_PACKET_SIZE];
+};
+
+/**
+ * Bounded single-producer/single-consumer lock-free queue of decoded events.
+ * The producer(log reader thread) fills a slot in place and publishes it with push(),
+ * the consumer(playback thread) reads the oldest slot with front() and releases it with pop().
+ * The producer never blocks on the consumer, the consumer may sleep in wait() until an event
+ * is pushed, the producer takes the lock to wake it only if it is actually sleeping.
+ */
+class EventRing
+{
+public:
+   /**
+    * @param capacity - amount of slots, rounded up to a power of two
+    */
+   EventRing(int capacity);
+   ~EventRing();
+
+   /**
+    * Producer: returns a free slot to fill or NULL if the ring is full.
+    */
+   ringEvent *slot();
+
+   /**
+    * Producer: publishes the slot returned by slot().
+    */
+   void push();
+
+   /**
+    * Marks that no more events will be pushed and wakes the waiting consumer,
+    * also used to release the consumer once the playback is stopped.
+    */
+   void finish();
+
+   /**
+    * Consumer: returns the oldest event or NULL if the ring is empty.
+    */
+   ringEvent *front();
+
+   /**
+    * Consumer: sleeps until the ring isn't empty or finish() is called.
+    *
+    * @return the oldest event or NULL if the ring is finished and empty
+    */
+   ringEvent *wait();
+
+   /**
+    * Consumer: returns the event following the front one by the given distance
+    * or NULL if there is no such event yet. Doesn't affect the statistics.
+    */
+   ringEvent *peek(int distance);
+
+   /**
+    * Consumer: releases the event returned by front().
+    */
+   void pop();
+
+   /**
+    * @return true if finish() was called and all events are consumed
+    */
+   bool finished();
+
+   /**
+    * Touches every slot, so no page fault happens once the playback is started.
+    */
+   void prefault();
+
+   int capacity() const { return (int)(mask + 1); }
+   int depth();
+
+   //consumer side statistics
+   uint64_t underruns; //accounted by the consumer: it waited for an event which was already due
+   int minDepth;       //minimal depth seen by the consumer after prefill
+   int maxDepth;
+
+   /**
+    * Resets the consumer statistics, called once the ring is prefilled.
+    */
+   void resetStats();
+
+private:
+   EventRing(const EventRing &);
+   EventRing &operator=(const EventRing &);
+
+   void wake();
+
+   ringEvent *slots;
+   uint32_t mask;
+   pthread_mutex_t lock; //the consumer sleeps in wait() on cond
+   pthread_cond_t cond;
+
+   //head and tail are written by different threads, keep them in different cache lines
+   alignas(64) std::atomic<uint32_t> head; //next slot to be written by the producer
+   alignas(64) std::atomic<uint32_t> tail; //next slot to be read by the consumer
+   alignas(64) std::atomic<bool> done;
+   std::atomic<bool> waiting; //the consumer is about to sleep or sleeps in wait()
+};
+
+#endif // _EVENT_RING__
@@ -20,6 +20,9 @@ enum packetType
 
 /**
  * Events(packets) list file header for verification and version check.
+ * Version 1: the header is followed by eventLogPacket headed packets.
+ * Version 2: the header is followed by compact records(@see EVENT_LOG_V2_* below).
+ * The version may have flags set on top of it(@see EVENT_LOG_INFO, EVENT_LOG_COMPRESSED).
 */
 struct eventLogHeader
 {
@@ -27,6 +30,121 @@ struct eventLogHeader
    uint32_t version;
 };
 
+/**
+ * ELOG v2 record:
+ *    tag        - uint8_t: bits 0..2 packet type, bits 3..6 CAN data length(0..8),
+ *                 bit 7 the timestamp is absolute
+ *    timestamp  - varint: nanoseconds since the epoch if absolute, otherwise zigzag
+ *                 encoded difference from the previous record timestamp
+ *    CAN:         varint id followed by length bytes of data(the rest of canEvent::data is 0)
+ *    other types: varint length followed by length bytes of data
+ * Varints are little endian base 128(7 bits per byte, the high bit marks that more bytes follow).
+ * The first record and every index checkpoint(@see eventIndexEntry) have absolute timestamps,
+ * so reading may start from any of them.
+*/
+#define EVENT_LOG_V2_TYPE_MASK     (0x07)
+#define EVENT_LOG_V2_CAN_LEN_SHIFT (3)
+#define EVENT_LOG_V2_CAN_LEN_MASK  (0x0F)
+#define EVENT_LOG_V2_ABSOLUTE      (0x80)
+
+/**
+ * Self-describing log: the version has EVENT_LOG_INFO set and the header is followed
+ * by eventLogInfo, the records start right after it and end at dataEnd. The summary is
+ * filled in by the writer once the log is complete, so the time range, the packet
+ * counts and the streams are known without reading the records.
+ * The time index(eventIndexHeader followed by the entries) is stored at indexOffset
+ * after the records instead of <log>.idx, indexOffset of a compressed log points to
+ * its chunk directory.
+*/
+#define EVENT_LOG_INFO        (0x20000)
+//streams beyond it are accounted in the per-type totals only
+#define EVENT_LOG_MAX_STREAMS (16)
+
+struct eventLogStream
+{
+   uint32_t type;        //@see packetType enum
+   uint32_t id;          //RTP: SSRC, CAN: 0(all frames of the bus)
+   uint32_t payloadType; //RTP payload type
+   uint32_t reserved;
+   uint64_t count;       //amount of packets
+   uint64_t bytes;       //total length of the packets
+};
+
+struct eventLogInfo
+{
+   uint64_t dataEnd;      //file offset following the last record
+   uint64_t indexOffset;  //0 if the log has no index
+   uint64_t firstSec;     //timestamp of the first packet
+   uint64_t firstUsec;
+   uint64_t lastSec;      //timestamp of the last packet
+   uint64_t lastUsec;
+   uint64_t count[PACKET_TYPE_MAX];
+   uint64_t bytes[PACKET_TYPE_MAX];
+   uint32_t streamCount;  //amount of valid streams entries
+   uint32_t reserved;
+   eventLogStream streams[EVENT_LOG_MAX_STREAMS];
+};
+
+/**
+ * Block compressed log: the version has EVENT_LOG_COMPRESSED set on top of the record
+ * version(1 or 2). The header(and eventLogInfo) is followed by zlib compressed chunks of about
+ * EVENT_LOG_CHUNK_SIZE of records each, records never cross a chunk and the first
+ * v2 record of a chunk has an absolute timestamp, so every chunk can be decompressed
+ * and read on its own. The chunks are followed by the chunk directory(count entries)
+ * and eventChunkFooter at the very end of the file. The directory replaces the time
+ * index, no <log>.idx is written for a compressed log.
+*/
+#define EVENT_LOG_COMPRESSED     (0x10000)
+#define EVENT_LOG_VERSION_MASK   (0xFFFF)
+#define EVENT_LOG_CHUNK_SIZE     (1024*1024)
+
+struct eventChunkEntry
+{
+   uint64_t offset;         //file offset of the compressed chunk
+   uint32_t compressedSize;
+   uint32_t size;           //size of the records
+   uint64_t sec;            //timestamp of the first record
+   uint64_t usec;
+};
+
+struct eventChunkFooter
+{
+   uint64_t directoryOffset;
+   uint64_t count;          //amount of chunks
+   uint8_t id[4];           //'ECHK'
+   uint32_t version;
+};
+
+/**
+ * Sparse time index of an events log stored next to it(<log>.idx) or inside
+ * it(@see EVENT_LOG_INFO). A checkpoint
+ * with the file offset of a packet header is taken every EVENT_INDEX_RECORDS
+ * packets or EVENT_INDEX_USEC of log time, whichever comes first.
+ * The header is followed by count entries sorted by time.
+*/
+#define EVENT_INDEX_RECORDS (1024)
+#define EVENT_INDEX_USEC    (500000)
+
+struct eventIndexHeader
+{
+   uint8_t id[4];    //'EIDX'
+   uint32_t version;
+   uint64_t logSize; //size of the indexed log, a stale index is ignored
+   uint64_t count;   //amount of entries
+};
+
+struct eventIndexEntry
+{
+   uint64_t sec;    //timestamp seconds
+   uint64_t usec;   //timestamp microseconds
+   uint64_t offset; //file offset of the packet(eventLogPacket)
+};
+
+//largest packet(eventLogPacket::len) the readers accept
+#define EVENT_LOG_MAX_PACKET_SIZE (2000)
+//largest ELOG v2 record: tag, timestamp, length/CAN id varints and data
+#define EVENT_LOG_V2_MAX_RECORD (1 + 10 + 5 + EVENT_LOG_MAX_PACKET_SIZE)
+
 struct eventLogPacket
 {
    uint64_t sec;  //timestamp seconds
@@ -45,6 +163,32 @@ struct canEvent
    uint8_t data[8];
 };
 
+/**
+ * Cache of a parsed CAN text log stored next to it(<log>.cev): the header is followed
+ * by count records in the log order. The cache belongs to the log of the recorded size
+ * and modification time whose first and last CAN_CACHE_HASH_BYTES hash to the recorded
+ * value, otherwise it is stale and rebuilt.
+*/
+#define CAN_CACHE_HASH_BYTES (64*1024)
+
+struct canCacheHeader
+{
+   uint8_t id[4];      //'ECEV'
+   uint32_t version;
+   uint64_t logSize;   //the source log size
+   int64_t mtimeSec;   //the source log modification time
+   int64_t mtimeNsec;
+   uint64_t hash;      //FNV-1a of the source log head and tail
+   uint64_t rts;       //the log time base(usec since the epoch)
+   uint64_t count;     //amount of records
+};
+
+struct canCacheRecord
+{
+   uint64_t ts;     //usec since the epoch
+   canEvent event;
+};
+
 /**
  * RTP packet(PACKET_TYPE_RTP) header(@see https://en.wikipedia.org/wiki/Real-time_Transport_Protocol)
  * followed by packet data.
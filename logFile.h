@@ -3,6 +3,8 @@
 
 #include <stdint.h>
 #include <time.h>
+#include <errno.h>
+#include <string.h>
 
 #include "eventlog.h"
 
@@ -17,12 +19,57 @@ public:
    virtual ~ILogFile() {};
 
    /**
-    * Reads the next packet.
+    * Reads the next packet without copying it: data points to the storage owned
+    * by the file, which stays valid until the next readView(), read(), seek() or rewind().
+    * If end of file is reached the 0 is returned.
+    *
+    * @return amount of data or -1 on error (errno is set to the error code)
+    */
+   virtual int readView(packetType &type, timeval &ts, const char *&data) = 0;
+
+   /**
+    * @return true if the view returned by the last readView() stays valid until close(),
+    * like the ones of a memory mapped log
+    */
+   virtual bool persistentView() const { return false; }
+
+   /**
+    * Reads the next packet into the caller buffer.
     * If end of file is reached the 0 is returned.
     *
     * @return amount of read data or -1 on error (errno is set to the error code)
     */
-   virtual int read(packetType &type, timeval &ts, char *data, const int size) = 0;
+   virtual int read(packetType &type, timeval &ts, char *data, const int size)
+   {
+      const char *view;
+      int len = readView(type, ts, view);
+      if(len <= 0)
+      {
+         return len;
+      }
+      if(len > size)
+      {
+         errno = ENOMEM;
+         return -1;
+      }
+      memcpy(data, view, len);
+      return len;
+   }
+
+   /**
+    * Starts reading over from the first packet.
+    *
+    * @return POSIX error code or 0 on success
+    */
+   virtual int rewind() = 0;
+
+   /**
+    * Positions the file so the next read() returns the first packet not earlier
+    * than the given time(or end of file).
+    *
+    * @return POSIX error code or 0 on success
+    */
+   virtual int seek(const timeval &ts) = 0;
 
    virtual int open(const char* fname) = 0;
    virtual void close() = 0;
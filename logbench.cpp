@@ -0,0 +1,901 @@
+/**
+ * Debug utility to measure the log reading performance of logplayer without
+ * sending anything. Every test reads the given logs the way the player reader
+ * thread does and reports the throughput.
+ *
+ *   read - compares copying reads(read()) with the zero-copy views(readView()) of
+ *          the block reader and of the mapped log, all of them deliver every event
+ *          into a ring slot like the player does(only the RTP header is copied from
+ *          a mapped log), the cost is reported relatively to a 100 Mbit/s RTP stream.
+ *   merge - merges k = 2..64 generated in-memory logs with MultiLogReader and
+ *          with a linear scan over the files, so only the merge cost is measured.
+ *   can  - parses CAN text logs with the reference fgets() + sscanf() parser the readers
+ *          used before and with CanLogReader, the parsed packets are compared.
+ *   cache - opens CAN text logs with CanLogFile without their cache(the cache is built) and
+ *          with it, the open times and the time to read every packet are compared with
+ *          the text parsing, the packets read from the cache are compared with the text ones.
+ *   pcap - extracts the RTP packets of raw captures with libpcap the way logparser does and
+ *          with PcapLogFile, the packets extracted by both are compared.
+ *   decode - reads every events log on its own(any version, block compressed too)
+ *          and compares the decode throughput with the bitrate the log is replayed at,
+ *          the CPU time includes the background decompression thread.
+*/
+
+#include <stdio.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <sys/stat.h>
+
+#include <pcap.h>
+
+#include <vector>
+
+#include "eventlog.h"
+#include "eventRing.h"
+#include "mixedLogFile.h"
+#include "canLogFile.h"
+#include "multiLogReader.h"
+#include "canLogReader.h"
+#include "canLogCache.h"
+#include "pcapLogFile.h"
+#include "pcapFrame.h"
+
+//the reference playback rate the read cost is compared with
+#define BENCH_RTP_BITRATE (100e6)
+
+//merge: total amount of events merged for every k and the largest k
+#define BENCH_MERGE_EVENTS (4000000)
+#define BENCH_MERGE_FILES  (64)
+
+/**
+ * @return monotonic time in seconds
+ */
+static double benchNow()
+{
+   struct timespec now;
+   clock_gettime(CLOCK_MONOTONIC, &now);
+   return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+/**
+ * @return CPU time(seconds) consumed by all threads of the process
+ */
+static double benchCpu()
+{
+   struct timespec now;
+   clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &now);
+   return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+/**
+ * Opens the logs: files ending with ".log" are CAN text logs, pcap/pcapng captures are read
+ * with PcapLogFile, the rest are events logs.
+ *
+ * @return POSIX error code or 0 on success
+ */
+static int benchOpen(int count, char **names, bool map, std::vector<ILogFile*> &files)
+{
+   for(int i=0; i<count; i++)
+   {
+      size_t len = strlen(names[i]);
+      ILogFile *file;
+      if((len > 4) && (0 == strcmp(names[i] + len - 4, ".log")))
+      {
+         file = new CanLogFile();
+      }
+      else if(PcapLogFile::probe(names[i]))
+      {
+         file = new PcapLogFile();
+      }
+      else
+      {
+         file = new MixedLogFile(map);
+      }
+      int err = file->open(names[i]);
+      if(0 != err)
+      {
+         delete file;
+         return err;
+      }
+      files.push_back(file);
+   }
+   return 0;
+}
+
+static void benchClose(std::vector<ILogFile*> &files)
+{
+   for(size_t i=0; i<files.size(); i++)
+   {
+      files[i]->close();
+      delete files[i];
+   }
+   files.clear();
+}
+
+struct benchResult
+{
+   uint64_t events;
+   uint64_t bytes;
+   double seconds;
+};
+
+/**
+ * Reads all logs passes times over, every event is delivered into the ring slot
+ * either through an intermediate event copy(view == false) or straight from the view.
+ *
+ * @return POSIX error code or 0 on success
+ */
+static int benchRead(MultiLogReader &reader, int passes, bool view, benchResult *res)
+{
+   ringEvent ev;
+   ringEvent slot;
+   memset(res, 0, sizeof(benchResult));
+
+   double start = benchNow();
+   for(int pass=0; pass<passes; pass++)
+   {
+      int err = reader.rewind();
+      if(0 != err)
+      {
+         return err;
+      }
+
+      for(;;)
+      {
+         int size;
+         if(view)
+         {
+            const char *data;
+            size = reader.readView(slot.type, slot.ts, data);
+            if((size > (int)sizeof(rtpHeader)) && (PACKET_TYPE_RTP == slot.type) && reader.persistentView())
+            {
+               slot.tail = data + sizeof(rtpHeader);
+               slot.tailSize = size - sizeof(rtpHeader);
+               memcpy(slot.data, data, sizeof(rtpHeader));
+            }
+            else if(size > 0)
+            {
+               slot.tail = NULL;
+               memcpy(slot.data, data, size);
+            }
+         }
+         else
+         {
+            size = reader.read(ev.type, ev.ts, ev.data, sizeof(ev.data));
+            if(size > 0)
+            {
+               slot.type = ev.type;
+               slot.ts = ev.ts;
+               memcpy(slot.data, ev.data, size);
+            }
+         }
+         if(size < 0)
+         {
+            return errno;
+         }
+         if(0 == size)
+         {
+            break;
+         }
+         slot.size = size;
+         res->events++;
+         res->bytes += size;
+      }
+   }
+   res->seconds = benchNow() - start;
+   return 0;
+}
+
+static void benchReport(const char *name, const benchResult *res)
+{
+   double rate = res->bytes / res->seconds;
+   printf("%-6s %10llu events %8.3f sec %10.0f events/s %8.1f MB/s, %5.2f%% of a core at %.0f Mbit/s\n"
+          , name, (unsigned long long)res->events, res->seconds, res->events / res->seconds, rate / 1e6
+          , 100.0 * (BENCH_RTP_BITRATE / 8) / rate, BENCH_RTP_BITRATE / 1e6);
+}
+
+/**
+ * Reads the logs with the block(map == false) or the mapped reader, copying(view == false)
+ * or viewing the events.
+ *
+ * @return POSIX error code or 0 on success
+ */
+static int benchReadLogs(int passes, int count, char **names, bool map, bool view, benchResult *res)
+{
+   std::vector<ILogFile*> files;
+   int err = benchOpen(count, names, map, files);
+   if(0 == err)
+   {
+      MultiLogReader reader(files);
+      err = benchRead(reader, passes, view, res);
+   }
+   benchClose(files);
+   return err;
+}
+
+static int benchReadMode(int passes, int count, char **names)
+{
+   //the first pass warms the page cache up
+   benchResult copy, view, mapped;
+   int err = benchReadLogs(1, count, names, false, true, &view);
+   if(0 == err)
+   {
+      err = benchReadLogs(passes, count, names, false, false, &copy);
+   }
+   if(0 == err)
+   {
+      err = benchReadLogs(passes, count, names, false, true, &view);
+   }
+   if(0 == err)
+   {
+      err = benchReadLogs(passes, count, names, true, true, &mapped);
+   }
+   if(0 != err)
+   {
+      fprintf(stderr, "Reading failed(%s)\n", strerror(err));
+      return err;
+   }
+
+   benchReport("read", &copy);
+   benchReport("view", &view);
+   benchReport("mapped", &mapped);
+   printf("view/read speedup %.2fx, mapped/read speedup %.2fx\n"
+          , copy.seconds / view.seconds, copy.seconds / mapped.seconds);
+   return 0;
+}
+
+/**
+ * Generated in-memory log: packets with a pseudo random gap of 0.5..1.5 msec,
+ * so the files of a merge test interleave irregularly and sometimes tie.
+ */
+class BenchLogFile : public ILogFile
+{
+public:
+   BenchLogFile(int index, uint64_t count)
+   {
+      this->count = count;
+      memset(this->payload, 0, sizeof(this->payload));
+      this->payload[0] = (char)index;
+      this->seed = 0x9E3779B9u * (index + 1);
+      rewind();
+   }
+
+   int readView(packetType &type, timeval &ts, const char *&data)
+   {
+      if(this->next >= this->count)
+      {
+         return 0;
+      }
+      this->state = this->state * 1664525u + 1013904223u;
+      this->usec += 500 + (this->state >> 8) % 1000;
+      this->next++;
+
+      type = PACKET_TYPE_CAN;
+      ts.tv_sec = this->usec / 1000000;
+      ts.tv_usec = this->usec % 1000000;
+      data = this->payload;
+      return sizeof(this->payload);
+   }
+
+   int rewind()
+   {
+      this->next = 0;
+      this->usec = 1458726003ull * 1000000;
+      this->state = this->seed;
+      return 0;
+   }
+
+   int seek(const timeval &ts) { return ENOTSUP; }
+   int open(const char* fname) { return 0; }
+   void close() {}
+
+private:
+   uint64_t count;
+   uint64_t next;
+   uint64_t usec;
+   uint32_t seed;
+   uint32_t state;
+   char payload[sizeof(canEvent)];
+};
+
+/**
+ * Reference merge: scans all files for the earliest read ahead packet, O(k) per packet.
+ *
+ * @return POSIX error code or 0 on success
+ */
+static int benchMergeLinear(std::vector<ILogFile*> &files, uint64_t *events, uint64_t *checksum)
+{
+   std::vector<MultiLogReader::fileContext> contexts(files.size());
+   std::vector<bool> valid(files.size(), false);
+   std::vector<bool> end(files.size(), false);
+
+   for(;;)
+   {
+      int earliest = -1;
+      for(int i=0; i<(int)files.size(); i++)
+      {
+         if(!end[i] && !valid[i])
+         {
+            int size = files[i]->readView(contexts[i].type, contexts[i].ts, contexts[i].data);
+            if(-1 == size)
+            {
+               return errno;
+            }
+            end[i] = (0 == size);
+            valid[i] = (0 != size);
+         }
+         if(valid[i] && ((-1 == earliest) || timercmp(&contexts[i].ts, &contexts[earliest].ts, <)))
+         {
+            earliest = i;
+         }
+      }
+      if(-1 == earliest)
+      {
+         return 0;
+      }
+      valid[earliest] = false;
+      (*events)++;
+      *checksum = *checksum * 31 + (uint8_t)contexts[earliest].data[0];
+   }
+}
+
+/**
+ * @return POSIX error code or 0 on success
+ */
+static int benchMergeHeap(std::vector<ILogFile*> &files, uint64_t *events, uint64_t *checksum)
+{
+   MultiLogReader reader(files);
+   packetType type;
+   timeval ts;
+   const char *data;
+   int size;
+   while((size = reader.readView(type, ts, data)) > 0)
+   {
+      (*events)++;
+      *checksum = *checksum * 31 + (uint8_t)data[0];
+   }
+   return (0 == size) ? 0 : errno;
+}
+
+static int benchMergeMode()
+{
+   printf("%4s %12s %14s %14s %8s\n", "k", "events", "linear ev/s", "heap ev/s", "speedup");
+   for(int k=2; k<=BENCH_MERGE_FILES; k*=2)
+   {
+      std::vector<ILogFile*> files;
+      for(int i=0; i<k; i++)
+      {
+         files.push_back(new BenchLogFile(i, BENCH_MERGE_EVENTS / k));
+      }
+
+      uint64_t linearEvents = 0, heapEvents = 0;
+      uint64_t linearSum = 0, heapSum = 0;
+      double start = benchNow();
+      int err = benchMergeLinear(files, &linearEvents, &linearSum);
+      double linearTime = benchNow() - start;
+      for(int i=0; (0 == err) && (i<k); i++)
+      {
+         err = files[i]->rewind();
+      }
+      start = benchNow();
+      if(0 == err)
+      {
+         err = benchMergeHeap(files, &heapEvents, &heapSum);
+      }
+      double heapTime = benchNow() - start;
+      benchClose(files);
+
+      if(0 != err)
+      {
+         fprintf(stderr, "Merge failed(%s)\n", strerror(err));
+         return err;
+      }
+      if((linearEvents != heapEvents) || (linearSum != heapSum))
+      {
+         fprintf(stderr, "k=%i: merged streams differ\n", k);
+         return EINVAL;
+      }
+      printf("%4i %12llu %14.0f %14.0f %7.2fx\n", k, (unsigned long long)heapEvents
+             , linearEvents / linearTime, heapEvents / heapTime, linearTime / heapTime);
+   }
+   return 0;
+}
+
+/**
+ * Reads the events log passes times over and reports the decode rate relatively
+ * to the replay bitrate of the log(its payload over its duration).
+ *
+ * @return POSIX error code or 0 on success
+ */
+static int benchDecodeLog(int passes, const char *name)
+{
+   struct stat st;
+   if(0 != stat(name, &st))
+   {
+      fprintf(stderr, "stat(%s) failed(%s)\n", name, strerror(errno));
+      return errno;
+   }
+
+   MixedLogFile file;
+   int err = file.open(name);
+   if(0 != err)
+   {
+      return err;
+   }
+
+   uint64_t events = 0;
+   uint64_t bytes = 0;
+   timeval first = {0, 0};
+   timeval last = {0, 0};
+   double start = benchNow();
+   double startCpu = benchCpu();
+   for(int pass=0; (pass<passes) && (0 == err); pass++)
+   {
+      err = file.rewind();
+      packetType type;
+      timeval ts;
+      const char *data;
+      int size;
+      while((0 == err) && ((size = file.readView(type, ts, data)) > 0))
+      {
+         if(0 == events)
+         {
+            first = ts;
+         }
+         last = ts;
+         events++;
+         bytes += size;
+      }
+      if((0 == err) && (size < 0))
+      {
+         err = errno;
+      }
+   }
+   double seconds = benchNow() - start;
+   double cpu = benchCpu() - startCpu;
+   file.close();
+   if(0 != err)
+   {
+      fprintf(stderr, "Reading %s failed(%s)\n", name, strerror(err));
+      return err;
+   }
+
+   double duration = (last.tv_sec - first.tv_sec) + (last.tv_usec - first.tv_usec) / 1e6;
+   double rate = bytes * 8 / seconds;
+   printf("%s: %llu bytes, %llu events %8.3f sec(%.3f sec CPU) %10.0f events/s %8.1f Mbit/s\n"
+          , name, (unsigned long long)st.st_size, (unsigned long long)events, seconds, cpu
+          , events / seconds, rate / 1e6);
+   if(duration > 0)
+   {
+      double replay = bytes / passes * 8 / duration;
+      printf("%s: replayed at %.1f Mbit/s, decoded %.1fx faster than real time, %5.2f%% of a core\n"
+             , name, replay / 1e6, rate / replay, 100.0 * cpu / (duration * passes));
+   }
+   return 0;
+}
+
+static int benchDecodeMode(int passes, int count, char **names)
+{
+   for(int i=0; i<count; i++)
+   {
+      int err = benchDecodeLog(passes, names[i]);
+      if(0 != err)
+      {
+         return err;
+      }
+   }
+   return 0;
+}
+
+/**
+ * Reference CAN text log parser: fgets() and sscanf() per line, the player and
+ * the parser dialects are tried in turn.
+ *
+ * @return POSIX error code or 0 on success
+ */
+static int benchCanSscanf(const char *name, uint64_t *lines, uint64_t *events, uint64_t *checksum)
+{
+   FILE *fp = fopen(name, "r");
+   if(NULL == fp)
+   {
+      fprintf(stderr, "Unable to open the file %s(%s)\n", name, strerror(errno));
+      return errno;
+   }
+
+   char buf[256];
+   uint64_t rts = 0;
+   uint64_t baseTs;
+   while(fgets(buf, sizeof(buf), fp) != NULL)
+   {
+      (*lines)++;
+      if((0 == strncmp(buf, "rts: ", 5)) && (2 == sscanf(buf, "rts: %lu  ts: %lu", &rts, &baseTs)))
+      {
+         break;
+      }
+   }
+
+   canEvent pkt;
+   uint32_t canData[8];
+   while(fgets(buf, sizeof(buf), fp) != NULL)
+   {
+      (*lines)++;
+      if(0 != strncmp(buf, "ts: ", 4))
+      {
+         continue;
+      }
+      uint64_t pktts;
+      int count = sscanf(buf,"ts: %lu %x [%u] %x %x %x %x %x %x %x %x", &pktts, &pkt.id, &pkt.len
+                         ,canData, canData+1, canData+2, canData+3, canData+4, canData+5, canData+6, canData+7 );
+      if(11 != count)
+      {
+         count = sscanf(buf,"ts: %lu   ID: %x LEN:%u DATA:%x %x %x %x %x %x %x %x", &pktts, &pkt.id, &pkt.len
+                        ,canData, canData+1, canData+2, canData+3, canData+4, canData+5, canData+6, canData+7 );
+      }
+      if(11 != count)
+      {
+         continue;
+      }
+      ldiv_t parsedTime = ldiv(pktts + rts, 1e6);
+      for(int i=0; i<8; i++)
+      {
+         pkt.data[i] = (uint8_t)canData[i];
+      }
+      (*events)++;
+      *checksum = *checksum * 31 + parsedTime.quot * 1000000 + parsedTime.rem;
+      *checksum = *checksum * 31 + pkt.id + pkt.len;
+      for(int i=0; i<8; i++)
+      {
+         *checksum = *checksum * 31 + pkt.data[i];
+      }
+   }
+   fclose(fp);
+   return 0;
+}
+
+/**
+ * @return POSIX error code or 0 on success
+ */
+static int benchCanReader(const char *name, uint64_t *events, uint64_t *checksum)
+{
+   CanLogReader reader;
+   int err = reader.open(name);
+   if(0 != err)
+   {
+      return err;
+   }
+
+   canEvent pkt;
+   uint64_t ts;
+   while(0 == (err = reader.next(ts, pkt)))
+   {
+      (*events)++;
+      *checksum = *checksum * 31 + (ts / 1000000) * 1000000 + ts % 1000000;
+      *checksum = *checksum * 31 + pkt.id + pkt.len;
+      for(int i=0; i<8; i++)
+      {
+         *checksum = *checksum * 31 + pkt.data[i];
+      }
+   }
+   return (ENODATA == err) ? 0 : err;
+}
+
+static int benchCanMode(int passes, int count, char **names)
+{
+   printf("%-24s %10s %14s %14s %8s\n", "log", "lines", "sscanf lines/s", "reader lines/s", "speedup");
+   for(int i=0; i<count; i++)
+   {
+      uint64_t lines = 0, sscanfEvents = 0, readerEvents = 0;
+      uint64_t sscanfSum = 0, readerSum = 0;
+      int err = 0;
+
+      //the first pass of each parser warms the page cache up
+      double sscanfTime = 0;
+      for(int pass=0; (0 == err) && (pass <= passes); pass++)
+      {
+         uint64_t passLines = 0, passEvents = 0, passSum = 0;
+         double start = benchNow();
+         err = benchCanSscanf(names[i], &passLines, &passEvents, &passSum);
+         if(0 != pass)
+         {
+            sscanfTime += benchNow() - start;
+         }
+         lines = passLines;
+         sscanfEvents = passEvents;
+         sscanfSum = passSum;
+      }
+      double readerTime = 0;
+      for(int pass=0; (0 == err) && (pass <= passes); pass++)
+      {
+         uint64_t passEvents = 0, passSum = 0;
+         double start = benchNow();
+         err = benchCanReader(names[i], &passEvents, &passSum);
+         if(0 != pass)
+         {
+            readerTime += benchNow() - start;
+         }
+         readerEvents = passEvents;
+         readerSum = passSum;
+      }
+
+      if(0 != err)
+      {
+         fprintf(stderr, "Parsing %s failed(%s)\n", names[i], strerror(err));
+         return err;
+      }
+      if((sscanfEvents != readerEvents) || (sscanfSum != readerSum))
+      {
+         fprintf(stderr, "%s: parsed packets differ(%llu and %llu packets)\n", names[i]
+                 , (unsigned long long)sscanfEvents, (unsigned long long)readerEvents);
+         return EINVAL;
+      }
+      printf("%-24s %10llu %14.0f %14.0f %7.2fx\n", names[i], (unsigned long long)lines
+             , lines * passes / sscanfTime, lines * passes / readerTime, sscanfTime / readerTime);
+   }
+   return 0;
+}
+
+/**
+ * Reads every packet of the file.
+ *
+ * @return POSIX error code or 0 on success
+ */
+static int benchCanFile(CanLogFile &file, uint64_t *events, uint64_t *checksum)
+{
+   packetType type;
+   timeval ts;
+   const char *data;
+   int size;
+   while((size = file.readView(type, ts, data)) > 0)
+   {
+      const canEvent *pkt = (const canEvent *)data;
+      (*events)++;
+      *checksum = *checksum * 31 + (uint64_t)ts.tv_sec * 1000000 + ts.tv_usec;
+      *checksum = *checksum * 31 + pkt->id + pkt->len;
+      for(int i=0; i<8; i++)
+      {
+         *checksum = *checksum * 31 + pkt->data[i];
+      }
+   }
+   return (0 == size) ? 0 : errno;
+}
+
+static int benchCacheMode(int passes, int count, char **names)
+{
+   printf("%-24s %10s %12s %12s %12s %12s\n", "log", "packets", "first open s", "cached ms", "text read s", "cache read s");
+   for(int i=0; i<count; i++)
+   {
+      std::string cacheName = CanLogCache::fileName(names[i]);
+      unlink(cacheName.c_str());
+
+      //the text parsing the players did on every open, it warms the page cache up as well
+      uint64_t textEvents = 0, textSum = 0;
+      double start = benchNow();
+      int err = benchCanReader(names[i], &textEvents, &textSum);
+      double textTime = benchNow() - start;
+
+      CanLogFile file;
+      start = benchNow();
+      if(0 == err)
+      {
+         err = file.open(names[i]);
+      }
+      double firstTime = benchNow() - start;
+      file.close();
+      if((0 == err) && (0 != access(cacheName.c_str(), F_OK)))
+      {
+         fprintf(stderr, "%s: the cache is not written\n", names[i]);
+         return EACCES;
+      }
+
+      double openTime = 0, readTime = 0;
+      for(int pass=0; (0 == err) && (pass < passes); pass++)
+      {
+         uint64_t events = 0, sum = 0;
+         start = benchNow();
+         err = file.open(names[i]);
+         double opened = benchNow();
+         if(0 == err)
+         {
+            err = benchCanFile(file, &events, &sum);
+         }
+         readTime += benchNow() - opened;
+         openTime += opened - start;
+         file.close();
+         if((0 == err) && ((events != textEvents) || (sum != textSum)))
+         {
+            fprintf(stderr, "%s: cached packets differ(%llu and %llu packets)\n", names[i]
+                    , (unsigned long long)textEvents, (unsigned long long)events);
+            return EINVAL;
+         }
+      }
+      if(0 != err)
+      {
+         fprintf(stderr, "Reading %s failed(%s)\n", names[i], strerror(err));
+         return err;
+      }
+      printf("%-24s %10llu %12.3f %12.3f %12.3f %12.3f\n", names[i], (unsigned long long)textEvents
+             , firstTime, openTime * 1e3 / passes, textTime, readTime / passes);
+   }
+   return 0;
+}
+
+static void benchRtpSum(const timeval &ts, const char *data, int size, uint64_t *checksum)
+{
+   *checksum = *checksum * 31 + (uint64_t)ts.tv_sec * 1000000 + ts.tv_usec;
+   *checksum = *checksum * 31 + size;
+   for(int i=0; i<size; i+=64)
+   {
+      *checksum = *checksum * 31 + (uint8_t)data[i];
+   }
+}
+
+/**
+ * Extracts the RTP packets with libpcap like logparser does.
+ *
+ * @return POSIX error code or 0 on success
+ */
+static int benchPcapLib(const char *name, uint64_t *events, uint64_t *checksum)
+{
+   char errbuf[PCAP_ERRBUF_SIZE];
+   pcap_t *fp = pcap_open_offline(name, errbuf);
+   if(NULL == fp)
+   {
+      fprintf(stderr, "Unable to open the file %s(%s)\n", name, errbuf);
+      return EIO;
+   }
+
+   struct pcap_pkthdr *header;
+   const uint8_t *pkt;
+   int res;
+   while((res = pcap_next_ex(fp, &header, &pkt)) >= 0)
+   {
+      const char *data;
+      int size;
+      if(pcapFrameRtp(pkt, header->caplen, header->len, data, size))
+      {
+         (*events)++;
+         benchRtpSum(header->ts, data, size, checksum);
+      }
+   }
+   pcap_close(fp);
+   return (-2 == res) ? 0 : EIO;
+}
+
+/**
+ * @return POSIX error code or 0 on success
+ */
+static int benchPcapFile(const char *name, uint64_t *events, uint64_t *checksum)
+{
+   PcapLogFile file;
+   int err = file.open(name);
+   if(0 != err)
+   {
+      return err;
+   }
+
+   packetType type;
+   timeval ts;
+   const char *data;
+   int size;
+   while((size = file.readView(type, ts, data)) > 0)
+   {
+      (*events)++;
+      benchRtpSum(ts, data, size, checksum);
+   }
+   return (0 == size) ? 0 : errno;
+}
+
+static int benchPcapMode(int passes, int count, char **names)
+{
+   printf("%-24s %10s %12s %14s %14s %8s\n", "log", "packets", "size MB", "libpcap MB/s", "reader MB/s", "speedup");
+   for(int i=0; i<count; i++)
+   {
+      struct stat st;
+      if(0 != stat(names[i], &st))
+      {
+         fprintf(stderr, "Unable to stat %s(%s)\n", names[i], strerror(errno));
+         return errno;
+      }
+
+      //the first pass of each reader warms the page cache up
+      uint64_t libEvents = 0, libSum = 0, fileEvents = 0, fileSum = 0;
+      double libTime = 0, fileTime = 0;
+      int err = 0;
+      for(int pass=0; (0 == err) && (pass <= passes); pass++)
+      {
+         libEvents = libSum = 0;
+         double start = benchNow();
+         err = benchPcapLib(names[i], &libEvents, &libSum);
+         if(0 != pass)
+         {
+            libTime += benchNow() - start;
+         }
+      }
+      for(int pass=0; (0 == err) && (pass <= passes); pass++)
+      {
+         fileEvents = fileSum = 0;
+         double start = benchNow();
+         err = benchPcapFile(names[i], &fileEvents, &fileSum);
+         if(0 != pass)
+         {
+            fileTime += benchNow() - start;
+         }
+      }
+
+      if(0 != err)
+      {
+         fprintf(stderr, "Reading %s failed(%s)\n", names[i], strerror(err));
+         return err;
+      }
+      if((libEvents != fileEvents) || (libSum != fileSum))
+      {
+         fprintf(stderr, "%s: extracted packets differ(%llu and %llu packets)\n", names[i]
+                 , (unsigned long long)libEvents, (unsigned long long)fileEvents);
+         return EINVAL;
+      }
+      double mb = st.st_size / 1e6;
+      printf("%-24s %10llu %12.1f %14.0f %14.0f %7.2fx\n", names[i], (unsigned long long)libEvents, mb
+             , mb * passes / libTime, mb * passes / fileTime, libTime / fileTime);
+   }
+   return 0;
+}
+
+static void usage(const char *name)
+{
+   printf("Usage: %s read passes log [log...]\n", name);
+   printf("       %s merge\n", name);
+   printf("       %s decode passes log [log...]\n", name);
+   printf("       %s can passes can.log [can.log...]\n", name);
+   printf("       %s cache passes can.log [can.log...]\n", name);
+   printf("       %s pcap passes capture.pcap [capture.pcap...]\n", name);
+   printf("Like: %s read 10 dump.bin can.log\n", name);
+   printf("      %s decode 3 dump.v2.bin dump.v2z.bin\n", name);
+}
+
+int main(int argc, char **argv)
+{
+   int err;
+   if((argc >= 4) && ((0 == strcmp(argv[1], "read")) || (0 == strcmp(argv[1], "decode")) || (0 == strcmp(argv[1], "can"))
+                     || (0 == strcmp(argv[1], "cache")) || (0 == strcmp(argv[1], "pcap"))))
+   {
+      int passes = atoi(argv[2]);
+      if(passes <= 0)
+      {
+         fprintf(stderr, "Wrong passes count(%s)\n", argv[2]);
+         return EXIT_FAILURE;
+      }
+      if(0 == strcmp(argv[1], "read"))
+      {
+         err = benchReadMode(passes, argc - 3, argv + 3);
+      }
+      else if(0 == strcmp(argv[1], "decode"))
+      {
+         err = benchDecodeMode(passes, argc - 3, argv + 3);
+      }
+      else if(0 == strcmp(argv[1], "can"))
+      {
+         err = benchCanMode(passes, argc - 3, argv + 3);
+      }
+      else if(0 == strcmp(argv[1], "cache"))
+      {
+         err = benchCacheMode(passes, argc - 3, argv + 3);
+      }
+      else
+      {
+         err = benchPcapMode(passes, argc - 3, argv + 3);
+      }
+   }
+   else if((argc == 2) && (0 == strcmp(argv[1], "merge")))
+   {
+      err = benchMergeMode();
+   }
+   else
+   {
+      usage(argv[0]);
+      return EXIT_FAILURE;
+   }
+   return (0 == err) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
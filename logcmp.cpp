@@ -30,12 +30,47 @@ static uint64_t timeval2ms(struct timeval *a)
    return  res;
 }
 
-int searchForPacket(FILE *file, eventLogPacket *header, const char* pkt, struct timeval *ts)
+/**
+ * Checks the log header and skips it along with the summary of a self-describing log.
+ * Only ELOG v1 logs are supported.
+ *
+ * @param end - set to the file offset following the last packet
+ * @return 0 on success or -1 on failure
+ */
+static int skipHeader(FILE *file, const char *name, long *end)
+{
+   eventLogHeader header;
+   if((1 != fread(&header, sizeof(header), 1, file)) || (0 != memcmp(header.id, "ELOG", 4))
+      || (1 != (header.version & ~EVENT_LOG_INFO)))
+   {
+      fprintf(stderr, "%s is not an uncompressed ELOG v1 log\n", name);
+      return -1;
+   }
+
+   *end = LONG_MAX;
+   if(header.version & EVENT_LOG_INFO)
+   {
+      eventLogInfo info;
+      if(1 != fread(&info, sizeof(info), 1, file))
+      {
+         fprintf(stderr, "%s has a broken summary\n", name);
+         return -1;
+      }
+      *end = info.dataEnd;
+   }
+   return 0;
+}
+
+int searchForPacket(FILE *file, long end, eventLogPacket *header, const char* pkt, struct timeval *ts)
 {
    char buf[2000];
    eventLogPacket packetHeader;
    for(;;)
    {
+      if(ftell(file) >= end)
+      {
+         break;
+      }
       int err = fread(&packetHeader, 1, sizeof(eventLogPacket), file);
       if(sizeof(eventLogPacket) != err)
       {
@@ -128,14 +163,25 @@ int main(int argc, char **argv)
       return EXIT_FAILURE;
    }
 
-   fseek(originalDump, sizeof(eventLogHeader), SEEK_SET);
-   fseek(recollectedDumpRTP, sizeof(eventLogHeader), SEEK_SET);
-   fseek(recollectedDumpCAN, sizeof(eventLogHeader), SEEK_SET);
+   long originalEnd, recollectedEnd;
+   if((0 != skipHeader(originalDump, originalDumpName, &originalEnd))
+      || (0 != skipHeader(recollectedDumpRTP, recollectedDumpName, &recollectedEnd))
+      || (0 != skipHeader(recollectedDumpCAN, recollectedDumpName, &recollectedEnd)))
+   {
+      fclose(originalDump);
+      fclose(recollectedDumpRTP);
+      fclose(recollectedDumpCAN);
+      return EXIT_FAILURE;
+   }
 
    char buf[2000];
    eventLogPacket packetHeader;
    for(;;)
    {
+      if(ftell(originalDump) >= originalEnd)
+      {
+         break;
+      }
       int err = fread(&packetHeader, 1, sizeof(eventLogPacket), originalDump);
       if(sizeof(eventLogPacket) != err)
       {
@@ -162,12 +208,12 @@ int main(int argc, char **argv)
       if(PACKET_TYPE_CAN == packetHeader.type)
       {
          busName = "CAN";
-         err = searchForPacket(recollectedDumpCAN, &packetHeader, buf, &ts);
+         err = searchForPacket(recollectedDumpCAN, recollectedEnd, &packetHeader, buf, &ts);
       }
       else
       {
          busName = "RTP";
-         err = searchForPacket(recollectedDumpRTP, &packetHeader, buf, &ts);
+         err = searchForPacket(recollectedDumpRTP, recollectedEnd, &packetHeader, buf, &ts);
       }
       if(0 == err)
       {
@@ -0,0 +1,120 @@
+/**
+ * Converts an events log(@see eventlog.h) to the given ELOG version, for example
+ * a v1 log produced by an older logparser to the compact v2 records or back,
+ * and block compresses it or decompresses it.
+ * The output log carries the summary and the time index(the chunk directory if it is compressed),
+ * so converting an older log adds them.
+*/
+
+#include <stdio.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+
+#include "eventlog.h"
+#include "mixedLogFile.h"
+#include "eventLogWriter.h"
+
+static void usage(const char *name)
+{
+   printf("Usage: %s [-v version] [-z level] in.bin out.bin\n", name);
+   printf("  -v ELOG version of the output log: 1 or 2(default: 2)\n");
+   printf("  -z block compress the output log with the zlib level 1..9(default: 0 - not compressed)\n");
+   printf("Like: %s -v 2 23022016.bin 23022016.v2.bin\n", name);
+   printf("      %s -v 2 -z 6 23022016.bin 23022016.v2z.bin\n", name);
+}
+
+int main(int argc, char **argv)
+{
+   uint32_t version = 2;
+   int level = 0;
+
+   int opt;
+   while ((opt = getopt(argc, argv, "v:z:")) != -1)
+   {
+      switch (opt)
+      {
+         case 'v':
+            version = atoi(optarg);
+            break;
+         case 'z':
+            level = atoi(optarg);
+            break;
+         default:
+            usage(argv[0]);
+            return EXIT_FAILURE;
+      }
+   }
+   if(argc - optind != 2)
+   {
+      usage(argv[0]);
+      return EXIT_FAILURE;
+   }
+   const char *inFile = argv[optind];
+   const char *outFile = argv[optind + 1];
+
+   MixedLogFile in;
+   int err = in.open(inFile);
+   if(0 != err)
+   {
+      return EXIT_FAILURE;
+   }
+
+   EventLogWriter out;
+   err = out.open(outFile, version, level);
+   if(0 != err)
+   {
+      return EXIT_FAILURE;
+   }
+
+   struct timespec start, end;
+   clock_gettime(CLOCK_MONOTONIC, &start);
+
+   uint64_t count = 0;
+   uint64_t inSize = sizeof(eventLogHeader);
+   packetType type;
+   timeval ts;
+   const char *data;
+   int size;
+   while((size = in.readView(type, ts, data)) > 0)
+   {
+      err = out.write(type, ts, data, size);
+      if(0 != err)
+      {
+         fprintf(stderr, "Writing %s failed(%s)\n", outFile, strerror(err));
+         break;
+      }
+      inSize += sizeof(eventLogPacket) + size;
+      count++;
+   }
+   if(size < 0)
+   {
+      err = errno;
+      fprintf(stderr, "Reading %s failed(%s)\n", inFile, strerror(err));
+   }
+   in.close();
+
+   int closeErr = out.close();
+   if((0 != err) || (0 != closeErr))
+   {
+      return EXIT_FAILURE;
+   }
+
+   clock_gettime(CLOCK_MONOTONIC, &end);
+   double seconds = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+   if(0 != level)
+   {
+      printf("Converted %llu packets to compressed ELOG v%u in %.3f sec: %llu bytes(%.1f%% of the v1 size), %i chunks\n"
+             , (unsigned long long)count, version, seconds, (unsigned long long)out.size()
+             , 100.0 * out.size() / inSize, out.chunks());
+   }
+   else
+   {
+      printf("Converted %llu packets to ELOG v%u in %.3f sec: %llu bytes(%.1f%% of the v1 size), %i index checkpoints\n"
+             , (unsigned long long)count, version, seconds, (unsigned long long)out.size()
+             , 100.0 * out.size() / inSize, out.checkpoints());
+   }
+   return EXIT_SUCCESS;
+}
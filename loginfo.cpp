@@ -0,0 +1,151 @@
+/**
+ * Prints the summary of self-describing events logs(@see EVENT_LOG_INFO in eventlog.h):
+ * the time range, packet counts and totals per type, the stream table and the index.
+ * Only the log header is read, so it takes the same time on a log of any size.
+*/
+
+#include <stdio.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+
+#include "eventlog.h"
+
+static const char *typeName(uint32_t type)
+{
+   switch(type)
+   {
+      case PACKET_TYPE_CAN:
+         return "CAN";
+      case PACKET_TYPE_RTP:
+         return "RTP";
+      default:
+         return "unknown";
+   }
+}
+
+static void printTime(const char *name, uint64_t sec, uint64_t usec)
+{
+   time_t t = (time_t)sec;
+   struct tm tm;
+   char buf[64];
+   strftime(buf, sizeof(buf), "%Y-%m-%d %H:%M:%S", localtime_r(&t, &tm));
+   printf("   %s %s.%06llu\n", name, buf, (unsigned long long)usec);
+}
+
+/**
+ * @return POSIX error code or 0 on success
+ */
+static int printInfo(const char *fname)
+{
+   FILE *fp = fopen(fname, "rb");
+   if(NULL == fp)
+   {
+      fprintf(stderr, "Unable to open the file %s(%s)\n", fname, strerror(errno));
+      return errno;
+   }
+
+   eventLogHeader header;
+   eventLogInfo info;
+   if((1 != fread(&header, sizeof(header), 1, fp)) || (0 != memcmp(header.id, "ELOG", 4)))
+   {
+      fprintf(stderr, "%s is not an events log\n", fname);
+      fclose(fp);
+      return EINVAL;
+   }
+   uint32_t version = header.version & EVENT_LOG_VERSION_MASK;
+   bool compressed = (0 != (header.version & EVENT_LOG_COMPRESSED));
+   if(0 == (header.version & EVENT_LOG_INFO))
+   {
+      printf("%s: ELOG v%u%s without a summary, convert it with logconv to add one\n"
+             , fname, version, compressed ? "(compressed)" : "");
+      fclose(fp);
+      return 0;
+   }
+   if((1 != fread(&info, sizeof(info), 1, fp)) || (info.streamCount > EVENT_LOG_MAX_STREAMS))
+   {
+      fprintf(stderr, "%s has a broken summary\n", fname);
+      fclose(fp);
+      return EINVAL;
+   }
+
+   double duration = ((int64_t)info.lastSec - (int64_t)info.firstSec)
+                   + ((int64_t)info.lastUsec - (int64_t)info.firstUsec) / 1e6;
+   printf("%s: ELOG v%u%s, records %llu bytes\n", fname, version, compressed ? "(compressed)" : ""
+          , (unsigned long long)(info.dataEnd - sizeof(header) - sizeof(info)));
+   printTime("first", info.firstSec, info.firstUsec);
+   printTime("last ", info.lastSec, info.lastUsec);
+   printf("   duration %.3f sec\n", duration);
+
+   for(int type=0; type<PACKET_TYPE_MAX; type++)
+   {
+      printf("   %s: %llu packets, %llu bytes\n", typeName(type)
+             , (unsigned long long)info.count[type], (unsigned long long)info.bytes[type]);
+   }
+   for(uint32_t i=0; i<info.streamCount; i++)
+   {
+      const eventLogStream &s = info.streams[i];
+      double kbps = (duration > 0) ? s.bytes * 8 / duration / 1e3 : 0;
+      if(PACKET_TYPE_RTP == s.type)
+      {
+         printf("   stream %u: RTP ssrc 0x%08x pt %u, %llu packets, %llu bytes, %.1f kbit/s\n", i, s.id, s.payloadType
+                , (unsigned long long)s.count, (unsigned long long)s.bytes, kbps);
+      }
+      else
+      {
+         printf("   stream %u: %s, %llu packets, %llu bytes, %.1f kbit/s\n", i, typeName(s.type)
+                , (unsigned long long)s.count, (unsigned long long)s.bytes, kbps);
+      }
+   }
+
+   if(0 == info.indexOffset)
+   {
+      printf("   no index\n");
+   }
+   else if(compressed)
+   {
+      printf("   chunk directory at %llu\n", (unsigned long long)info.indexOffset);
+   }
+   else
+   {
+      eventIndexHeader index;
+      if((0 == fseek(fp, info.indexOffset, SEEK_SET)) && (1 == fread(&index, sizeof(index), 1, fp))
+         && (0 == memcmp(index.id, "EIDX", 4)))
+      {
+         printf("   index at %llu, %llu checkpoints\n", (unsigned long long)info.indexOffset, (unsigned long long)index.count);
+      }
+      else
+      {
+         printf("   index at %llu is broken\n", (unsigned long long)info.indexOffset);
+      }
+   }
+   fclose(fp);
+   return 0;
+}
+
+static void usage(const char *name)
+{
+   printf("Usage: %s log.bin [log.bin...]\n", name);
+   printf("Like: %s 23022016.bin\n", name);
+}
+
+int main(int argc, char **argv)
+{
+   if(argc < 2)
+   {
+      usage(argv[0]);
+      return EXIT_FAILURE;
+   }
+
+   int result = EXIT_SUCCESS;
+   for(int i=1; i<argc; i++)
+   {
+      if(0 != printInfo(argv[i]))
+      {
+         result = EXIT_FAILURE;
+      }
+   }
+   return result;
+}
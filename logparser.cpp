@@ -12,107 +12,51 @@
 #include <time.h>
 
 #include <limits.h>
+#include <pthread.h>
 #include <pcap.h>
 
-#include "eventlog.h"
+#include <vector>
+#include <deque>
 
-#define SWAP2(i)           (static_cast<uint16_t>((static_cast<uint16_t>(i) << 8) | (static_cast<uint16_t>(i) >> 8)))
-#define SWAP4(i)           (((i)<<24) | (((i)& 0x0000FF00)<<8) | (((i)& 0x00FF0000)>>8) | ((i)>>24) )
-
-#define ETHERNET_FRAME_MAX_SIZE      (2000u)
-//MIN size of RTP packet to sort out some unrelated data and make parsing more safe
-#define ETHERNET_FRAME_MIN_SIZE      (12u+14u+20u+8u)
-
-#define SIZE_UDP 8
-/* Ethernet header */
-struct sniff_ethernet {
-   uint8_t ether_dhost[6];
-   uint8_t ether_shost[6];
-   uint16_t ether_type;
-};
-
-/* IP header */
-struct sniff_ip {
-   uint8_t ip_vhl;    /* version << 4 | header length >> 2 */
-   uint8_t ip_tos;    /* type of service */
-   uint16_t ip_len;   /* total length */
-   uint16_t ip_id;    /* identification */
-   uint16_t ip_off;   /* fragment offset field */
-   uint8_t ip_ttl;    /* time to live */
-   uint8_t ip_p;      /* protocol */
-   uint16_t ip_sum;   /* checksum */
-   uint32_t ip_src;
-   uint32_t ip_dst;
-};
-#define IP_HL(ip)    (((ip)->ip_vhl) & 0x0f)
-#define IP_V(ip)     (((ip)->ip_vhl) >> 4)
-
-struct sniff_udp_rtp {
-   uint16_t sport;
-   uint16_t dport;
-   uint16_t length;
-   uint16_t checksum;
-   rtpHeader rtp;
-};
+#include "eventlog.h"
+#include "eventLogWriter.h"
+#include "canLogReader.h"
+#include "canLogParallelReader.h"
+#include "pcapFrame.h"
 
 /**
- * Internal can log parser data contains file handler and timestamp base greeped from
- * CAN log header.
+ * Internal can log parser data contains the buffered log reader and the last read packet.
+ * With several threads the log is parsed by the parallel reader instead.
 */
 typedef struct
 {
-   FILE *canDump;
-   uint64_t  timeBase;//rts value form log header(rts: 1458726428015650 ts: 2659501121)
+   CanLogReader log;
+   CanLogParallelReader parallel;
+   int threads;
+   canEvent pkt;
 }canReader;
 
 
 /**
- * Reads the next packet from the CAN log and provide it as pointer to a static buffer.
+ * Reads the next packet from the CAN log and provide it as pointer to the reader buffer.
  * If end of file is reached the ENODATA is returned.
  *
  * @return POSIX error code or 0 on success
  */
 static int canReadNextPkt(canReader *ctx, struct timeval *ts, char **data, int *size)
 {
-   static canEvent pkt;
-   uint32_t canData[8];
-
-   char buf[256];
-   while(fgets(buf, sizeof(buf), ctx->canDump) != NULL)
+   uint64_t msgTimestamp;
+   int err = (ctx->threads > 1) ? ctx->parallel.next(msgTimestamp, ctx->pkt) : ctx->log.next(msgTimestamp, ctx->pkt);
+   if(0 != err)
    {
-      if(0==strncmp(buf, "ts: ", 4))//ts: 000000092770   ID:  47 LEN:8 DATA:20 00 00 00 00 00 00 00
-      {
-         uint64_t pktts;
-         int count = sscanf(buf,"ts: %lu   ID: %x LEN:%u DATA:%x %x %x %x %x %x %x %x", &pktts, &pkt.id, &pkt.len
-                            ,canData, canData+1, canData+2, canData+3, canData+4, canData+5, canData+6, canData+7 );
-         if(11 != count)
-         {
-            fprintf(stderr, "Wrong line format: (%s)", buf);
-            continue;
-         }
-         uint64_t  msgTimestamp = pktts + ctx->timeBase;
-         ldiv_t parsedTime = ldiv(msgTimestamp, 1e6);
-
-         for(int i=0; i<8; i++)
-         {
-            pkt.data[i] = (uint8_t)canData[i];
-         }
-
-         ts->tv_sec = parsedTime.quot;
-         ts->tv_usec = parsedTime.rem;
-         *size = sizeof(canEvent);
-         *data = (char*)&pkt;
-
-         return 0;
-      }
-   }
-
-   if(feof(ctx->canDump))
-   {
-      return ENODATA;
+      return err;
    }
 
-   return EIO;
+   ts->tv_sec = msgTimestamp / 1000000;
+   ts->tv_usec = msgTimestamp % 1000000;
+   *size = sizeof(canEvent);
+   *data = (char*)&ctx->pkt;
+   return 0;
 }
 
 /**
@@ -120,48 +64,17 @@ static int canReadNextPkt(canReader *ctx, struct timeval *ts, char **data, int *
  *
  * @return POSIX error code or 0 on success
  */
-static int canReaderInit(canReader *ctx, const char *fname)
+static int canReaderInit(canReader *ctx, const char *fname, int threads)
 {
-   ctx->timeBase = 0u;
-
-   ctx->canDump = fopen(fname, "r");
-   if (ctx->canDump == NULL)
-   {
-      fprintf(stderr, "Unable to open the file %s(%s)\n", fname, strerror(errno));
-      return errno;
-   }
-
-   char buf[256];
-   uint64_t rts = 0u;
-   uint64_t baseTs = 0u;
-   while(fgets(buf, sizeof(buf), ctx->canDump) != NULL)
-   {
-      if(0==strncmp(buf, "rts: ", 5))
-      {
-         int count = sscanf(buf,"rts: %lu  ts: %lu", &rts, &baseTs);
-         if(2 != count)
-         {
-            fprintf(stderr, "Wrong RTS specification string: (%s)", buf);
-            fclose(ctx->canDump);
-            ctx->canDump = NULL;
-            return EIO;
-         }
-         ctx->timeBase = rts;
-         time_t startTime = rts/1e6;
-         printf("CAN log started from  %s", ctime(&startTime));
-
-         break;
-      }
-   }
-
-   if(0u == ctx->timeBase)
+   ctx->threads = threads;
+   int err = (threads > 1) ? ctx->parallel.open(fname, threads) : ctx->log.open(fname);
+   if(0 != err)
    {
-      fprintf(stderr, "Failed to init can dump timebase!\n");
-      fclose(ctx->canDump);
-      ctx->canDump = NULL;
-      return EIO;
+      return err;
    }
 
+   time_t startTime = ((threads > 1) ? ctx->parallel.timeBase() : ctx->log.timeBase()) / 1000000;
+   printf("CAN log started from  %s", ctime(&startTime));
    return 0;
 }
 
@@ -170,25 +83,53 @@ static int canReaderInit(canReader *ctx, const char *fname)
  */
 void canReaderClose(canReader *ctx)
 {
-   fclose(ctx->canDump);
-   ctx->canDump = NULL;
+   ctx->log.close();
+   ctx->parallel.close();
    return;
 }
 
 /**
- * Internal PCAP log parser data contains pcap library handler
+ * Internal PCAP log parser data contains pcap library handler, the selected RTP streams
+ * and the amount of the frames libpcap returned.
 */
 typedef struct
 {
    pcap_t *fp;
+   pcapRtpSelect select;
+   uint64_t frames;
 }pcapReader;
 
 /**
- * Open and verify the PCAP dump file with libpcap.
+ * Builds the BPF expression matching the frames pcapFrameRtp() may select, like:
+ *    ip and udp and greater 55 and less 2000 and udp[8] & 0xc0 = 0x80 and udp[9] & 0x7f = 98
+ */
+static void pcapFilterExpression(const pcapRtpSelect *select, char *expression, size_t size)
+{
+   int len = snprintf(expression, size, "ip and udp and greater %u and less %u and udp[8] & 0xc0 = 0x80"
+                      , ETHERNET_FRAME_MIN_SIZE + 1, ETHERNET_FRAME_MAX_SIZE);
+   if(select->payloadType >= 0)
+   {
+      len += snprintf(expression + len, size - len, " and udp[9] & 0x7f = %d", select->payloadType);
+   }
+   if(0 != select->port)
+   {
+      len += snprintf(expression + len, size - len, " and udp port %d", select->port);
+   }
+   if(select->ssrc >= 0)
+   {
+      snprintf(expression + len, size - len, " and udp[16:4] = 0x%08x", (uint32_t)select->ssrc);
+   }
+}
+
+/**
+ * Open and verify the PCAP dump file with libpcap. The frames are prefiltered by libpcap
+ * with the compiled BPF filter, so most of the unrelated traffic of a capture isn't even
+ * returned to the parser.
  *
+ * @param filter - BPF filter expression, NULL - built from the stream selection
  * @return POSIX error code or 0 on success
  */
-int pcapReaderInit(pcapReader *ctx, const char *fname)
+int pcapReaderInit(pcapReader *ctx, const char *fname, const pcapRtpSelect *select, const char *filter)
 {
    char errbuf[PCAP_ERRBUF_SIZE];
    if((ctx->fp = pcap_open_offline(fname, errbuf)) == NULL)
@@ -196,6 +137,39 @@ int pcapReaderInit(pcapReader *ctx, const char *fname)
       fprintf(stderr, "Unable to open the file %s(%s)\n", fname, errbuf);
       return EIO;
    }
+   ctx->select = *select;
+   ctx->frames = 0;
+
+   if(DLT_EN10MB != pcap_datalink(ctx->fp))
+   {
+      //pcapFrameRtp() wouldn't find a RTP packet in them either
+      fprintf(stderr, "%s doesn't contain Ethernet frames\n", fname);
+      pcap_close(ctx->fp);
+      return EINVAL;
+   }
+
+   char expression[256];
+   if(NULL == filter)
+   {
+      pcapFilterExpression(select, expression, sizeof(expression));
+      filter = expression;
+   }
+   struct bpf_program program;
+   if(0 != pcap_compile(ctx->fp, &program, filter, 1, PCAP_NETMASK_UNKNOWN))
+   {
+      fprintf(stderr, "Unable to compile the filter '%s'(%s)\n", filter, pcap_geterr(ctx->fp));
+      pcap_close(ctx->fp);
+      return EINVAL;
+   }
+   int err = pcap_setfilter(ctx->fp, &program);
+   pcap_freecode(&program);
+   if(0 != err)
+   {
+      fprintf(stderr, "Unable to set the filter '%s'(%s)\n", filter, pcap_geterr(ctx->fp));
+      pcap_close(ctx->fp);
+      return EINVAL;
+   }
+   printf("PCAP filter: %s\n", filter);
 
    return 0;
 }
@@ -215,50 +189,23 @@ int pcapReadNextPkt(pcapReader *ctx, struct timeval *ts, char **data, int *size)
 
    while((res = pcap_next_ex(ctx->fp, &header, &pkt_data)) >= 0)
    {
+      ctx->frames++;
       if(!firstPktProcessed)
       {
          printf("PCAP log started from %s", ctime(&header->ts.tv_sec));
          firstPktProcessed = true;
       }
 
-      if(header->len <= ETHERNET_FRAME_MIN_SIZE || header->len > ETHERNET_FRAME_MAX_SIZE)
-      {
-         continue;
-      }
-      struct sniff_ethernet *ethernet;
-      ethernet = (sniff_ethernet*)pkt_data;
-      if(0x0008 != ethernet->ether_type)//IP packet
-      {
-         continue;
-      }
-
-      struct sniff_ip *ip = (sniff_ip*)(pkt_data + sizeof(sniff_ethernet));
-      u_int size_ip;
-      size_ip = IP_HL(ip)*4;
-      if (size_ip < 20)
-      {
-         continue;
-      }
-      if(17 != ip->ip_p)//UDP packet
-      {
-         continue;
-      }
-
-      sniff_udp_rtp *udp =(sniff_udp_rtp *)(pkt_data + sizeof(sniff_ethernet) + size_ip);
-      if((98 != udp->rtp.pt) || (2 != udp->rtp.version))//likely not an RTP packet
+      const char *rtp;
+      int rtpSize;
+      if(!pcapFrameRtp(pkt_data, header->caplen, header->len, rtp, rtpSize, ctx->select))
       {
          continue;
       }
 
-//      printf("Packets dump timestamp: %li; len: %u(%u->%u[%u]):ssrc: %x; ts: %u version: %u pt: %u\n", header->ts.tv_sec, header->len
-//              , SWAP2(udp->sport), SWAP2(udp->dport), SWAP2(udp->length)
-//              , SWAP4(udp->rtp.ssrc), SWAP4(udp->rtp.ts)
-//              , udp->rtp.version, udp->rtp.pt
-//             );
-
       *ts = header->ts;
-      *data = (char*)&udp->rtp;
-      *size = SWAP2(udp->length) - SIZE_UDP;
+      *data = (char*)rtp;
+      *size = rtpSize;
       break;
    }
 
@@ -283,22 +230,385 @@ void pcapReaderClose(pcapReader *ctx)
    return;
 }
 
+//the packets are passed between the pipeline stages in batches of that many packets
+#define PARSER_BATCH_PACKETS (1024)
+//amount of batches of every queue, it bounds the memory of the pipeline
+#define PARSER_QUEUE_BATCHES (8)
+
+typedef struct
+{
+   packetType type;
+   struct timeval ts;
+   size_t offset; //the packet data in parserBatch::data
+   int size;
+}parserPacket;
+
+/**
+ * Packets passed between the stages, the data is copied as the readers reuse their buffers.
+*/
+typedef struct
+{
+   std::vector<parserPacket> packets;
+   std::vector<char> data;
+   int err; //the stream ends after the batch: ENODATA at the end of file or the producer error
+}parserBatch;
+
+/**
+ * Bounded queue between two pipeline stages: the filled batches go to the consumer and
+ * come back empty, so the producer blocks once PARSER_QUEUE_BATCHES are in flight.
+*/
+typedef struct
+{
+   pthread_mutex_t lock;
+   pthread_cond_t cond;
+   std::deque<parserBatch*> full;
+   std::deque<parserBatch*> empty;
+   bool stop; //the consumer doesn't take batches anymore
+}parserQueue;
+
+/**
+ * Throughput statistics of a stage.
+*/
+typedef struct
+{
+   const char *name;
+   uint64_t packets;
+   uint64_t bytes;
+   double cpu;  //the stage thread CPU time(sec)
+   double wait; //time(sec) blocked on the queues
+}parserStage;
+
+/**
+ * Pipeline input: the decoder thread reads the packets of a log into the queue batches.
+*/
+typedef struct
+{
+   int (*read)(void *reader, struct timeval *ts, char **data, int *size);
+   void *reader;
+   packetType type;
+   const char *readName;  //reported if reading fails
+   parserQueue queue;
+   parserStage stage;
+   pthread_t thread;
+   parserBatch *batch;    //merge: the batch being merged
+   size_t pos;            //merge: the next packet of the batch
+}parserInput;
+
+/**
+ * Pipeline output: the writer thread encodes the merged batches into the log.
+*/
+typedef struct
+{
+   EventLogWriter *file;
+   parserQueue queue;
+   parserStage stage;
+   pthread_t thread;
+   int err;  //the write error
+}parserOutput;
+
+/**
+ * @return monotonic time in seconds
+ */
+static double parserNow()
+{
+   struct timespec now;
+   clock_gettime(CLOCK_MONOTONIC, &now);
+   return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+/**
+ * @return CPU time(seconds) consumed by the calling thread
+ */
+static double parserThreadCpu()
+{
+   struct timespec now;
+   clock_gettime(CLOCK_THREAD_CPUTIME_ID, &now);
+   return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+static void queueInit(parserQueue *q)
+{
+   pthread_mutex_init(&q->lock, NULL);
+   pthread_cond_init(&q->cond, NULL);
+   for(int i=0; i<PARSER_QUEUE_BATCHES; i++)
+   {
+      parserBatch *batch = new parserBatch;
+      batch->packets.reserve(PARSER_BATCH_PACKETS);
+      batch->err = 0;
+      q->empty.push_back(batch);
+   }
+   q->stop = false;
+}
+
+static void queueDeinit(parserQueue *q)
+{
+   for(size_t i=0; i<q->full.size(); i++)
+   {
+      delete q->full[i];
+   }
+   for(size_t i=0; i<q->empty.size(); i++)
+   {
+      delete q->empty[i];
+   }
+   q->full.clear();
+   q->empty.clear();
+   pthread_cond_destroy(&q->cond);
+   pthread_mutex_destroy(&q->lock);
+}
+
+/**
+ * Takes a batch out of the given list, waiting for it if needed.
+ *
+ * @return the batch or NULL if the queue is stopped
+ */
+static parserBatch *queueTake(parserQueue *q, std::deque<parserBatch*> &list, parserStage *stage)
+{
+   pthread_mutex_lock(&q->lock);
+   if(list.empty() && !q->stop)
+   {
+      double start = parserNow();
+      while(list.empty() && !q->stop)
+      {
+         pthread_cond_wait(&q->cond, &q->lock);
+      }
+      stage->wait += parserNow() - start;
+   }
+   parserBatch *batch = NULL;
+   if(!list.empty())
+   {
+      batch = list.front();
+      list.pop_front();
+   }
+   pthread_mutex_unlock(&q->lock);
+   return batch;
+}
+
+static void queuePut(parserQueue *q, std::deque<parserBatch*> &list, parserBatch *batch)
+{
+   pthread_mutex_lock(&q->lock);
+   list.push_back(batch);
+   pthread_cond_broadcast(&q->cond);
+   pthread_mutex_unlock(&q->lock);
+}
+
+/**
+ * The consumer gives up: the producer waiting for an empty batch is released.
+ */
+static void queueStop(parserQueue *q)
+{
+   pthread_mutex_lock(&q->lock);
+   q->stop = true;
+   pthread_cond_broadcast(&q->cond);
+   pthread_mutex_unlock(&q->lock);
+}
+
+/**
+ * Decoder thread: reads the log packets into the batches until the end of file or an error.
+ */
+static void *inputThread(void *arg)
+{
+   parserInput *in = (parserInput *)arg;
+   for(;;)
+   {
+      parserBatch *batch = queueTake(&in->queue, in->queue.empty, &in->stage);
+      if(NULL == batch)
+      {
+         break;
+      }
+      batch->packets.clear();
+      batch->data.clear();
+      batch->err = 0;
+      while(batch->packets.size() < PARSER_BATCH_PACKETS)
+      {
+         parserPacket pkt;
+         char *data;
+         int err = in->read(in->reader, &pkt.ts, &data, &pkt.size);
+         if(0 != err)
+         {
+            batch->err = err;
+            break;
+         }
+         pkt.type = in->type;
+         pkt.offset = batch->data.size();
+         batch->data.insert(batch->data.end(), data, data + pkt.size);
+         batch->packets.push_back(pkt);
+         in->stage.packets++;
+         in->stage.bytes += pkt.size;
+      }
+      bool end = (0 != batch->err);
+      queuePut(&in->queue, in->queue.full, batch);
+      if(end)
+      {
+         break;
+      }
+   }
+   in->stage.cpu = parserThreadCpu();
+   return NULL;
+}
+
+/**
+ * Writer thread: appends the merged packets to the log until the end of the stream
+ * or a write error.
+ */
+static void *outputThread(void *arg)
+{
+   parserOutput *out = (parserOutput *)arg;
+   for(;;)
+   {
+      parserBatch *batch = queueTake(&out->queue, out->queue.full, &out->stage);
+      if(NULL == batch)
+      {
+         break;
+      }
+      for(size_t i=0; (0 == out->err) && (i<batch->packets.size()); i++)
+      {
+         const parserPacket &pkt = batch->packets[i];
+         out->err = out->file->write(pkt.type, pkt.ts, &batch->data[pkt.offset], pkt.size);
+         out->stage.packets++;
+         out->stage.bytes += pkt.size;
+      }
+      bool end = (0 != batch->err);
+      queuePut(&out->queue, out->queue.empty, batch);
+      if(0 != out->err)
+      {
+         //the merge stage stops once it can't get an empty batch
+         queueStop(&out->queue);
+         break;
+      }
+      if(end)
+      {
+         break;
+      }
+   }
+   out->stage.cpu = parserThreadCpu();
+   return NULL;
+}
+
+/**
+ * Merge stage: returns the next packet of the input without taking it.
+ *
+ * @return POSIX error code or 0 on success, ENODATA if the input is over
+ */
+static int inputPeek(parserInput *in, parserStage *merge, parserPacket **pkt)
+{
+   while((NULL == in->batch) || (in->pos >= in->batch->packets.size()))
+   {
+      if(NULL != in->batch)
+      {
+         if(0 != in->batch->err)
+         {
+            return in->batch->err;
+         }
+         queuePut(&in->queue, in->queue.empty, in->batch);
+      }
+      in->batch = queueTake(&in->queue, in->queue.full, merge);
+      in->pos = 0;
+   }
+   *pkt = &in->batch->packets[in->pos];
+   return 0;
+}
+
+static int pcapRead(void *reader, struct timeval *ts, char **data, int *size)
+{
+   return pcapReadNextPkt((pcapReader *)reader, ts, data, size);
+}
+
+static int canRead(void *reader, struct timeval *ts, char **data, int *size)
+{
+   return canReadNextPkt((canReader *)reader, ts, data, size);
+}
+
+static void inputInit(parserInput *in, const char *name, const char *readName, packetType type
+                      , int (*read)(void *, struct timeval *, char **, int *), void *reader)
+{
+   in->read = read;
+   in->reader = reader;
+   in->type = type;
+   in->readName = readName;
+   queueInit(&in->queue);
+   memset(&in->stage, 0, sizeof(in->stage));
+   in->stage.name = name;
+   in->batch = NULL;
+   in->pos = 0;
+}
+
+static void stageReport(const parserStage *stage)
+{
+   printf("  %-12s %10llu packets %10.1f MB  cpu %7.3f s(%7.1f MB/s)  blocked %7.3f s\n", stage->name
+          , (unsigned long long)stage->packets, stage->bytes / 1e6, stage->cpu
+          , (stage->cpu > 0) ? stage->bytes / 1e6 / stage->cpu : 0, stage->wait);
+}
+
+
+static void usage(const char *name)
+{
+   printf("Usage: %s [-v version] [-z level] [-j threads] [-t pt] [-p port] [-s ssrc] [-f filter] dump.pcap dump.can out.bin\n", name);
+   printf("  -v ELOG version of the output log: 1 or 2(compact records, default: 1)\n");
+   printf("  -z block compress the log with the zlib level 1..9(default: 0 - not compressed)\n");
+   printf("  -j parse the CAN log on this amount of threads, 0 - one per CPU(default: 1)\n");
+   printf("  -t RTP payload type of the selected streams, -1 - any(default: %d)\n", PCAP_RTP_PAYLOAD_TYPE);
+   printf("  -p UDP source or destination port of the selected streams(default: any)\n");
+   printf("  -s RTP SSRC(hex) of the selected stream(default: any)\n");
+   printf("  -f BPF filter expression applied by libpcap(default: built from the selection)\n");
+   printf("Like: %s -v 2 -p 5004 -f 'udp and host 10.0.0.5' 23022016.pcap 23022016.can 23022016.bin\n", name);
+}
 
 int main(int argc, char **argv)
 {
-   if(argc != 4)
+   uint32_t version = 1;
+   int level = 0;
+   int threads = 1;
+   pcapRtpSelect select = {PCAP_RTP_PAYLOAD_TYPE, 0, -1};
+   const char *filter = NULL;
+
+   int opt;
+   while ((opt = getopt(argc, argv, "v:z:j:t:p:s:f:")) != -1)
    {
-      printf("Usage: %s dump.pcap dump.can out.bin\n", argv[0]);
+      switch (opt)
+      {
+         case 'v':
+            version = atoi(optarg);
+            break;
+         case 'z':
+            level = atoi(optarg);
+            break;
+         case 'j':
+            threads = atoi(optarg);
+            if(threads <= 0)
+            {
+               threads = sysconf(_SC_NPROCESSORS_ONLN);
+            }
+            break;
+         case 't':
+            select.payloadType = atoi(optarg);
+            break;
+         case 'p':
+            select.port = atoi(optarg);
+            break;
+         case 's':
+            select.ssrc = strtoul(optarg, NULL, 16);
+            break;
+         case 'f':
+            filter = optarg;
+            break;
+         default:
+            usage(argv[0]);
+            return EXIT_FAILURE;
+      }
+   }
+   if(argc - optind != 3)
+   {
+      usage(argv[0]);
       return EXIT_FAILURE;
    }
-   const char *pcapFile = argv[1];
-   const char *canFile = argv[2];
-   const char *outFile = argv[3];
+   const char *pcapFile = argv[optind];
+   const char *canFile = argv[optind + 1];
+   const char *outFile = argv[optind + 2];
 
    printf("Convert %s/%s -> %s\n",pcapFile, canFile, outFile);
 
    pcapReader pcapFp;
-   int err = pcapReaderInit(&pcapFp, pcapFile);
+   int err = pcapReaderInit(&pcapFp, pcapFile, &select, filter);
    if (0 != err)
    {
       fprintf(stderr, "pcapReaderInit(%s) failed(%s)\n", pcapFile, strerror(err));
@@ -306,7 +616,7 @@ int main(int argc, char **argv)
    }
 
    canReader canFp;
-   err = canReaderInit(&canFp, canFile);
+   err = canReaderInit(&canFp, canFile, threads);
    if (0 != err)
    {
       fprintf(stderr, "canReaderInit(%s) failed(%s)\n", canFile, strerror(err));
@@ -314,106 +624,179 @@ int main(int argc, char **argv)
       return EXIT_FAILURE;
    }
 
-   FILE *file;
-   file = fopen(outFile, "w+b");
-   if (file == NULL)
+   //the summary and the sparse time index of the written packets are stored in the log
+   //(a compressed log has the chunk directory instead of the index)
+   EventLogWriter file;
+   err = file.open(outFile, version, level);
+   if (0 != err)
    {
-      fprintf(stderr, "Unable to open the file %s(%s)\n", outFile, strerror(errno));
       pcapReaderClose(&pcapFp);
       canReaderClose(&canFp);
       return EXIT_FAILURE;
    }
-   eventLogHeader outHeader = { {'E','L','O','G'}, 1};
-   fwrite(&outHeader, sizeof(eventLogHeader), 1, file);
 
    /*
-    * The cycle below reads a PCAP and a CAN message, then compare timestamps and writes out a
-    * packet with earlier ts. After that a next message of written type is read again.
+    * The conversion is pipelined: a decoder thread per input log reads its packets, the cycle
+    * below merges them by comparing timestamps of the next PCAP and CAN packets and writes out
+    * the packet with earlier ts, the writer thread encodes the merged packets into the log.
+    * The stages are connected by bounded queues of packet batches.
     * */
-   struct timeval pcapts = {LONG_MAX, LONG_MAX};
-   char *pcapdata = NULL;
-   int pcapsize;
-
-   struct timeval cants = {LONG_MAX, LONG_MAX};
-   char *candata = NULL;
-   int cansize;
+   parserInput inputs[2];
+   parserInput *pcapIn = &inputs[0];
+   parserInput *canIn = &inputs[1];
+   inputInit(pcapIn, "pcap decode", "pcapReadNextPkt", PACKET_TYPE_RTP, pcapRead, &pcapFp);
+   inputInit(canIn, "can decode", "canReadNextPkt", PACKET_TYPE_CAN, canRead, &canFp);
+   parserOutput output;
+   output.file = &file;
+   output.err = 0;
+   queueInit(&output.queue);
+   memset(&output.stage, 0, sizeof(output.stage));
+   output.stage.name = "write";
+   parserStage merge;
+   memset(&merge, 0, sizeof(merge));
+   merge.name = "merge";
+
+   double start = parserNow();
+   double mergeCpu = parserThreadCpu();
+   int started = 0;
+   for(; started<2; started++)
+   {
+      err = pthread_create(&inputs[started].thread, NULL, inputThread, &inputs[started]);
+      if(0 != err)
+      {
+         break;
+      }
+   }
+   bool writing = (2 == started) && (0 == (err = pthread_create(&output.thread, NULL, outputThread, &output)));
+   if(!writing)
+   {
+      fprintf(stderr, "pthread_create() failed(%s)\n", strerror(err));
+   }
 
    int canMsgCount = 0;
    int rtpMsgCount = 0;
-   for(;;)
+   parserBatch *outBatch = NULL;
+   while(writing)
    {
-      eventLogPacket logPacket;
-      if(NULL == pcapdata)
+      parserPacket *pcapPkt = NULL;
+      parserPacket *canPkt = NULL;
+      err = inputPeek(pcapIn, &merge, &pcapPkt);
+      if((0 != err) && (ENODATA != err))
       {
-         err = pcapReadNextPkt(&pcapFp, &pcapts, &pcapdata, &pcapsize);
-         if (0 != err)
-         {
-            //to mark that the end of file is reached set the ts to MAX value
-            if(ENODATA == err)
-            {
-               pcapts.tv_sec = pcapts.tv_usec = LONG_MAX;
-               pcapdata = NULL;
-            }
-            else
-            {
-               fprintf(stderr, "pcapReadNextPkt failed(%s)\n", strerror(err));
-               break;
-            }
-         }
+         fprintf(stderr, "%s failed(%s)\n", pcapIn->readName, strerror(err));
+         break;
       }
-
-      if(NULL == candata)
+      err = inputPeek(canIn, &merge, &canPkt);
+      if((0 != err) && (ENODATA != err))
       {
-         err = canReadNextPkt(&canFp, &cants, &candata, &cansize);
-         if (0 != err)
-         {
-            //to mark that the end of file is reached set the ts to MAX value
-            if(ENODATA == err)
-            {
-               cants.tv_sec = cants.tv_usec = LONG_MAX;
-               candata = NULL;
-            }
-            else
-            {
-               fprintf(stderr, "canReadNextPkt failed(%s)\n", strerror(err));
-               break;
-            }
-         }
+         fprintf(stderr, "%s failed(%s)\n", canIn->readName, strerror(err));
+         break;
       }
-      if(timercmp(&pcapts, &cants, <) && pcapdata)
+
+      parserInput *in;
+      parserPacket *pkt;
+      //the input at its end has the MAX ts, so the other one is taken
+      if(pcapPkt && (!canPkt || timercmp(&pcapPkt->ts, &canPkt->ts, <)))
       {
-         logPacket.type = PACKET_TYPE_RTP;
-         logPacket.sec = pcapts.tv_sec;
-         logPacket.usec = pcapts.tv_usec;
-         logPacket.len = pcapsize;
-
-         fwrite(&logPacket, sizeof(logPacket), 1, file);
-         fwrite(pcapdata, pcapsize, 1, file);
-         pcapdata = NULL;
+         in = pcapIn;
+         pkt = pcapPkt;
          rtpMsgCount++;
       }
-      else if(candata)
+      else if(canPkt)
       {
-         logPacket.type = PACKET_TYPE_CAN;
-         logPacket.sec = cants.tv_sec;
-         logPacket.usec = cants.tv_usec;
-         logPacket.len = cansize;
-
-         fwrite(&logPacket, sizeof(logPacket), 1, file);
-         fwrite(candata, cansize, 1, file);
-         candata = NULL;
+         in = canIn;
+         pkt = canPkt;
          canMsgCount++;
       }
-
-      if((LONG_MAX == cants.tv_sec)&&(LONG_MAX == pcapts.tv_sec))
+      else
       {
-         printf("Processed %i CAN and %i RTP packets.\n", canMsgCount, rtpMsgCount);
+         printf("Processed %i CAN and %i RTP packets, %llu PCAP frames passed the filter.\n"
+                , canMsgCount, rtpMsgCount, (unsigned long long)pcapFp.frames);
          break;
       }
+
+      if(NULL == outBatch)
+      {
+         outBatch = queueTake(&output.queue, output.queue.empty, &merge);
+         if(NULL == outBatch)
+         {
+            //the writer failed
+            break;
+         }
+         outBatch->packets.clear();
+         outBatch->data.clear();
+         outBatch->err = 0;
+      }
+      parserPacket copy = *pkt;
+      copy.offset = outBatch->data.size();
+      const char *data = &in->batch->data[pkt->offset];
+      outBatch->data.insert(outBatch->data.end(), data, data + pkt->size);
+      outBatch->packets.push_back(copy);
+      in->pos++;
+      merge.packets++;
+      merge.bytes += pkt->size;
+      if(outBatch->packets.size() >= PARSER_BATCH_PACKETS)
+      {
+         queuePut(&output.queue, output.queue.full, outBatch);
+         outBatch = NULL;
+      }
    }
 
+   //the decoders are released if the merge stopped before their end
+   for(int i=0; i<started; i++)
+   {
+      queueStop(&inputs[i].queue);
+      pthread_join(inputs[i].thread, NULL);
+   }
+   if(writing)
+   {
+      if(NULL == outBatch)
+      {
+         outBatch = queueTake(&output.queue, output.queue.empty, &merge);
+      }
+      if(NULL != outBatch)
+      {
+         //the packets merged before a read error are written like they were before the pipeline
+         outBatch->err = ENODATA;
+         queuePut(&output.queue, output.queue.full, outBatch);
+      }
+      pthread_join(output.thread, NULL);
+   }
+   merge.cpu = parserThreadCpu() - mergeCpu;
+   double elapsed = parserNow() - start;
+   int writeErr = writing ? output.err : err;
+
+   printf("Pipeline stages(%.3f s):\n", elapsed);
+   stageReport(&pcapIn->stage);
+   stageReport(&canIn->stage);
+   stageReport(&merge);
+   stageReport(&output.stage);
+   for(int i=0; i<2; i++)
+   {
+      if(NULL != inputs[i].batch)
+      {
+         queuePut(&inputs[i].queue, inputs[i].queue.empty, inputs[i].batch);
+      }
+      queueDeinit(&inputs[i].queue);
+   }
+   queueDeinit(&output.queue);
+
    canReaderClose(&canFp);
    pcapReaderClose(&pcapFp);
-   fclose(file);
+
+   if((0 != file.close()) || (0 != writeErr))
+   {
+      return EXIT_FAILURE;
+   }
+   if(0 != level)
+   {
+      printf("Log %s(ELOG v%u, compressed): %llu bytes, %i chunks\n"
+             , outFile, version, (unsigned long long)file.size(), file.chunks());
+   }
+   else
+   {
+      printf("Log %s(ELOG v%u): %llu bytes, index: %i checkpoints\n"
+             , outFile, version, (unsigned long long)file.size(), file.checkpoints());
+   }
    return EXIT_SUCCESS;
 }
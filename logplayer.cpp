@@ -21,14 +21,27 @@
 
 void usage(const char *name)
 {
-   printf("Usage: %s [-v] [-r] [-d can_device_path] [-t can_frame_type] "
-           "[-p bind_port] [-i bind_addr] rtplog_file.bin canlog_file.log\n"
+   printf("Usage: %s [-v] [-r] [-m cache_size] [-o start_offset] [-d can_device_path] [-t can_frame_type] "
+           "[-p bind_port] [-i bind_addr] [-w wait_mode] [-s speed] [-a] [-b batch_window] [-x txtime_lead] "
+           "[-P rt_priority] [-c cpu_list] [-I] rtplog_file.bin canlog_file.log\n"
+           "  rtplog_file may also be a pcap/pcapng capture, the RTP packets are filtered out of it while playing\n"
            "  -v increase logging verbosity level\n"
            "  -r rewind log file once end of file is reached\n"
+           "  -m loop logs up to the given size(MB) from memory without file I/O(default: 0 - disabled)\n"
+           "  -o start the playback the given time(sec) after the log start(default: 0)\n"
            "  -d can device name to send a CAN message(default: can0)\n"
            "  -t std/ext - Standart/Extended CAN Frame (default: std)\n"
            "  -p port to listen for RTPS connection (default: 554)\n"
            "  -i ip address to bind (default: INADDR_ANY)\n"
+           "  -w sleep/hybrid - wait for an event with sleep only or sleep then busy-poll(default: sleep)\n"
+           "  -s playback speed factor in range 0.1..100(default: 1.0)\n"
+           "  -a play events as fast as possible ignoring their timestamps\n"
+           "  -b send RTP packets due within the window(usec) with a single syscall(default: 0 - disabled)\n"
+           "  -x hand RTP packets to the kernel the given time(usec) ahead of their deadline with SO_TXTIME,\n"
+           "     requires etf or fq qdisc on the egress interface(default: 0 - disabled)\n"
+           "  -P run the bus threads with SCHED_FIFO priority 1..99 and lock the process memory(default: 0 - disabled)\n"
+           "  -c pin the bus threads to the comma separated list of cores like 2,3(default: no pinning)\n"
+           "  -I keep the RTSP server and log reader threads off the cores given with -c\n"
            , name);
 
    printf("Like: %s -r -i 127.0.01 -p 8554 camera.bin CAN.log\n", name);
@@ -50,6 +63,13 @@ int getRequestSequenceNumber(const char *data);
  */
 int getRequestClientPort(const char *data, uint32_t *port1, uint32_t *port2);
 
+/**
+ * Parses the input RTSP PLAY request and extracts the start of the Range: npt= value.
+ *
+ * @return 0 on success(start is filled with the time in seconds) or -1 if there is no explicit start time.
+ */
+int getRequestRangeStart(const char *data, double *start);
+
 struct playerCfg
 {
    const char *bindAddr;
@@ -60,6 +80,13 @@ struct playerCfg
    canFrameType canType;
    int verbosity;
    int rewindLog;
+   int cacheSize;
+   int startOffset;
+   playbackWaitMode waitMode;
+   double speed;
+   int batchWindow;
+   int txtimeLead;
+   rtProfile rt;
 };
 
 struct rtcpSession
@@ -71,10 +98,15 @@ struct rtcpSession
    uint32_t port2;
 
    dumpPlayer player;
+   bool playing;   //the player is started
+   bool paused;
 };
 
 static rtcpSession session;
 static playerCfg   configOptions;
+//summary of the RTP log(if it has one), DESCRIBE is answered without reading the log
+static eventLogInfo logInfo;
+static bool logInfoValid = false;
 
 int optionCmdHandler (const char *data, const int size, int fd)
 {
@@ -147,20 +179,39 @@ int describeCmdHandler (const char *data, const int size, int fd)
          "b=AS:9216\r\n"
          "t=0 0\r\n"
          "a=control:*\r\n"
-         "a=range:npt=now-\r\n"
-         "m=video 0 RTP/AVP 98\r\n"
+         "a=range:npt=%s\r\n"
+         "m=video 0 RTP/AVP %u\r\n"
          "b=AS:9216\r\n"
          "a=framerate:30.0\r\n"
          "a=control:trackID=1\r\n"
-         "a=rtpmap:98 H264/90000\r\n"
-         "a=fmtp:98 packetization-mode=1; profile-level-id=640028; sprop-parameter-sets=Z2QAKK3FTYY4jFRWKmwxxGKisVNhjiMVFRBIjEc2SSIJEYjmySRBIjEc2SQtAKAPP+A1SAAAXdgACvyHsQPoAAYahf//HYgfQAAw1C//+FA=,aM44MA==\r\n"
+         "a=rtpmap:%u H264/90000\r\n"
+         "a=fmtp:%u packetization-mode=1; profile-level-id=640028; sprop-parameter-sets=Z2QAKK3FTYY4jFRWKmwxxGKisVNhjiMVFRBIjEc2SSIJEYjmySRBIjEc2SQtAKAPP+A1SAAAXdgACvyHsQPoAAYahf//HYgfQAAw1C//+FA=,aM44MA==\r\n"
          "a=h264-esid:201\r\n"
          "\r\n"
          ;
-   char sdpMsg[256];
-   snprintf(sdpMsg, sizeof(sdpMsg), SDPMsg, configOptions.bindAddr);
 
-   char response[1024];
+   //the payload type of the logged stream and the log duration are taken from the log summary
+   unsigned payloadType = 98;
+   char range[32] = "now-";
+   if(logInfoValid)
+   {
+      for(uint32_t i=0; i<logInfo.streamCount; i++)
+      {
+         if(PACKET_TYPE_RTP == logInfo.streams[i].type)
+         {
+            payloadType = logInfo.streams[i].payloadType;
+            break;
+         }
+      }
+      double duration = ((int64_t)logInfo.lastSec - (int64_t)logInfo.firstSec)
+                      + ((int64_t)logInfo.lastUsec - (int64_t)logInfo.firstUsec) / 1e6;
+      snprintf(range, sizeof(range), "0-%.3f", duration);
+   }
+
+   char sdpMsg[1024];
+   snprintf(sdpMsg, sizeof(sdpMsg), SDPMsg, configOptions.bindAddr, range, payloadType, payloadType, payloadType);
+
+   char response[2048];
    int resSize = snprintf(response, sizeof(response),
          "RTSP/1.0 200 OK\r\n"
          "CSeq: %i\r\n"
@@ -185,12 +236,17 @@ int describeCmdHandler (const char *data, const int size, int fd)
    return 0;
 }
 
-int playCmdHandler (const char *data, const int size, int fd)
+/**
+ * Sends the PLAY response with the position the playback starts from.
+ *
+ * @return POSIX error code or 0 on success
+ */
+static int playResponse(int fd, int sequenceNumber, const dumpPlayerPosition *pos)
 {
-   int sequenceNumber = getRequestSequenceNumber(data);
-   if(sequenceNumber < 0)
+   char rtpInfo[128] = "";
+   if(pos->rtpValid)
    {
-      return EIO;
+      snprintf(rtpInfo, sizeof(rtpInfo), ";seq=%u;rtptime=%u", pos->seq, pos->rtpTime);
    }
 
    char response[512];
@@ -198,10 +254,13 @@ int playCmdHandler (const char *data, const int size, int fd)
          "RTSP/1.0 200 OK\r\n"
          "CSeq: %i\r\n"
          "Session: %u\r\n"
-         "RTP-Info: url=trackID=1;seq=57746;rtptime=1212438488\r\n"
+         "Range: npt=%.3f-\r\n"
+         "RTP-Info: url=trackID=1%s\r\n"
          "\r\n"
          ,sequenceNumber
          ,session.sessionID
+         ,pos->npt
+         ,rtpInfo
       );
 
    resSize = write(fd, response, strlen(response));
@@ -210,9 +269,41 @@ int playCmdHandler (const char *data, const int size, int fd)
       fprintf(stderr, "write() failed(%s)\n", strerror(errno));
       return errno;
    }
+   return 0;
+}
+
+int playCmdHandler (const char *data, const int size, int fd)
+{
+   int sequenceNumber = getRequestSequenceNumber(data);
+   if(sequenceNumber < 0)
+   {
+      return EIO;
+   }
+
+   double nptStart;
+   bool rangeRequested = (0 == getRequestRangeStart(data, &nptStart));
+
+   dumpPlayerPosition pos;
+   if(session.playing)
+   {
+      if(!rangeRequested)
+      {
+         //resume the paused playback(or keep playing) without reopening the logs
+         dumpPlayerResume(&session.player, &pos);
+         session.paused = false;
+         return playResponse(fd, sequenceNumber, &pos);
+      }
+      //a new position is requested, the playback is restarted from there
+      dumpPlayerStop(&session.player);
+      dumpPlayerDeinit(&session.player);
+      session.playing = false;
+      session.paused = false;
+   }
 
    dumpPlayerCfg playerCfg = {configOptions.RTPlogFile, configOptions.CANlogFile, session.clientIp, (int)session.port1, session.ssrc
-         , configOptions.canDeviceName, configOptions.canType, configOptions.rewindLog
+         , configOptions.canDeviceName, configOptions.canType, configOptions.rewindLog, configOptions.cacheSize, configOptions.waitMode
+         , configOptions.speed, configOptions.batchWindow, configOptions.txtimeLead
+         , &configOptions.rt
    };
 
    int err = dumpPlayerInit(&session.player, &playerCfg);
@@ -221,7 +312,31 @@ int playCmdHandler (const char *data, const int size, int fd)
       fprintf(stderr, "dumpPlayerInit() failed(%s)\n", strerror(err));
       return err;
    }
+
+   //the requested range start overrides the -o option
+   int64_t offset = (int64_t)configOptions.startOffset * 1000;
+   if(rangeRequested)
+   {
+      offset = (int64_t)(nptStart * 1e6);
+   }
+
+   err = dumpPlayerSeek(&session.player, offset, &pos);
+   if(0 != err)
+   {
+      fprintf(stderr, "dumpPlayerSeek() failed(%s)\n", strerror(err));
+      dumpPlayerDeinit(&session.player);
+      return err;
+   }
+
+   err = playResponse(fd, sequenceNumber, &pos);
+   if(0 != err)
+   {
+      dumpPlayerDeinit(&session.player);
+      return err;
+   }
+
    err = dumpPlayerStart(&session.player);
+   session.playing = (0 == err);
 
    return err;
 }
@@ -250,6 +365,12 @@ int pauseCmdHandler (const char *data, const int size, int fd)
       fprintf(stderr, "write() failed(%s)\n", strerror(errno));
       return errno;
    }
+
+   if(session.playing)
+   {
+      dumpPlayerPause(&session.player);
+      session.paused = true;
+   }
    return 0;
 }
 
@@ -337,6 +458,13 @@ int main(int argc, char **argv)
    configOptions.canType = CAN_FRAME_STD_TYPE;
    configOptions.verbosity = 0;
    configOptions.rewindLog = 0;
+   configOptions.cacheSize = 0;
+   configOptions.startOffset = 0;
+   configOptions.waitMode = PLAYBACK_WAIT_SLEEP;
+   configOptions.speed = 1.0;
+   configOptions.batchWindow = 0;
+   configOptions.txtimeLead = 0;
+   memset(&configOptions.rt, 0, sizeof(configOptions.rt));
 
    configOptions.RTPlogFile = NULL;
    configOptions.CANlogFile = NULL;
@@ -351,7 +479,7 @@ int main(int argc, char **argv)
    }
 
    int opt;
-   while ((opt = getopt(argc, argv, "vrd:b:t:p:i:f")) != -1)
+   while ((opt = getopt(argc, argv, "vrm:o:d:b:t:p:i:fw:s:ax:P:c:I")) != -1)
    {
        switch (opt)
        {
@@ -364,6 +492,12 @@ int main(int argc, char **argv)
           case 'r':
              configOptions.rewindLog = 1;
           break;
+          case 'm':
+             configOptions.cacheSize = atoi(optarg);
+          break;
+          case 'o':
+             configOptions.startOffset = (int)(atof(optarg) * 1000);
+          break;
           case 'd':
              configOptions.canDeviceName = optarg;
           break;
@@ -379,6 +513,52 @@ int main(int argc, char **argv)
           case 'i':
              configOptions.bindAddr = optarg;
           break;
+          case 'w':
+             if(0 == strcmp(optarg, "hybrid"))
+             {
+                configOptions.waitMode = PLAYBACK_WAIT_HYBRID;
+             }
+             else if(0 == strcmp(optarg, "sleep"))
+             {
+                configOptions.waitMode = PLAYBACK_WAIT_SLEEP;
+             }
+             else
+             {
+                usage(argv[0]);
+             }
+          break;
+          case 's':
+             configOptions.speed = atof(optarg);
+             if((configOptions.speed < 0.1) || (configOptions.speed > 100.0))
+             {
+                usage(argv[0]);
+             }
+          break;
+          case 'a':
+             configOptions.waitMode = PLAYBACK_WAIT_NONE;
+          break;
+          case 'b':
+             configOptions.batchWindow = atoi(optarg);
+          break;
+          case 'x':
+             configOptions.txtimeLead = atoi(optarg);
+          break;
+          case 'P':
+             configOptions.rt.priority = atoi(optarg);
+             if((configOptions.rt.priority < 1) || (configOptions.rt.priority > 99))
+             {
+                usage(argv[0]);
+             }
+          break;
+          case 'c':
+             if(0 != rtProfileParseCpus(&configOptions.rt, optarg))
+             {
+                usage(argv[0]);
+             }
+          break;
+          case 'I':
+             configOptions.rt.isolate = true;
+          break;
 
           default:
              usage(argv[0]);
@@ -394,11 +574,31 @@ int main(int argc, char **argv)
    configOptions.RTPlogFile = argv[optind];
    configOptions.CANlogFile = argv[optind+1];
 
+   //a raw capture has no summary, it is played with the defaults
+   if(!PcapLogFile::probe(configOptions.RTPlogFile))
+   {
+      MixedLogFile rtpLog(false);
+      if((0 == rtpLog.open(configOptions.RTPlogFile)) && (NULL != rtpLog.info()))
+      {
+         logInfo = *rtpLog.info();
+         logInfoValid = true;
+      }
+      rtpLog.close();
+   }
+
+   //has to be done before any thread is created, they inherit the main thread affinity
+   if(0 != rtProfileProcessInit(&configOptions.rt))
+   {
+      fprintf(stderr, "Real-time profile is applied partially\n");
+   }
+
    //it is debug feature for player performance testing with logdump/logcmp utilities
    if(forcePlayback)
    {
       dumpPlayerCfg playerCfg = {configOptions.RTPlogFile, configOptions.CANlogFile, configOptions.bindAddr, configOptions.bindPort, 11223344
-            , configOptions.canDeviceName, configOptions.canType, configOptions.rewindLog
+            , configOptions.canDeviceName, configOptions.canType, configOptions.rewindLog, configOptions.cacheSize, configOptions.waitMode
+            , configOptions.speed, configOptions.batchWindow, configOptions.txtimeLead
+         , &configOptions.rt
       };
 
       printf("Stream file %s to %s:%i\n", configOptions.RTPlogFile, configOptions.bindAddr,  configOptions.bindPort);
@@ -408,6 +608,13 @@ int main(int argc, char **argv)
          fprintf(stderr, "dumpPlayerInit() failed(%s)\n", strerror(err));
          return err;
       }
+      dumpPlayerPosition pos;
+      err = dumpPlayerSeek(&session.player, (int64_t)configOptions.startOffset * 1000, &pos);
+      if(0 != err)
+      {
+         fprintf(stderr, "dumpPlayerSeek() failed(%s)\n", strerror(err));
+         return err;
+      }
       err = dumpPlayerStart(&session.player);
       pause();
    }
@@ -493,6 +700,8 @@ int main(int argc, char **argv)
 
       dumpPlayerStop(&session.player);
       dumpPlayerDeinit(&session.player);
+      session.playing = false;
+      session.paused = false;
       close(childfd);
    }
 }
@@ -539,6 +748,57 @@ int getRequestClientPort(const char *data, uint32_t *port1, uint32_t *port2)
 }
 
 
+/**
+ * Parses the input RTSP PLAY request and extracts the start of the Range: npt= value.
+ * Both npt-sec(like 90.5) and npt-hhmmss(like 0:01:30.5) forms are accepted.
+ *
+ * @return 0 on success(start is filled with the time in seconds) or -1 if there is no explicit start time.
+ */
+int getRequestRangeStart(const char *data, double *start)
+{
+   char *tmpData = strdup(data);
+   if(NULL == tmpData)
+   {
+      return -1;
+   }
+
+   char* p;
+
+   const char* rangePrefix = "npt=";
+   const char* delims = "\r\n";
+   p = strtok(tmpData, delims);
+
+   int res = -1;
+   while( p != NULL )
+   {
+      if(0 == strncasecmp(p, "Range:", 6))
+      {
+         char* range = strstr(p, rangePrefix);
+         if(NULL != range)
+         {
+            range = range + strlen(rangePrefix);
+            unsigned int hours, minutes;
+            double seconds;
+            if(3 == sscanf(range, "%u:%u:%lf", &hours, &minutes, &seconds))
+            {
+               *start = hours * 3600.0 + minutes * 60.0 + seconds;
+               res = 0;
+            }
+            else if((1 == sscanf(range, "%lf", &seconds)) && (seconds >= 0))
+            {
+               *start = seconds;
+               res = 0;
+            }
+         }
+         break;
+      }
+      p = strtok( NULL, delims );
+   }
+
+   free(tmpData);
+   return res;
+}
+
 /**
  * Parses the input RTSP request and extracts the command sequence number (CSeq:) value.
  *
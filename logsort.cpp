@@ -0,0 +1,470 @@
+/**
+ * Sorts the packets of any number of logs into a single strictly time ordered events
+ * log(@see eventlog.h). The inputs may be events logs of any version, CAN text logs(.log)
+ * and raw pcap/pcapng captures, in any order and overlapping in time, like rotated or
+ * multi-NIC captures and clock corrected logs.
+ * The sort is external, so the inputs may be far larger than the memory: the packets are
+ * collected up to the memory limit, sorted and spilled into a temporary run log, the runs
+ * are merged by MultiLogReader afterwards, more than LOG_SORT_MAX_RUNS runs are merged in
+ * several passes.
+ *   stable - packets of the same time keep the order of the inputs on the command line
+ *            and of their positions in the input
+ *   fast   - packets of the same time may come in any order
+*/
+
+#include <stdio.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "eventlog.h"
+#include "mixedLogFile.h"
+#include "canLogFile.h"
+#include "pcapLogFile.h"
+#include "multiLogReader.h"
+#include "eventLogWriter.h"
+
+//the runs are merged at most that many at once
+#define LOG_SORT_MAX_RUNS (64)
+
+struct sortKey
+{
+   uint64_t ts;     //usec since the epoch
+   size_t offset;   //the packet(eventLogPacket followed by the data, padded to its alignment) in the arena
+};
+
+static bool keyEarlier(const sortKey &a, const sortKey &b)
+{
+   return a.ts < b.ts;
+}
+
+/**
+ * @return size of the packet in the arena: the eventLogPacket and the data padded, so the next packet is aligned
+ */
+static size_t arenaPacketSize(int size)
+{
+   return (sizeof(eventLogPacket) + size + alignof(eventLogPacket) - 1) & ~(alignof(eventLogPacket) - 1);
+}
+
+/**
+ * Packets collected for the run being generated.
+ */
+struct sortContext
+{
+   std::vector<char> arena;
+   std::vector<sortKey> keys;
+   size_t memoryLimit;
+   bool stable;
+   std::string tmpPrefix;
+   std::vector<std::string> runs; //the run logs in the order of the inputs
+   int runNumber;                 //to name the runs
+};
+
+/**
+ * Opens the log: files ending with ".log" are CAN text logs(parsed once, no cache is
+ * written next to them), pcap/pcapng captures are read with PcapLogFile, the rest
+ * are events logs.
+ *
+ * @return the opened log or NULL
+ */
+static ILogFile *sortOpen(const char *name)
+{
+   size_t len = strlen(name);
+   ILogFile *file;
+   if((len > 4) && (0 == strcmp(name + len - 4, ".log")))
+   {
+      file = new CanLogFile(false);
+   }
+   else if(PcapLogFile::probe(name))
+   {
+      file = new PcapLogFile();
+   }
+   else
+   {
+      //runs are read by many at once, the blocks keep the memory bounded
+      file = new MixedLogFile(false);
+   }
+   if(0 != file->open(name))
+   {
+      delete file;
+      return NULL;
+   }
+   return file;
+}
+
+static void sortRemoveRuns(sortContext *ctx)
+{
+   for(size_t i=0; i<ctx->runs.size(); i++)
+   {
+      unlink(ctx->runs[i].c_str());
+   }
+   ctx->runs.clear();
+}
+
+/**
+ * Writes the sorted packets of the arena into the log.
+ *
+ * @return POSIX error code or 0 on success
+ */
+static int sortWriteArena(sortContext *ctx, EventLogWriter &out)
+{
+   if(ctx->stable)
+   {
+      std::stable_sort(ctx->keys.begin(), ctx->keys.end(), keyEarlier);
+   }
+   else
+   {
+      std::sort(ctx->keys.begin(), ctx->keys.end(), keyEarlier);
+   }
+
+   for(size_t i=0; i<ctx->keys.size(); i++)
+   {
+      const eventLogPacket *pkt = (const eventLogPacket *)&ctx->arena[ctx->keys[i].offset];
+      timeval ts;
+      ts.tv_sec = pkt->sec;
+      ts.tv_usec = pkt->usec;
+      int err = out.write((packetType)pkt->type, ts, (const char *)(pkt + 1), pkt->len);
+      if(0 != err)
+      {
+         return err;
+      }
+   }
+   ctx->arena.clear();
+   ctx->keys.clear();
+   return 0;
+}
+
+/**
+ * @return name of a new run log
+ */
+static std::string sortRunName(sortContext *ctx)
+{
+   char suffix[32];
+   snprintf(suffix, sizeof(suffix), ".%d.run", ctx->runNumber++);
+   return ctx->tmpPrefix + suffix;
+}
+
+/**
+ * Sorts the collected packets and spills them into a new run.
+ *
+ * @return POSIX error code or 0 on success
+ */
+static int sortSpill(sortContext *ctx)
+{
+   std::string name = sortRunName(ctx);
+   //the runs are v1 logs, so the packets are kept byte exact whatever the output version is
+   EventLogWriter run;
+   int err = run.open(name.c_str(), 1);
+   if(0 != err)
+   {
+      return err;
+   }
+   ctx->runs.push_back(name);
+   err = sortWriteArena(ctx, run);
+   int closeErr = run.close();
+   return (0 != err) ? err : closeErr;
+}
+
+/**
+ * Collects the packet, the collected packets are spilled once they exceed the memory limit.
+ *
+ * @return POSIX error code or 0 on success
+ */
+static int sortAdd(sortContext *ctx, packetType type, const timeval &ts, const char *data, int size)
+{
+   if(size > 0xFFFF)
+   {
+      return EMSGSIZE;
+   }
+   eventLogPacket pkt = {(uint64_t)ts.tv_sec, (uint64_t)ts.tv_usec, (uint16_t)type, (uint16_t)size};
+   sortKey key = {(uint64_t)ts.tv_sec * 1000000 + ts.tv_usec, ctx->arena.size()};
+   ctx->arena.insert(ctx->arena.end(), (const char *)&pkt, (const char *)(&pkt + 1));
+   ctx->arena.insert(ctx->arena.end(), data, data + size);
+   ctx->arena.resize(key.offset + arenaPacketSize(size));
+   ctx->keys.push_back(key);
+
+   if(ctx->arena.size() + ctx->keys.size() * sizeof(sortKey) >= ctx->memoryLimit)
+   {
+      return sortSpill(ctx);
+   }
+   return 0;
+}
+
+/**
+ * Merges the runs [first, first + count) into the log.
+ *
+ * @return POSIX error code or 0 on success
+ */
+static int sortMerge(sortContext *ctx, size_t first, size_t count, EventLogWriter &out, uint64_t *packets)
+{
+   std::vector<ILogFile*> files;
+   int err = 0;
+   for(size_t i=first; i<first + count; i++)
+   {
+      ILogFile *file = sortOpen(ctx->runs[i].c_str());
+      if(NULL == file)
+      {
+         err = EIO;
+         break;
+      }
+      files.push_back(file);
+   }
+
+   if(0 == err)
+   {
+      //ties are taken from the earlier run first, which keeps the stable order
+      MultiLogReader reader(files);
+      packetType type;
+      timeval ts;
+      const char *data;
+      int size;
+      while((size = reader.readView(type, ts, data)) > 0)
+      {
+         err = out.write(type, ts, data, size);
+         if(0 != err)
+         {
+            break;
+         }
+         (*packets)++;
+      }
+      if(size < 0)
+      {
+         err = errno;
+         fprintf(stderr, "Reading the runs failed(%s)\n", strerror(err));
+      }
+   }
+
+   for(size_t i=0; i<files.size(); i++)
+   {
+      files[i]->close();
+      delete files[i];
+   }
+   return err;
+}
+
+/**
+ * Merges the runs LOG_SORT_MAX_RUNS at once until they can be merged by a single pass,
+ * every merged group takes the place of its runs, so the order of the runs is kept.
+ *
+ * @return POSIX error code or 0 on success
+ */
+static int sortReduceRuns(sortContext *ctx, int *passes)
+{
+   while(ctx->runs.size() > LOG_SORT_MAX_RUNS)
+   {
+      std::vector<std::string> merged;
+      for(size_t first=0; first<ctx->runs.size(); first+=LOG_SORT_MAX_RUNS)
+      {
+         size_t count = std::min((size_t)LOG_SORT_MAX_RUNS, ctx->runs.size() - first);
+         if(1 == count)
+         {
+            merged.push_back(ctx->runs[first]);
+            continue;
+         }
+
+         std::string name = sortRunName(ctx);
+         EventLogWriter run;
+         int err = run.open(name.c_str(), 1);
+         if(0 == err)
+         {
+            uint64_t packets = 0;
+            merged.push_back(name);
+            err = sortMerge(ctx, first, count, run, &packets);
+            int closeErr = run.close();
+            err = (0 != err) ? err : closeErr;
+         }
+         if(0 != err)
+         {
+            //the runs not merged yet and the merged ones are removed together
+            merged.insert(merged.end(), ctx->runs.begin() + first, ctx->runs.end());
+            ctx->runs = merged;
+            return err;
+         }
+         for(size_t i=first; i<first + count; i++)
+         {
+            unlink(ctx->runs[i].c_str());
+         }
+      }
+      ctx->runs = merged;
+      (*passes)++;
+   }
+   return 0;
+}
+
+static void usage(const char *name)
+{
+   printf("Usage: %s [-s stable|fast] [-m memory] [-T tmp_dir] [-v version] [-z level] out.bin in [in...]\n", name);
+   printf("  -s order of the packets of the same time: stable(the input order) or fast(any)(default: stable)\n");
+   printf("  -m memory(MB) to sort the packets in, larger inputs are sorted in runs(default: 256)\n");
+   printf("  -T directory of the temporary run logs(default: the directory of out.bin)\n");
+   printf("  -v ELOG version of the output log: 1 or 2(default: 2)\n");
+   printf("  -z block compress the output log with the zlib level 1..9(default: 0 - not compressed)\n");
+   printf("  in - events logs, CAN text logs(.log) and pcap/pcapng captures\n");
+   printf("Like: %s -m 1024 23022016.bin cam1.pcap cam2.pcapng 23022016.log\n", name);
+}
+
+int main(int argc, char **argv)
+{
+   uint32_t version = 2;
+   int level = 0;
+   bool stable = true;
+   long memory = 256;
+   const char *tmpDir = NULL;
+
+   int opt;
+   while ((opt = getopt(argc, argv, "s:m:T:v:z:")) != -1)
+   {
+      switch (opt)
+      {
+         case 's':
+            if(0 == strcmp(optarg, "stable"))
+            {
+               stable = true;
+            }
+            else if(0 == strcmp(optarg, "fast"))
+            {
+               stable = false;
+            }
+            else
+            {
+               usage(argv[0]);
+               return EXIT_FAILURE;
+            }
+            break;
+         case 'm':
+            memory = atol(optarg);
+            break;
+         case 'T':
+            tmpDir = optarg;
+            break;
+         case 'v':
+            version = atoi(optarg);
+            break;
+         case 'z':
+            level = atoi(optarg);
+            break;
+         default:
+            usage(argv[0]);
+            return EXIT_FAILURE;
+      }
+   }
+   if((argc - optind < 2) || (memory <= 0))
+   {
+      usage(argv[0]);
+      return EXIT_FAILURE;
+   }
+   const char *outFile = argv[optind];
+
+   sortContext ctx;
+   ctx.memoryLimit = (size_t)memory * 1024 * 1024;
+   ctx.stable = stable;
+   ctx.runNumber = 0;
+   //reserved up front, so the vectors are not reallocated while the run grows up to the limit
+   ctx.arena.reserve(ctx.memoryLimit + arenaPacketSize(0xFFFF));
+   ctx.keys.reserve(ctx.memoryLimit / (sizeof(eventLogPacket) + sizeof(sortKey)) + 1);
+   std::string dir = (NULL != tmpDir) ? std::string(tmpDir) : std::string(outFile);
+   if(NULL == tmpDir)
+   {
+      size_t slash = dir.rfind('/');
+      dir = (std::string::npos == slash) ? std::string(".") : dir.substr(0, slash + 1);
+   }
+   char prefix[64];
+   snprintf(prefix, sizeof(prefix), "/logsort.%d", (int)getpid());
+   ctx.tmpPrefix = dir + prefix;
+
+   struct timespec start, end;
+   clock_gettime(CLOCK_MONOTONIC, &start);
+
+   //run generation
+   int err = 0;
+   uint64_t count = 0;
+   for(int i=optind + 1; (0 == err) && (i<argc); i++)
+   {
+      ILogFile *in = sortOpen(argv[i]);
+      if(NULL == in)
+      {
+         err = EIO;
+         break;
+      }
+      packetType type;
+      timeval ts;
+      const char *data;
+      int size;
+      while((size = in->readView(type, ts, data)) > 0)
+      {
+         err = sortAdd(&ctx, type, ts, data, size);
+         if(0 != err)
+         {
+            fprintf(stderr, "Sorting %s failed(%s)\n", argv[i], strerror(err));
+            break;
+         }
+         count++;
+      }
+      if(size < 0)
+      {
+         err = errno;
+         fprintf(stderr, "Reading %s failed(%s)\n", argv[i], strerror(err));
+      }
+      in->close();
+      delete in;
+   }
+
+   //the last packets are a run of their own unless everything fits the memory
+   if((0 == err) && !ctx.runs.empty() && !ctx.keys.empty())
+   {
+      err = sortSpill(&ctx);
+   }
+   int passes = 0;
+   size_t runs = ctx.runs.size();
+   if((0 == err) && !ctx.runs.empty())
+   {
+      err = sortReduceRuns(&ctx, &passes);
+   }
+   if(0 != err)
+   {
+      sortRemoveRuns(&ctx);
+      return EXIT_FAILURE;
+   }
+
+   EventLogWriter out;
+   err = out.open(outFile, version, level);
+   if(0 != err)
+   {
+      sortRemoveRuns(&ctx);
+      return EXIT_FAILURE;
+   }
+   uint64_t written = 0;
+   if(ctx.runs.empty())
+   {
+      err = sortWriteArena(&ctx, out);
+      written = count;
+   }
+   else
+   {
+      err = sortMerge(&ctx, 0, ctx.runs.size(), out, &written);
+      passes++;
+   }
+   sortRemoveRuns(&ctx);
+   int closeErr = out.close();
+   if((0 != err) || (0 != closeErr))
+   {
+      if(0 != err)
+      {
+         fprintf(stderr, "Writing %s failed(%s)\n", outFile, strerror(err));
+      }
+      return EXIT_FAILURE;
+   }
+
+   clock_gettime(CLOCK_MONOTONIC, &end);
+   double seconds = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+   printf("Sorted %llu packets of %i logs(%s) in %.3f sec: %llu runs, %i merge passes, %llu bytes\n"
+          , (unsigned long long)written, argc - optind - 1, stable ? "stable" : "fast", seconds
+          , (unsigned long long)runs, passes, (unsigned long long)out.size());
+   return EXIT_SUCCESS;
+}
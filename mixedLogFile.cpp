@@ -6,28 +6,392 @@
 #include <stdlib.h>
 #include <stdio.h>
 
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+
 #include "eventlog.h"
+#include "eventCodec.h"
 #include "mixedLogFile.h"
 
 
 int MixedLogFile::open(const char* fname)
 {
-   this->fp = fopen(fname, "r");
-   if (this->fp == NULL)
+   this->fd = ::open(fname, O_RDONLY);
+   if (this->fd == -1)
    {
       fprintf(stderr, "Unable to open the file %s(%s)\n", fname, strerror(errno));
       return errno;
    }
 
+   eventLogHeader header;
+   memset(&header, 0, sizeof(header));
+   bool ok = (sizeof(header) == pread(this->fd, &header, sizeof(header), 0)) && (0 == memcmp(header.id, "ELOG", 4));
+   uint32_t version = header.version & EVENT_LOG_VERSION_MASK;
+   if(!ok || ((1 != version) && (2 != version))
+      || (0 != (header.version & ~(EVENT_LOG_VERSION_MASK | EVENT_LOG_COMPRESSED | EVENT_LOG_INFO))))
+   {
+      fprintf(stderr, "%s is not an events log(ELOG v1 or v2)\n", fname);
+      close();
+      return EINVAL;
+   }
+
+   struct stat st;
+   if(0 != fstat(this->fd, &st))
+   {
+      int err = errno;
+      fprintf(stderr, "fstat(%s) failed(%s)\n", fname, strerror(err));
+      close();
+      return err;
+   }
+
+   this->fileName = fname;
+   this->fileSize = st.st_size;
+   this->version = version;
+   this->compressed = (0 != (header.version & EVENT_LOG_COMPRESSED));
+   this->lastNs = 0;
+   this->dataOffset = sizeof(header);
+   this->dataEnd = this->fileSize;
+   this->hasInfo = (0 != (header.version & EVENT_LOG_INFO));
+   this->index.clear();
+   this->indexLoaded = false;
+
+   if(this->hasInfo)
+   {
+      this->dataOffset += sizeof(this->logInfo);
+      if((sizeof(this->logInfo) != pread(this->fd, &this->logInfo, sizeof(this->logInfo), sizeof(header)))
+         || (this->logInfo.dataEnd < (uint64_t)this->dataOffset) || (this->logInfo.dataEnd > this->fileSize)
+         || (this->logInfo.indexOffset > this->fileSize) || (this->logInfo.streamCount > EVENT_LOG_MAX_STREAMS))
+      {
+         fprintf(stderr, "%s has a broken summary\n", fname);
+         close();
+         return EINVAL;
+      }
+      this->dataEnd = this->logInfo.dataEnd;
+   }
+
+   if(this->compressed)
+   {
+      int err = this->chunks.open(this->fd, this->fileSize, this->dataOffset);
+      if(0 != err)
+      {
+         close();
+         return err;
+      }
+      this->blockOffset = 0;
+      return rewind();
+   }
+
+   if(this->mapEnabled)
+   {
+      void *addr = mmap(NULL, this->fileSize, PROT_READ, MAP_SHARED, this->fd, 0);
+      if(MAP_FAILED == addr)
+      {
+         fprintf(stderr, "mmap(%s) failed(%s), the log is read by blocks\n", fname, strerror(errno));
+      }
+      else
+      {
+         //the pages are released behind the read position, so they must not be locked by mlockall()
+         munlock(addr, this->fileSize);
+         madvise(addr, this->fileSize, MADV_SEQUENTIAL);
+         this->map = (char *)addr;
+      }
+   }
+
+   if(NULL != this->map)
+   {
+      this->buf = this->map;
+      this->blockOffset = 0;
+      this->blockLen = this->dataEnd;
+      this->prefetched = 0;
+      this->released = 0;
+   }
+   else
+   {
+      this->block.resize(MIXED_LOG_BLOCK_SIZE);
+      this->buf = &this->block[0];
+   }
+   setPosition(this->dataOffset);
    return 0;
 }
 
+/**
+ * Mapped log: prefetches the pages ahead of the read position and drops the ones
+ * far behind it. Both are done once per MIXED_LOG_MAP_AHEAD of read data.
+ */
+void MixedLogFile::advise()
+{
+   static const uint64_t pageMask = ~(uint64_t)(sysconf(_SC_PAGESIZE) - 1);
+   uint64_t pos = this->blockPos & pageMask;
+
+   if((pos < this->released) || (pos + 2 * MIXED_LOG_MAP_AHEAD < this->prefetched))
+   {
+      //moved backward by rewind() or seek()
+      this->prefetched = pos;
+      if(pos < this->released)
+      {
+         this->released = pos;
+      }
+   }
+
+   if((pos + MIXED_LOG_MAP_AHEAD > this->prefetched) && (this->prefetched < this->fileSize))
+   {
+      uint64_t from = (this->prefetched > pos) ? this->prefetched : pos;
+      uint64_t to = pos + 2 * MIXED_LOG_MAP_AHEAD;
+      if(to > this->fileSize)
+      {
+         to = this->fileSize;
+      }
+      madvise(this->map + from, to - from, MADV_WILLNEED);
+      this->prefetched = to;
+   }
+
+   if(pos > this->released + MIXED_LOG_MAP_BEHIND + MIXED_LOG_MAP_AHEAD)
+   {
+      uint64_t to = pos - MIXED_LOG_MAP_BEHIND;
+      madvise(this->map + this->released, to - this->released, MADV_DONTNEED);
+      this->released = to;
+   }
+}
+
+/**
+ * Moves the read position to the given file offset, the block is kept
+ * if the offset falls into it.
+ */
+void MixedLogFile::setPosition(uint64_t offset)
+{
+   if(this->compressed)
+   {
+      //the offset is within the current chunk
+      this->blockPos = (offset < this->blockLen) ? offset : this->blockLen;
+      return;
+   }
+   if(NULL != this->map)
+   {
+      this->blockPos = (offset < this->blockLen) ? offset : this->blockLen;
+      advise();
+      return;
+   }
+   if((offset >= this->blockOffset) && (offset <= this->blockOffset + this->blockLen))
+   {
+      this->blockPos = offset - this->blockOffset;
+      return;
+   }
+   this->blockOffset = offset;
+   this->blockPos = 0;
+   this->blockLen = 0;
+}
+
+/**
+ * Makes at least need bytes following the read position available in the block:
+ * the unread tail is moved to the block start and the rest is refilled from the file.
+ * Records never cross the chunks of a compressed log, so the next chunk is taken
+ * only once the current one is read up.
+ *
+ * @return POSIX error code or 0 on success, ENODATA if the file ends earlier
+ */
+int MixedLogFile::fill(size_t need)
+{
+   size_t avail = this->blockLen - this->blockPos;
+   if(avail >= need)
+   {
+      return 0;
+   }
+   if(NULL != this->map)
+   {
+      return ENODATA;
+   }
+   if(this->compressed)
+   {
+      while(0 == avail)
+      {
+         const char *data;
+         int err = this->chunks.next(data, avail);
+         if(0 != err)
+         {
+            return err;
+         }
+         this->buf = data;
+         this->blockPos = 0;
+         this->blockLen = avail;
+      }
+      return (avail >= need) ? 0 : ENODATA;
+   }
+
+   if(0 != this->blockPos)
+   {
+      memmove(&this->block[0], &this->block[this->blockPos], avail);
+      this->blockOffset += this->blockPos;
+      this->blockPos = 0;
+      this->blockLen = avail;
+   }
+
+   while(this->blockLen < need)
+   {
+      //the index may follow the records
+      uint64_t left = this->dataEnd - (this->blockOffset + this->blockLen);
+      size_t want = this->block.size() - this->blockLen;
+      if(want > left)
+      {
+         want = left;
+      }
+      if(0 == want)
+      {
+         return ENODATA;
+      }
+      ssize_t got = pread(this->fd, &this->block[this->blockLen], want, this->blockOffset + this->blockLen);
+      if(-1 == got)
+      {
+         if(EINTR == errno)
+         {
+            continue;
+         }
+         int err = errno;
+         fprintf(stderr, "pread() failed(%s)\n", strerror(err));
+         return err;
+      }
+      if(0 == got)
+      {
+         return ENODATA;
+      }
+      this->blockLen += got;
+   }
+   return 0;
+}
+
+/**
+ * Starts reading over from the first packet.
+ *
+ * @return POSIX error code or 0 on success
+ */
+int MixedLogFile::rewind()
+{
+   this->lastNs = 0;
+   if(this->compressed)
+   {
+      this->chunks.start(0);
+      this->blockPos = 0;
+      this->blockLen = 0;
+      return 0;
+   }
+   setPosition(this->dataOffset);
+   return 0;
+}
+
+/**
+ * Positions the file so the next read() returns the first packet not earlier
+ * than the given time(or end of file). The time index is loaded on the first
+ * call, the file is scanned from the nearest checkpoint before the time or from
+ * the beginning if there is no index. A compressed log is scanned from the start
+ * of the chunk found in its directory.
+ *
+ * @return POSIX error code or 0 on success
+ */
+int MixedLogFile::seek(const timeval &ts)
+{
+   if(this->compressed)
+   {
+      this->chunks.start(this->chunks.find(ts));
+      this->blockPos = 0;
+      this->blockLen = 0;
+      this->lastNs = 0;
+   }
+   else if(!this->indexLoaded && this->hasInfo)
+   {
+      //the index is stored in the log
+      int err = (0 != this->logInfo.indexOffset) ? this->index.read(this->fd, this->logInfo.indexOffset, this->dataEnd) : ENOENT;
+      if(0 != err)
+      {
+         fprintf(stderr, "Index of %s is not used(%s), the log is scanned\n", this->fileName.c_str(), strerror(err));
+      }
+      this->indexLoaded = true;
+   }
+   else if(!this->indexLoaded)
+   {
+      std::string indexName = EventIndex::fileName(this->fileName.c_str());
+      int err = this->index.load(indexName.c_str(), this->fileSize);
+      if(0 != err)
+      {
+         fprintf(stderr, "Index %s is not used(%s), the log is scanned\n", indexName.c_str(), strerror(err));
+      }
+      this->indexLoaded = true;
+   }
+
+   if(!this->compressed)
+   {
+      int64_t offset = this->index.find(ts);
+      if(-1 == offset)
+      {
+         offset = this->dataOffset;
+      }
+      setPosition(offset);
+   }
+
+   if(2 == this->version)
+   {
+      //v2 records are decoded one by one, the checkpoints have absolute timestamps
+      int64_t target = ((int64_t)ts.tv_sec * 1000000 + ts.tv_usec) * 1000;
+      for(;;)
+      {
+         //the next chunk is taken before the position is saved
+         int err = fill(1);
+         if(0 != err)
+         {
+            return (ENODATA == err) ? 0 : err;
+         }
+         uint64_t pos = this->blockOffset + this->blockPos;
+         int64_t prevNs = this->lastNs;
+         packetType type;
+         timeval packetTs;
+         const char *data;
+         int len = readViewV2(type, packetTs, data);
+         if(len <= 0)
+         {
+            return (0 == len) ? 0 : errno;
+         }
+         if(this->lastNs >= target)
+         {
+            setPosition(pos);
+            this->lastNs = prevNs;
+            return 0;
+         }
+      }
+   }
+
+   for(;;)
+   {
+      int err = fill(sizeof(eventLogPacket));
+      if(0 != err)
+      {
+         //all packets are earlier, the next read() reports end of file
+         return (ENODATA == err) ? 0 : err;
+      }
+
+      eventLogPacket packetHeader;
+      memcpy(&packetHeader, this->buf + this->blockPos, sizeof(eventLogPacket));
+      if((packetHeader.sec > (uint64_t)ts.tv_sec)
+         || ((packetHeader.sec == (uint64_t)ts.tv_sec) && (packetHeader.usec >= (uint64_t)ts.tv_usec)))
+      {
+         return 0;
+      }
+
+      setPosition(this->blockOffset + this->blockPos + sizeof(eventLogPacket) + packetHeader.len);
+   }
+}
+
 void MixedLogFile::close()
 {
-   if(NULL != this->fp)
+   this->chunks.close();
+   if(NULL != this->map)
    {
-      fclose(this->fp);
-      this->fp = NULL;
+      munmap(this->map, this->fileSize);
+      this->map = NULL;
+   }
+   if(-1 != this->fd)
+   {
+      ::close(this->fd);
+      this->fd = -1;
    }
 }
 
@@ -37,48 +401,148 @@ MixedLogFile::~MixedLogFile()
 }
 
 
-MixedLogFile::MixedLogFile()
+MixedLogFile::MixedLogFile(bool map)
 {
-   this->fp = NULL;
+   this->fd = -1;
+   this->buf = NULL;
+   this->mapEnabled = map;
+   this->map = NULL;
+   this->prefetched = 0;
+   this->released = 0;
+   this->dataOffset = 0;
+   this->fileSize = 0;
+   this->dataEnd = 0;
+   this->hasInfo = false;
+   memset(&this->logInfo, 0, sizeof(this->logInfo));
+   this->version = 1;
+   this->compressed = false;
+   this->lastNs = 0;
+   this->second = 0;
+   this->secondNs = 0;
+   memset(&this->canBuf, 0, sizeof(this->canBuf));
+   this->lastView = NULL;
+   this->indexLoaded = false;
+   this->blockOffset = 0;
+   this->blockPos = 0;
+   this->blockLen = 0;
 }
 
 /**
- * Reads the next packet.
+ * Reads the next packet without copying it: data points into the mapping or
+ * the read block and stays valid until close() or the next read, seek() or rewind()
+ * respectively.
  * If end of file is reached the 0 is returned.
  *
- * @return amount of read data or -1 on error (errno is set to the error code)
+ * @return amount of data or -1 on error (errno is set to the error code)
  */
-int MixedLogFile::read(packetType &type, timeval &ts, char *data, const int size)
+int MixedLogFile::readView(packetType &type, timeval &ts, const char *&data)
 {
-   eventLogPacket packetHeader;
-   int err = fread(&packetHeader, 1, sizeof(eventLogPacket), this->fp);
-   if(sizeof(eventLogPacket) != err)
+   if(2 == this->version)
+   {
+      return readViewV2(type, ts, data);
+   }
+
+   int err = fill(sizeof(eventLogPacket));
+   if(0 != err)
    {
-      fprintf(stderr, "fread() failed(%i)\n", err);
-      if(feof(this->fp))
+      if(ENODATA == err)
       {
+         if(this->blockPos != this->blockLen)
+         {
+            fprintf(stderr, "Truncated packet header at the end of the log\n");
+         }
          return 0;
       }
+      errno = err;
       return -1;
    }
 
-   if(packetHeader.len > size)
+   eventLogPacket packetHeader;
+   memcpy(&packetHeader, this->buf + this->blockPos, sizeof(eventLogPacket));
+   if(packetHeader.len > EVENT_LOG_MAX_PACKET_SIZE)
    {
       fprintf(stderr, "Suspicious packet len: (%u)\n", packetHeader.len);
       errno = ENOMEM;
       return -1;
    }
 
-   err = fread(data, 1, packetHeader.len, this->fp);
-   if(packetHeader.len != err)
+   err = fill(sizeof(eventLogPacket) + packetHeader.len);
+   if(0 != err)
    {
-      fprintf(stderr, "fread() failed(%i)\n", err);
+      if(ENODATA == err)
+      {
+         fprintf(stderr, "Truncated packet at the end of the log\n");
+         err = EIO;
+      }
+      errno = err;
       return -1;
    }
 
+   data = this->buf + this->blockPos + sizeof(eventLogPacket);
+   this->blockPos += sizeof(eventLogPacket) + packetHeader.len;
+   if((NULL != this->map) && (this->blockPos + MIXED_LOG_MAP_AHEAD > this->prefetched))
+   {
+      advise();
+   }
+
    type = (packetType)(packetHeader.type);
    ts.tv_sec = packetHeader.sec;
    ts.tv_usec  = packetHeader.usec;
 
    return packetHeader.len;
 }
+
+/**
+ * Decodes the next ELOG v2 record, CAN packets are expanded into canBuf.
+ * If end of file is reached the 0 is returned.
+ *
+ * @return amount of data or -1 on error (errno is set to the error code)
+ */
+int MixedLogFile::readViewV2(packetType &type, timeval &ts, const char *&data)
+{
+   int err = fill(EVENT_LOG_V2_MAX_RECORD);
+   if((0 != err) && (ENODATA != err))
+   {
+      errno = err;
+      return -1;
+   }
+
+   size_t avail = this->blockLen - this->blockPos;
+   if(0 == avail)
+   {
+      return 0;
+   }
+
+   int size;
+   int len = eventCodecDecode((const uint8_t *)this->buf + this->blockPos, avail, type, this->lastNs
+                              , data, size, &this->canBuf);
+   if(len <= 0)
+   {
+      if(0 == len)
+      {
+         fprintf(stderr, "Truncated record at the end of the log\n");
+         return 0;
+      }
+      fprintf(stderr, "Malformed record at %llu\n", (unsigned long long)(this->blockOffset + this->blockPos));
+      errno = EINVAL;
+      return -1;
+   }
+   this->blockPos += len;
+   if((NULL != this->map) && (this->blockPos + MIXED_LOG_MAP_AHEAD > this->prefetched))
+   {
+      advise();
+   }
+
+   //the second is split off only when it changes, the rest fits a 32 bit division
+   uint64_t inSecond = (uint64_t)(this->lastNs - this->secondNs);
+   if(inSecond >= 1000000000u)
+   {
+      this->second = this->lastNs / 1000000000;
+      this->secondNs = this->second * 1000000000;
+      inSecond = (uint64_t)(this->lastNs - this->secondNs);
+   }
+   ts.tv_sec = this->second;
+   ts.tv_usec = (uint32_t)inSecond / 1000u;
+   this->lastView = data;
+   return size;
+}
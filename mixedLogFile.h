@@ -5,27 +5,90 @@
 #include <time.h>
 #include <stdio.h>
 
+#include <string>
+#include <vector>
+
 #include "logFile.h"
+#include "eventIndex.h"
+#include "eventChunkReader.h"
 
+//the log is read by blocks of this size, packets are returned as views into the block
+#define MIXED_LOG_BLOCK_SIZE (256*1024)
+//mapped log: pages are prefetched this far ahead of the read position and released
+//once they are this far behind it, so the resident set stays bounded on any log size
+#define MIXED_LOG_MAP_AHEAD  (8*1024*1024)
+#define MIXED_LOG_MAP_BEHIND (32*1024*1024)
 
+/**
+ * Events log(@see eventlog.h) reader, both ELOG v1 and v2 are supported. The log is
+ * memory mapped and the packets are returned as views into the mapping, which stay
+ * valid until close(). If the log can't be mapped(or map is false) it is read by
+ * blocks with pread() instead. CAN packets of v2 logs are expanded into a canEvent
+ * owned by the reader, their views are valid until the next read.
+ * The summary of a self-describing log is loaded by open() and available with info().
+ * Block compressed logs are read transparently: the chunks are decompressed by
+ * the background thread of EventChunkReader and the views point into the chunk.
+ */
 class MixedLogFile : public ILogFile
 {
 public:
-   MixedLogFile();
+   MixedLogFile(bool map = true);
    ~MixedLogFile();
    /**
-    * Reads the next packet.
+    * Reads the next packet without copying it: data points into the mapping or
+    * the read block and stays valid until close() or the next read, seek() or rewind()
+    * respectively.
     * If end of file is reached the 0 is returned.
     *
-    * @return amount of read data or -1 on error (errno is set to the error code)
+    * @return amount of data or -1 on error (errno is set to the error code)
     */
-   int read(packetType &type, timeval &ts, char *data, const int size);
+   int readView(packetType &type, timeval &ts, const char *&data);
+
+   bool persistentView() const { return (NULL != this->map) && (this->lastView != (const char *)&this->canBuf); }
 
+   /**
+    * @return summary of a self-describing log(@see EVENT_LOG_INFO) or NULL if the log has none
+    */
+   const eventLogInfo *info() const { return this->hasInfo ? &this->logInfo : NULL; }
+
+   int rewind();
+   int seek(const timeval &ts);
    int open(const char* fname);
    void close();
 
 private:
-   FILE *fp;
+   int readViewV2(packetType &type, timeval &ts, const char *&data);
+   int fill(size_t need);
+   void setPosition(uint64_t offset);
+   void advise();
+
+   int fd;
+   const char *buf;      //the block or the whole mapped log
+   std::vector<char> block;
+   uint64_t blockOffset; //file offset of the block start
+   size_t blockPos;      //read position within the block
+   size_t blockLen;      //amount of valid data in the block
+
+   bool mapEnabled;
+   char *map;            //the mapped log, NULL if it is read by blocks
+   uint64_t prefetched;  //end of the range advised with MADV_WILLNEED
+   uint64_t released;    //pages before it are dropped with MADV_DONTNEED
+   std::string fileName;
+   long dataOffset;     //position of the first packet following the log header
+   uint64_t fileSize;
+   uint64_t dataEnd;     //the records end here, the index may follow them
+   bool hasInfo;
+   eventLogInfo logInfo; //the summary from the header
+   uint32_t version;     //ELOG record version from the header
+   bool compressed;      //the log is block compressed, the block is the current chunk
+   EventChunkReader chunks;
+   int64_t lastNs;       //v2: timestamp(nsec) of the last decoded record
+   int64_t second;       //v2: the second of the last decoded record
+   int64_t secondNs;     //v2: the second in nsec
+   canEvent canBuf;      //v2: the last decoded CAN packet
+   const char *lastView; //the last returned view
+   EventIndex index;    //loaded by the first seek()
+   bool indexLoaded;
 };
 
 #endif // _MIXED_LOG_FILE__
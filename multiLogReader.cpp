@@ -15,70 +15,201 @@
 
 MultiLogReader::MultiLogReader(std::vector<ILogFile*> &fileList) : files(fileList)
 {
-   fileContext ctx;
-   for(int i =0; i<(int)files.size(); i++)
+   contexts.resize(files.size());
+   heap.reserve(files.size());
+   reset();
+}
+
+/**
+ * Drops the packets read ahead, the files are read ahead again by the next read.
+ */
+void MultiLogReader::reset()
+{
+   for(int i =0; i<(int)contexts.size(); i++)
    {
-      contexts.push_back(ctx);
+      contexts[i] = fileContext();
    }
+   heap.clear();
+   current = -1;
+   primed = false;
 }
 
+/**
+ * @return true if the packet read ahead from file a goes before the one of file b
+ */
+bool MultiLogReader::earlier(int a, int b) const
+{
+   const timeval &ta = contexts[a].ts;
+   const timeval &tb = contexts[b].ts;
+   if(ta.tv_sec != tb.tv_sec)
+   {
+      return ta.tv_sec < tb.tv_sec;
+   }
+   if(ta.tv_usec != tb.tv_usec)
+   {
+      return ta.tv_usec < tb.tv_usec;
+   }
+   //ties keep the order of the files
+   return a < b;
+}
 
 /**
- * Reads the next packet.
+ * Moves the heap entry at the given position down until both its children are later.
+ */
+void MultiLogReader::siftDown(int pos)
+{
+   int count = (int)heap.size();
+   int file = heap[pos];
+   for(;;)
+   {
+      int child = 2 * pos + 1;
+      if(child >= count)
+      {
+         break;
+      }
+      if((child + 1 < count) && earlier(heap[child + 1], heap[child]))
+      {
+         child++;
+      }
+      if(!earlier(heap[child], file))
+      {
+         break;
+      }
+      heap[pos] = heap[child];
+      pos = child;
+   }
+   heap[pos] = file;
+}
+
+/**
+ * Reads the next packet without copying it: data points to the storage of the
+ * file it comes from and stays valid until the next read, seek() or rewind().
+ * Only the file of the returned packet is read by the next call, so the views
+ * read ahead from the other files stay valid.
  * If end of file is reached the 0 is returned.
  *
- * @return amount of read data or -1 on error (errno is set to the error code)
+ * @return amount of data or -1 on error (errno is set to the error code)
  */
-int MultiLogReader::read(packetType &type, timeval &ts, char *data, const int size)
+int MultiLogReader::readView(packetType &type, timeval &ts, const char *&data)
 {
-   for(int i =0; i<(int)files.size(); i++)
+   if(!primed)
    {
-      if(!contexts[i].endIsReached && !contexts[i].valid)
+      for(int i =0; i<(int)files.size(); i++)
       {
-         int err = files[i]->read(contexts[i].type, contexts[i].ts, contexts[i].buff, sizeof(contexts[i].buff));
+         fileContext &ctx = contexts[i];
+         int err = files[i]->readView(ctx.type, ctx.ts, ctx.data);
          if(-1 == err)
          {
+            heap.clear();
             return -1;
          }
-         if(0 == err)
+         if(0 != err)
          {
-            contexts[i].endIsReached = true;
-            continue;
+            ctx.size = err;
+            heap.push_back(i);
          }
-         contexts[i].valid = true;
-         contexts[i].size = err;
       }
-   }
-
-   bool dataReady = false;
-   fileContext *EarlierCtx = &contexts[0];
-   for(int i =0; i<(int)contexts.size(); i++)
-   {
-      if(!contexts[i].endIsReached && contexts[i].valid)
+      for(int i = (int)heap.size() / 2 - 1; i >= 0; i--)
       {
-         if(timercmp(&EarlierCtx->ts, &contexts[i].ts, >=))
-         {
-            EarlierCtx = &contexts[i];
-            dataReady = true;
-         }
+         siftDown(i);
       }
+      primed = true;
    }
-
-   if(dataReady)
+   else if(-1 != current)
    {
-      if(EarlierCtx->size > size)
+      //the top file is read ahead again and takes its place in the heap
+      fileContext &ctx = contexts[current];
+      int err = files[current]->readView(ctx.type, ctx.ts, ctx.data);
+      if(-1 == err)
       {
-         errno = ENOMEM;
          return -1;
       }
+      if(0 == err)
+      {
+         heap[0] = heap.back();
+         heap.pop_back();
+      }
+      else
+      {
+         ctx.size = err;
+      }
+      if(!heap.empty())
+      {
+         siftDown(0);
+      }
+      current = -1;
+   }
+
+   if(heap.empty())
+   {
+      return 0;
+   }
 
-      type = EarlierCtx->type;
-      ts = EarlierCtx->ts;
-      memcpy(data, EarlierCtx->buff, EarlierCtx->size);
-      EarlierCtx->valid = false;
-      return EarlierCtx->size;
+   current = heap[0];
+   const fileContext &ctx = contexts[current];
+   type = ctx.type;
+   ts = ctx.ts;
+   data = ctx.data;
+   return ctx.size;
+}
+
+/**
+ * Reads the next packet into the caller buffer.
+ * If end of file is reached the 0 is returned.
+ *
+ * @return amount of read data or -1 on error (errno is set to the error code)
+ */
+int MultiLogReader::read(packetType &type, timeval &ts, char *data, const int size)
+{
+   const char *view;
+   int len = readView(type, ts, view);
+   if(len <= 0)
+   {
+      return len;
    }
+   if(len > size)
+   {
+      errno = ENOMEM;
+      return -1;
+   }
+   memcpy(data, view, len);
+   return len;
+}
 
+/**
+ * Rewinds all files and drops the packets read ahead from them.
+ *
+ * @return POSIX error code or 0 on success
+ */
+int MultiLogReader::rewind()
+{
+   for(int i =0; i<(int)files.size(); i++)
+   {
+      int err = files[i]->rewind();
+      if(0 != err)
+      {
+         return err;
+      }
+   }
+   reset();
    return 0;
 }
 
+/**
+ * Seeks all files to the given time and drops the packets read ahead from them.
+ *
+ * @return POSIX error code or 0 on success
+ */
+int MultiLogReader::seek(const timeval &ts)
+{
+   for(int i =0; i<(int)files.size(); i++)
+   {
+      int err = files[i]->seek(ts);
+      if(0 != err)
+      {
+         return err;
+      }
+   }
+   reset();
+   return 0;
+}
@@ -8,6 +8,12 @@
 #include "logFile.h"
 #include <vector>
 
+/**
+ * Merges the packets of several logs into a single stream in time order.
+ * Every file is read one packet ahead, the files are kept in a binary min-heap
+ * by the time of that packet, so taking a packet costs O(log k) for k files.
+ * Packets of the same time are returned in the order of the files in the list.
+ */
 class MultiLogReader
 {
 public:
@@ -15,13 +21,41 @@ public:
    MultiLogReader(std::vector<ILogFile*> &fileList);
 
    /**
-    * Reads the next packet.
+    * Reads the next packet without copying it: data points to the storage of the
+    * file it comes from and stays valid until the next read, seek() or rewind().
+    * If end of file is reached the 0 is returned.
+    *
+    * @return amount of data or -1 on error (errno is set to the error code)
+    */
+   int readView(packetType &type, timeval &ts, const char *&data);
+
+   /**
+    * @return true if the view returned by the last readView() stays valid until the files are closed
+    */
+   bool persistentView() const { return (-1 != current) && files[current]->persistentView(); }
+
+   /**
+    * Reads the next packet into the caller buffer.
     * If end of file is reached the 0 is returned.
     *
     * @return amount of read data or -1 on error (errno is set to the error code)
     */
    int read(packetType &type, timeval &ts, char *data, const int size);
 
+   /**
+    * Rewinds all files and drops the packets read ahead from them.
+    *
+    * @return POSIX error code or 0 on success
+    */
+   int rewind();
+
+   /**
+    * Seeks all files to the given time and drops the packets read ahead from them.
+    *
+    * @return POSIX error code or 0 on success
+    */
+   int seek(const timeval &ts);
+
    struct fileContext
    {
       fileContext()
@@ -29,22 +63,26 @@ public:
          type = PACKET_TYPE_MAX;
          ts.tv_sec = 0;
          ts.tv_usec = 0;
-         endIsReached = false;
-         valid = false;
          size = 0;
+         data = NULL;
       }
 
       packetType type;
       timeval ts;
-      char buff[2000];
-      bool endIsReached;
-      bool valid;
+      const char *data; //view of the read ahead packet, valid until the file is read again
       int size;
    };
 
 private:
+   void reset();
+   bool earlier(int a, int b) const;
+   void siftDown(int pos);
+
    std::vector<ILogFile*> &files;
    std::vector<fileContext> contexts;
+   std::vector<int> heap; //files with a read ahead packet, the earliest one on top
+   int current;           //file of the last returned packet(heap top), it is read ahead by the next call, -1 - none
+   bool primed;           //every file was read ahead since the last rewind or seek
 };
 
 #endif // _MULTI_LOG_READER__
@@ -0,0 +1,142 @@
+#ifndef _PCAP_FRAME__
+#define _PCAP_FRAME__
+
+#include <stdint.h>
+
+#include "eventlog.h"
+
+#define SWAP2(i)           (static_cast<uint16_t>((static_cast<uint16_t>(i) << 8) | (static_cast<uint16_t>(i) >> 8)))
+#define SWAP4(i)           (((i)<<24) | (((i)& 0x0000FF00)<<8) | (((i)& 0x00FF0000)>>8) | ((i)>>24) )
+
+#define ETHERNET_FRAME_MAX_SIZE      (2000u)
+//MIN size of RTP packet to sort out some unrelated data and make parsing more safe
+#define ETHERNET_FRAME_MIN_SIZE      (12u+14u+20u+8u)
+
+#define SIZE_UDP 8
+
+//RTP payload type of the camera video stream
+#define PCAP_RTP_PAYLOAD_TYPE (98)
+
+/**
+ * Selection of the RTP streams of a capture.
+ */
+struct pcapRtpSelect
+{
+   int payloadType;  //RTP payload type, -1 - any
+   int port;         //UDP source or destination port, 0 - any
+   int64_t ssrc;     //RTP SSRC, -1 - any
+};
+/* Ethernet header */
+struct sniff_ethernet {
+   uint8_t ether_dhost[6];
+   uint8_t ether_shost[6];
+   uint16_t ether_type;
+};
+
+/* IP header */
+struct sniff_ip {
+   uint8_t ip_vhl;    /* version << 4 | header length >> 2 */
+   uint8_t ip_tos;    /* type of service */
+   uint16_t ip_len;   /* total length */
+   uint16_t ip_id;    /* identification */
+   uint16_t ip_off;   /* fragment offset field */
+   uint8_t ip_ttl;    /* time to live */
+   uint8_t ip_p;      /* protocol */
+   uint16_t ip_sum;   /* checksum */
+   uint32_t ip_src;
+   uint32_t ip_dst;
+};
+#define IP_HL(ip)    (((ip)->ip_vhl) & 0x0f)
+#define IP_V(ip)     (((ip)->ip_vhl) >> 4)
+
+struct sniff_udp_rtp {
+   uint16_t sport;
+   uint16_t dport;
+   uint16_t length;
+   uint16_t checksum;
+   rtpHeader rtp;
+};
+
+/**
+ * Filters out a RTP packet of the captured Ethernet frame: an IPv4/UDP datagram with
+ * the RTP version 2 header of one of the selected streams. It is shared by the libpcap
+ * reader of logparser and PcapLogFile, so both pick the same packets of a capture.
+ *
+ * @param caplen - amount of the captured frame bytes
+ * @param len - the frame length on the wire
+ * @param data - the RTP packet(the UDP payload)
+ * @param size - the RTP packet size
+ * @return true if the frame carries a RTP packet
+ */
+static inline bool pcapFrameRtp(const uint8_t *frame, uint32_t caplen, uint32_t len, const char *&data, int &size
+                                , const pcapRtpSelect &select)
+{
+   if(len <= ETHERNET_FRAME_MIN_SIZE || len > ETHERNET_FRAME_MAX_SIZE)
+   {
+      return false;
+   }
+   if(caplen < sizeof(sniff_ethernet) + sizeof(sniff_ip))
+   {
+      return false;
+   }
+   const sniff_ethernet *ethernet = (const sniff_ethernet *)frame;
+   if(0x0008 != ethernet->ether_type)//IP packet
+   {
+      return false;
+   }
+
+   const sniff_ip *ip = (const sniff_ip *)(frame + sizeof(sniff_ethernet));
+   uint32_t size_ip = IP_HL(ip)*4;
+   if (size_ip < 20)
+   {
+      return false;
+   }
+   if(17 != ip->ip_p)//UDP packet
+   {
+      return false;
+   }
+
+   uint32_t offset = sizeof(sniff_ethernet) + size_ip;
+   if(caplen < offset + sizeof(sniff_udp_rtp))
+   {
+      return false;
+   }
+   const sniff_udp_rtp *udp = (const sniff_udp_rtp *)(frame + offset);
+   if(2 != udp->rtp.version)//likely not an RTP packet
+   {
+      return false;
+   }
+   if((select.payloadType >= 0) && ((uint32_t)select.payloadType != udp->rtp.pt))
+   {
+      return false;
+   }
+   if((0 != select.port) && (select.port != SWAP2(udp->sport)) && (select.port != SWAP2(udp->dport)))
+   {
+      return false;
+   }
+   if((select.ssrc >= 0) && ((uint32_t)select.ssrc != SWAP4(udp->rtp.ssrc)))
+   {
+      return false;
+   }
+
+   //the datagram must be captured completely
+   int payload = SWAP2(udp->length) - SIZE_UDP;
+   if((payload < (int)sizeof(rtpHeader)) || (offset + SIZE_UDP + payload > caplen))
+   {
+      return false;
+   }
+   data = (const char *)&udp->rtp;
+   size = payload;
+   return true;
+}
+
+/**
+ * Filters out a RTP packet of the camera video stream(payload type 98) of the captured frame.
+ */
+static inline bool pcapFrameRtp(const uint8_t *frame, uint32_t caplen, uint32_t len, const char *&data, int &size)
+{
+   static const pcapRtpSelect camera = {PCAP_RTP_PAYLOAD_TYPE, 0, -1};
+   return pcapFrameRtp(frame, caplen, len, data, size, camera);
+}
+
+#endif // _PCAP_FRAME__
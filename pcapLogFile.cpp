@@ -0,0 +1,475 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <byteswap.h>
+
+#include "eventlog.h"
+#include "pcapFrame.h"
+#include "pcapLogFile.h"
+
+//classic pcap: file header magic with microsecond and nanosecond timestamps
+#define PCAP_MAGIC_USEC (0xa1b2c3d4)
+#define PCAP_MAGIC_NSEC (0xa1b23c4d)
+#define PCAP_FILE_HEADER_SIZE   (24)
+#define PCAP_RECORD_HEADER_SIZE (16)
+#define PCAP_LINKTYPE_ETHERNET  (1)
+
+//pcapng block types and the section header byte order magic
+#define PCAPNG_SHB (0x0A0D0D0A)
+#define PCAPNG_IDB (0x00000001)
+#define PCAPNG_EPB (0x00000006)
+#define PCAPNG_BYTE_ORDER_MAGIC (0x1A2B3C4D)
+//block type, block length and the trailing block length
+#define PCAPNG_BLOCK_OVERHEAD (12)
+//EPB: interface id, timestamp high and low, captured and original length
+#define PCAPNG_EPB_HEADER_SIZE (8 + 20)
+#define PCAPNG_OPT_ENDOFOPT (0)
+#define PCAPNG_OPT_TSRESOL  (9)
+#define PCAPNG_OPT_TSOFFSET (14)
+
+
+PcapLogFile::PcapLogFile()
+{
+   this->map = NULL;
+   this->fileSize = 0;
+   this->dataOffset = 0;
+   this->pos = 0;
+   this->ng = false;
+   this->nsec = false;
+   this->section.swapped = false;
+   this->sectionOffset = 0;
+   this->indexed = 0;
+   this->indexSection.swapped = false;
+   this->indexSectionOffset = 0;
+   this->pending = false;
+   this->pendingData = NULL;
+   this->pendingSize = 0;
+}
+
+PcapLogFile::~PcapLogFile()
+{
+   close();
+}
+
+/**
+ * @return true if the file starts like a pcap or pcapng capture
+ */
+bool PcapLogFile::probe(const char *fname)
+{
+   int fd = ::open(fname, O_RDONLY);
+   if(-1 == fd)
+   {
+      return false;
+   }
+   uint32_t magic = 0;
+   bool capture = (sizeof(magic) == pread(fd, &magic, sizeof(magic), 0))
+                  && ((PCAP_MAGIC_USEC == magic) || (PCAP_MAGIC_NSEC == magic)
+                      || (PCAP_MAGIC_USEC == bswap_32(magic)) || (PCAP_MAGIC_NSEC == bswap_32(magic))
+                      || (PCAPNG_SHB == magic));
+   ::close(fd);
+   return capture;
+}
+
+uint16_t PcapLogFile::get16(const uint8_t *p) const
+{
+   uint16_t v;
+   memcpy(&v, p, sizeof(v));
+   return this->section.swapped ? bswap_16(v) : v;
+}
+
+uint32_t PcapLogFile::get32(const uint8_t *p) const
+{
+   uint32_t v;
+   memcpy(&v, p, sizeof(v));
+   return this->section.swapped ? bswap_32(v) : v;
+}
+
+int PcapLogFile::open(const char* fname)
+{
+   close();
+
+   int fd = ::open(fname, O_RDONLY);
+   if(-1 == fd)
+   {
+      fprintf(stderr, "Unable to open the file %s(%s)\n", fname, strerror(errno));
+      return errno;
+   }
+   struct stat st;
+   if(0 != fstat(fd, &st))
+   {
+      int err = errno;
+      fprintf(stderr, "fstat(%s) failed(%s)\n", fname, strerror(err));
+      ::close(fd);
+      return err;
+   }
+   if(st.st_size < PCAPNG_BLOCK_OVERHEAD)
+   {
+      fprintf(stderr, "%s is not a pcap or pcapng capture\n", fname);
+      ::close(fd);
+      return EINVAL;
+   }
+   void *addr = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+   int err = errno;
+   ::close(fd);
+   if(MAP_FAILED == addr)
+   {
+      fprintf(stderr, "mmap(%s) failed(%s)\n", fname, strerror(err));
+      return err;
+   }
+   madvise(addr, st.st_size, MADV_SEQUENTIAL);
+   this->map = (const uint8_t *)addr;
+   this->fileSize = st.st_size;
+   this->fileName = fname;
+
+   uint32_t magic;
+   memcpy(&magic, this->map, sizeof(magic));
+   if(PCAPNG_SHB == magic)
+   {
+      //the byte order is taken from the section header by nextFrame()
+      this->ng = true;
+      this->dataOffset = 0;
+   }
+   else
+   {
+      this->ng = false;
+      this->section.swapped = (PCAP_MAGIC_USEC == bswap_32(magic)) || (PCAP_MAGIC_NSEC == bswap_32(magic));
+      magic = this->section.swapped ? bswap_32(magic) : magic;
+      if(((PCAP_MAGIC_USEC != magic) && (PCAP_MAGIC_NSEC != magic)) || (this->fileSize < PCAP_FILE_HEADER_SIZE))
+      {
+         fprintf(stderr, "%s is not a pcap or pcapng capture\n", fname);
+         close();
+         return EINVAL;
+      }
+      this->nsec = (PCAP_MAGIC_NSEC == magic);
+      uint32_t linkType = get32(this->map + 20) & 0x0FFFFFFF;
+      if(PCAP_LINKTYPE_ETHERNET != linkType)
+      {
+         fprintf(stderr, "%s: link type %u is not supported, only Ethernet captures are\n", fname, linkType);
+         close();
+         return EINVAL;
+      }
+      this->dataOffset = PCAP_FILE_HEADER_SIZE;
+   }
+
+   return rewind();
+}
+
+void PcapLogFile::close()
+{
+   if(NULL != this->map)
+   {
+      munmap((void *)this->map, this->fileSize);
+      this->map = NULL;
+   }
+   this->fileSize = 0;
+   this->pos = 0;
+   this->section.swapped = false;
+   this->section.interfaces.clear();
+   this->index.clear();
+   this->indexed = 0;
+   this->indexSection.interfaces.clear();
+   this->pending = false;
+}
+
+/**
+ * Starts reading over from the first packet.
+ *
+ * @return POSIX error code or 0 on success
+ */
+int PcapLogFile::rewind()
+{
+   this->pos = this->dataOffset;
+   if(this->ng)
+   {
+      this->section.interfaces.clear();
+   }
+   this->sectionOffset = this->dataOffset;
+   this->pending = false;
+   return 0;
+}
+
+/**
+ * Reports the capture cut in the middle of a record, the packets before it are played.
+ *
+ * @return ENODATA
+ */
+int PcapLogFile::truncated()
+{
+   fprintf(stderr, "%s is truncated at %llu\n", this->fileName.c_str(), (unsigned long long)this->pos);
+   this->pos = this->fileSize;
+   return ENODATA;
+}
+
+/**
+ * Adds the interface of the pcapng interface description block, the interfaces
+ * read before(after a seek) are not added again.
+ */
+void PcapLogFile::addInterface(const uint8_t *block, uint32_t blockLen, uint64_t offset)
+{
+   for(size_t i=0; i<this->section.interfaces.size(); i++)
+   {
+      if(this->section.interfaces[i].offset == offset)
+      {
+         return;
+      }
+   }
+
+   pcapInterface itf;
+   itf.offset = offset;
+   itf.linkType = (blockLen >= 16) ? get16(block + 8) : 0;
+   itf.unitsPerSec = 1000000;
+   itf.tsOffset = 0;
+
+   //options: code, length and the value padded to 4 bytes
+   const uint8_t *opt = block + 16;
+   const uint8_t *end = block + blockLen - 4;
+   while(opt + 4 <= end)
+   {
+      uint16_t code = get16(opt);
+      uint16_t len = get16(opt + 2);
+      if((PCAPNG_OPT_ENDOFOPT == code) || (opt + 4 + len > end))
+      {
+         break;
+      }
+      if((PCAPNG_OPT_TSRESOL == code) && (1 == len))
+      {
+         uint8_t resol = opt[4];
+         uint32_t exp = resol & 0x7f;
+         if(resol & 0x80)
+         {
+            itf.unitsPerSec = 1ULL << ((exp < 63) ? exp : 63);
+         }
+         else
+         {
+            itf.unitsPerSec = 1;
+            for(uint32_t i=0; (i<exp) && (i<19); i++)
+            {
+               itf.unitsPerSec *= 10;
+            }
+         }
+      }
+      else if((PCAPNG_OPT_TSOFFSET == code) && (8 == len))
+      {
+         uint64_t v;
+         memcpy(&v, opt + 4, sizeof(v));
+         itf.tsOffset = (int64_t)(this->section.swapped ? bswap_64(v) : v);
+      }
+      opt += 4 + ((len + 3) & ~3u);
+   }
+   this->section.interfaces.push_back(itf);
+}
+
+/**
+ * Reads up to the next captured frame, the other pcapng blocks are processed or skipped.
+ *
+ * @return POSIX error code or 0 on success, ENODATA if end of file is reached
+ */
+int PcapLogFile::nextFrame(timeval &ts, const uint8_t *&frame, uint32_t &caplen, uint32_t &len)
+{
+   if(!this->ng)
+   {
+      if(this->pos >= this->fileSize)
+      {
+         return ENODATA;
+      }
+      if(this->fileSize - this->pos < PCAP_RECORD_HEADER_SIZE)
+      {
+         return truncated();
+      }
+      const uint8_t *rec = this->map + this->pos;
+      caplen = get32(rec + 8);
+      len = get32(rec + 12);
+      if(caplen > this->fileSize - this->pos - PCAP_RECORD_HEADER_SIZE)
+      {
+         return truncated();
+      }
+      uint32_t frac = get32(rec + 4);
+      ts.tv_sec = get32(rec);
+      ts.tv_usec = this->nsec ? frac / 1000 : frac;
+      frame = rec + PCAP_RECORD_HEADER_SIZE;
+      this->pos += PCAP_RECORD_HEADER_SIZE + caplen;
+      return 0;
+   }
+
+   for(;;)
+   {
+      if(this->pos >= this->fileSize)
+      {
+         return ENODATA;
+      }
+      if(this->fileSize - this->pos < PCAPNG_BLOCK_OVERHEAD)
+      {
+         return truncated();
+      }
+      const uint8_t *block = this->map + this->pos;
+      uint32_t type = get32(block);
+      if(PCAPNG_SHB == type)
+      {
+         //a new section, possibly of the other byte order
+         uint32_t magic;
+         if(this->fileSize - this->pos < PCAPNG_BLOCK_OVERHEAD + 16)
+         {
+            return truncated();
+         }
+         memcpy(&magic, block + 8, sizeof(magic));
+         if((PCAPNG_BYTE_ORDER_MAGIC != magic) && (PCAPNG_BYTE_ORDER_MAGIC != bswap_32(magic)))
+         {
+            fprintf(stderr, "%s: broken section header at %llu\n", this->fileName.c_str(), (unsigned long long)this->pos);
+            return EINVAL;
+         }
+         this->section.swapped = (PCAPNG_BYTE_ORDER_MAGIC != magic);
+         this->section.interfaces.clear();
+         this->sectionOffset = this->pos;
+      }
+
+      uint32_t blockLen = get32(block + 4);
+      if((blockLen < PCAPNG_BLOCK_OVERHEAD) || (0 != (blockLen & 3)))
+      {
+         fprintf(stderr, "%s: broken block at %llu\n", this->fileName.c_str(), (unsigned long long)this->pos);
+         return EINVAL;
+      }
+      if(blockLen > this->fileSize - this->pos)
+      {
+         return truncated();
+      }
+      uint64_t offset = this->pos;
+      this->pos += blockLen;
+
+      if(PCAPNG_IDB == type)
+      {
+         addInterface(block, blockLen, offset);
+      }
+      else if((PCAPNG_EPB == type) && (blockLen >= PCAPNG_EPB_HEADER_SIZE + 4))
+      {
+         uint32_t id = get32(block + 8);
+         if(id >= this->section.interfaces.size())
+         {
+            continue;
+         }
+         const pcapInterface &itf = this->section.interfaces[id];
+         caplen = get32(block + 20);
+         len = get32(block + 24);
+         if((PCAP_LINKTYPE_ETHERNET != itf.linkType) || (caplen > blockLen - PCAPNG_EPB_HEADER_SIZE - 4))
+         {
+            continue;
+         }
+         uint64_t units = ((uint64_t)get32(block + 12) << 32) | get32(block + 16);
+         ts.tv_sec = units / itf.unitsPerSec + itf.tsOffset;
+         ts.tv_usec = (uint64_t)((unsigned __int128)(units % itf.unitsPerSec) * 1000000 / itf.unitsPerSec);
+         frame = block + PCAPNG_EPB_HEADER_SIZE;
+         return 0;
+      }
+      //the other blocks carry no timestamped frames
+   }
+}
+
+/**
+ * Reads the next RTP packet without copying it: data points into the mapping
+ * and stays valid until close().
+ * If end of file is reached the 0 is returned.
+ *
+ * @return amount of data or -1 on error (errno is set to the error code)
+ */
+int PcapLogFile::readView(packetType &type, timeval &ts, const char *&data)
+{
+   type = PACKET_TYPE_RTP;
+   if(this->pending)
+   {
+      this->pending = false;
+      ts = this->pendingTs;
+      data = this->pendingData;
+      return this->pendingSize;
+   }
+
+   for(;;)
+   {
+      uint64_t offset = this->pos;
+      const uint8_t *frame;
+      uint32_t caplen, len;
+      int err = nextFrame(ts, frame, caplen, len);
+      if(0 != err)
+      {
+         if(ENODATA == err)
+         {
+            return 0;
+         }
+         errno = err;
+         return -1;
+      }
+
+      int size;
+      if(!pcapFrameRtp(frame, caplen, len, data, size))
+      {
+         continue;
+      }
+
+      if(offset >= this->indexed)
+      {
+         //the checkpoints of a pcapng capture are kept for the last section only,
+         //they are read with the interfaces of it
+         if(this->ng && (this->sectionOffset != this->indexSectionOffset))
+         {
+            this->index.clear();
+            this->indexSectionOffset = this->sectionOffset;
+         }
+         if(this->index.add(ts, offset) && this->ng)
+         {
+            this->indexSection = this->section;
+         }
+         this->indexed = this->pos;
+      }
+      return size;
+   }
+}
+
+/**
+ * Positions the file so the next read() returns the first packet not earlier
+ * than the given time(or end of file). The scan starts from the nearest checkpoint
+ * of the read part of the capture.
+ *
+ * @return POSIX error code or 0 on success
+ */
+int PcapLogFile::seek(const timeval &ts)
+{
+   int64_t offset = this->index.find(ts);
+   if(offset < 0)
+   {
+      rewind();
+   }
+   else
+   {
+      this->pos = offset;
+      if(this->ng)
+      {
+         this->section = this->indexSection;
+         this->sectionOffset = this->indexSectionOffset;
+      }
+      this->pending = false;
+   }
+
+   for(;;)
+   {
+      packetType type;
+      timeval pktTs;
+      const char *data;
+      int size = readView(type, pktTs, data);
+      if(size <= 0)
+      {
+         return (0 == size) ? 0 : errno;
+      }
+      if(timercmp(&pktTs, &ts, >=))
+      {
+         this->pending = true;
+         this->pendingTs = pktTs;
+         this->pendingData = data;
+         this->pendingSize = size;
+         return 0;
+      }
+   }
+}
@@ -0,0 +1,97 @@
+#ifndef _PCAP_LOG_FILE__
+#define _PCAP_LOG_FILE__
+
+#include <stdint.h>
+#include <time.h>
+#include <sys/time.h>
+
+#include <string>
+#include <vector>
+
+#include "logFile.h"
+#include "eventIndex.h"
+
+/**
+ * Reader of raw network captures, both the classic pcap and the pcapng formats, without
+ * libpcap. The capture is memory mapped and the RTP packets are filtered out of the
+ * Ethernet frames the way logparser does it(@see pcapFrameRtp()), so a capture can be
+ * played without converting it to an events log first. The packets are returned as
+ * views into the mapping, which stay valid until close().
+ * A sparse time index of the read part of the capture is built while reading, seek()
+ * jumps to its nearest checkpoint and scans the capture after the indexed part.
+ */
+class PcapLogFile : public ILogFile
+{
+public:
+   PcapLogFile();
+   ~PcapLogFile();
+
+   /**
+    * Reads the next RTP packet without copying it: data points into the mapping
+    * and stays valid until close().
+    * If end of file is reached the 0 is returned.
+    *
+    * @return amount of data or -1 on error (errno is set to the error code)
+    */
+   int readView(packetType &type, timeval &ts, const char *&data);
+
+   bool persistentView() const { return NULL != map; }
+
+   int rewind();
+   int seek(const timeval &ts);
+   int open(const char* fname);
+   void close();
+
+   /**
+    * @return true if the file starts like a pcap or pcapng capture
+    */
+   static bool probe(const char *fname);
+
+private:
+   PcapLogFile(const PcapLogFile &);
+   PcapLogFile &operator=(const PcapLogFile &);
+
+   struct pcapInterface
+   {
+      uint64_t offset;      //file offset of the interface description block
+      uint32_t linkType;
+      uint64_t unitsPerSec; //timestamp resolution
+      int64_t tsOffset;     //seconds added to the timestamps
+   };
+
+   //pcapng section state, the interfaces are numbered within the section
+   struct pcapSection
+   {
+      bool swapped;
+      std::vector<pcapInterface> interfaces;
+   };
+
+   int nextFrame(timeval &ts, const uint8_t *&frame, uint32_t &caplen, uint32_t &len);
+   void addInterface(const uint8_t *block, uint32_t blockLen, uint64_t offset);
+   int truncated();
+   uint16_t get16(const uint8_t *p) const;
+   uint32_t get32(const uint8_t *p) const;
+
+   std::string fileName;
+   const uint8_t *map;
+   uint64_t fileSize;
+   uint64_t dataOffset;  //the first record(pcap) or block(pcapng)
+   uint64_t pos;         //the next record or block
+   bool ng;              //pcapng capture
+   bool nsec;            //pcap: nanosecond timestamps
+   pcapSection section;  //pcap: only the byte order is used
+   uint64_t sectionOffset;
+
+   EventIndex index;     //RTP packets read before, built while reading
+   uint64_t indexed;     //the index covers the capture up to this offset
+   pcapSection indexSection; //the state the checkpoints are read with
+   uint64_t indexSectionOffset;
+
+   //the packet found by seek(), returned by the next read
+   bool pending;
+   timeval pendingTs;
+   const char *pendingData;
+   int pendingSize;
+};
+
+#endif // _PCAP_LOG_FILE__
@@ -0,0 +1,415 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <errno.h>
+#include <string.h>
+
+#include <time.h>
+#include <sys/time.h>
+
+#include "playbackClock.h"
+
+#define NSEC_PER_SEC  (1000000000ll)
+#define NSEC_PER_USEC (1000ll)
+
+//wakeup slack calibration: amount and length of test sleeps, safety margin added to the result
+#define CALIBRATION_ROUNDS      (200)
+#define CALIBRATION_SLEEP_NSEC  (200000ll)
+#define CALIBRATION_MARGIN_NSEC (10000ll)
+
+/**
+ * Calculate (a - b) time difference in nanoseconds
+ */
+int64_t timespecDiffNsec(const struct timespec *a, const struct timespec *b)
+{
+   return (int64_t)(a->tv_sec - b->tv_sec) * NSEC_PER_SEC + (a->tv_nsec - b->tv_nsec);
+}
+
+/**
+ * Shift the given time by the given amount of nanoseconds
+ */
+void timespecAddNsec(struct timespec *a, int64_t nsec)
+{
+   int64_t total = (int64_t)a->tv_nsec + nsec;
+   a->tv_sec += total / NSEC_PER_SEC;
+   a->tv_nsec = total % NSEC_PER_SEC;
+   if(a->tv_nsec < 0)
+   {
+      a->tv_nsec += NSEC_PER_SEC;
+      a->tv_sec--;
+   }
+}
+
+/**
+ * Sleeps until the given absolute CLOCK_MONOTONIC time.
+ *
+ * @return POSIX error code or 0 on success
+ */
+static int sleepUntil(const struct timespec *deadline)
+{
+   int err;
+   do
+   {
+      err = clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, deadline, NULL);
+   }while(EINTR == err);
+
+   if(0 != err)
+   {
+      fprintf(stderr, "clock_nanosleep() failed(%s)\n", strerror(err));
+   }
+   return err;
+}
+
+static int compareNsec(const void *a, const void *b)
+{
+   int64_t x = *(const int64_t *)a;
+   int64_t y = *(const int64_t *)b;
+   return (x > y) - (x < y);
+}
+
+/**
+ * Resets the time base, the epoch is captured by playbackTimebaseStart().
+ */
+void playbackTimebaseInit(playbackTimebase *base, double speed)
+{
+   memset(&base->epoch, 0, sizeof(base->epoch));
+   memset(&base->logStart, 0, sizeof(base->logStart));
+   memset(&base->pauseStart, 0, sizeof(base->pauseStart));
+   base->speed = speed;
+   base->paused = false;
+   base->stopped = false;
+   base->generation.store(0);
+   pthread_mutex_init(&base->lock, NULL);
+   pthread_cond_init(&base->resumed, NULL);
+}
+
+/**
+ * Releases the time base synchronization objects.
+ */
+void playbackTimebaseDeinit(playbackTimebase *base)
+{
+   pthread_cond_destroy(&base->resumed);
+   pthread_mutex_destroy(&base->lock);
+}
+
+/**
+ * Maps the given log timestamp to the current CLOCK_MONOTONIC time.
+ */
+void playbackTimebaseStart(playbackTimebase *base, const struct timeval *logStart)
+{
+   pthread_mutex_lock(&base->lock);
+   clock_gettime(CLOCK_MONOTONIC, &base->epoch);
+   base->logStart = *logStart;
+   //a pause requested before the start freezes the timeline at the first event
+   base->pauseStart = base->epoch;
+   base->generation.fetch_add(1, std::memory_order_release);
+   pthread_mutex_unlock(&base->lock);
+}
+
+/**
+ * Freezes the timeline: clocks don't return from playbackClockWait() until resume.
+ */
+void playbackTimebasePause(playbackTimebase *base)
+{
+   pthread_mutex_lock(&base->lock);
+   if(!base->paused)
+   {
+      clock_gettime(CLOCK_MONOTONIC, &base->pauseStart);
+      base->paused = true;
+      base->generation.fetch_add(1, std::memory_order_release);
+   }
+   pthread_mutex_unlock(&base->lock);
+}
+
+/**
+ * Shifts the epoch by the time spent in pause and releases the waiting clocks.
+ */
+void playbackTimebaseResume(playbackTimebase *base)
+{
+   pthread_mutex_lock(&base->lock);
+   if(base->paused)
+   {
+      struct timespec now;
+      clock_gettime(CLOCK_MONOTONIC, &now);
+      timespecAddNsec(&base->epoch, timespecDiffNsec(&now, &base->pauseStart));
+      base->paused = false;
+      base->generation.fetch_add(1, std::memory_order_release);
+      pthread_cond_broadcast(&base->resumed);
+   }
+   pthread_mutex_unlock(&base->lock);
+}
+
+/**
+ * Releases the waiting clocks for good, playbackClockWait() fails with ECANCELED.
+ */
+void playbackTimebaseStop(playbackTimebase *base)
+{
+   pthread_mutex_lock(&base->lock);
+   base->stopped = true;
+   base->generation.fetch_add(1, std::memory_order_release);
+   pthread_cond_broadcast(&base->resumed);
+   pthread_mutex_unlock(&base->lock);
+}
+
+/**
+ * @return log time(nsec from the log start) the timeline is at, the pause time if paused
+ */
+int64_t playbackTimebaseElapsed(playbackTimebase *base)
+{
+   pthread_mutex_lock(&base->lock);
+   struct timespec now;
+   if(base->paused)
+   {
+      now = base->pauseStart;
+   }
+   else
+   {
+      clock_gettime(CLOCK_MONOTONIC, &now);
+   }
+   int64_t elapsed = (int64_t)(timespecDiffNsec(&now, &base->epoch) * base->speed);
+   pthread_mutex_unlock(&base->lock);
+   return (elapsed > 0) ? elapsed : 0;
+}
+
+/**
+ * Refreshes the copy of the epoch if the time base changed, blocks while it is paused.
+ *
+ * @return 0 on success or ECANCELED if the time base is stopped
+ */
+static int clockSync(playbackClock *ctx)
+{
+   playbackTimebase *base = ctx->base;
+   if(ctx->generation == base->generation.load(std::memory_order_acquire))
+   {
+      return 0;
+   }
+
+   pthread_mutex_lock(&base->lock);
+   while(base->paused && !base->stopped)
+   {
+      pthread_cond_wait(&base->resumed, &base->lock);
+   }
+   int err = base->stopped ? ECANCELED : 0;
+   ctx->epoch = base->epoch;
+   ctx->generation = base->generation.load(std::memory_order_relaxed);
+   pthread_mutex_unlock(&base->lock);
+   return err;
+}
+
+/**
+ * @return true if the time base changed since the last clockSync()
+ */
+static bool clockChanged(playbackClock *ctx)
+{
+   return ctx->generation != ctx->base->generation.load(std::memory_order_acquire);
+}
+
+/**
+ * Resets the clock statistics and binds the clock to the common time base.
+ */
+void playbackClockInit(playbackClock *ctx, playbackTimebase *base, playbackWaitMode mode)
+{
+   memset(ctx, 0, sizeof(playbackClock));
+   ctx->base = base;
+   ctx->mode = mode;
+   //forces clockSync() to copy the epoch once the time base is started
+   ctx->generation = base->generation.load() - 1;
+}
+
+/**
+ * Measures how late clock_nanosleep() wakes up on this host and uses it
+ * as the HYBRID mode slack. Should be called from the thread which waits on the clock.
+ *
+ * @return the measured slack in nanoseconds
+ */
+int64_t playbackClockCalibrate(playbackClock *ctx)
+{
+   int64_t lateness[CALIBRATION_ROUNDS];
+
+   for(int i=0; i<CALIBRATION_ROUNDS; i++)
+   {
+      struct timespec deadline;
+      clock_gettime(CLOCK_MONOTONIC, &deadline);
+      timespecAddNsec(&deadline, CALIBRATION_SLEEP_NSEC);
+
+      sleepUntil(&deadline);
+
+      struct timespec now;
+      clock_gettime(CLOCK_MONOTONIC, &now);
+      lateness[i] = timespecDiffNsec(&now, &deadline);
+   }
+
+   //99th percentile, a rare longer wakeup is compensated by the deadline not being moved
+   qsort(lateness, CALIBRATION_ROUNDS, sizeof(lateness[0]), compareNsec);
+   ctx->slack = lateness[CALIBRATION_ROUNDS*99/100] + CALIBRATION_MARGIN_NSEC;
+
+   return ctx->slack;
+}
+
+/**
+ * Converts the event timestamp to the absolute CLOCK_MONOTONIC deadline.
+ */
+void playbackClockDeadline(playbackClock *ctx, const struct timeval *ts, struct timespec *deadline)
+{
+   playbackTimebase *base = ctx->base;
+   int64_t offset = (int64_t)(ts->tv_sec - base->logStart.tv_sec) * NSEC_PER_SEC
+                  + (int64_t)(ts->tv_usec - base->logStart.tv_usec) * NSEC_PER_USEC;
+
+   *deadline = ctx->epoch;
+   timespecAddNsec(deadline, (int64_t)(offset / base->speed));
+}
+
+/**
+ * Sleeps until the deadline(minus the clock lead) of the given event timestamp and accounts the wakeup drift.
+ *
+ * @return POSIX error code or 0 on success
+ */
+int playbackClockWait(playbackClock *ctx, const struct timeval *ts)
+{
+   if(PLAYBACK_WAIT_NONE == ctx->mode)
+   {
+      ctx->events++;
+      return clockSync(ctx);
+   }
+
+   struct timespec deadline;
+   struct timespec now;
+   for(;;)
+   {
+      int err = clockSync(ctx);
+      if(0 != err)
+      {
+         return err;
+      }
+
+      playbackClockDeadline(ctx, ts, &deadline);
+      timespecAddNsec(&deadline, -ctx->lead);
+
+      if(PLAYBACK_WAIT_HYBRID == ctx->mode)
+      {
+         struct timespec wakeup = deadline;
+         timespecAddNsec(&wakeup, -ctx->slack);
+
+         err = sleepUntil(&wakeup);
+         if(0 != err)
+         {
+            return err;
+         }
+
+         do
+         {
+            clock_gettime(CLOCK_MONOTONIC, &now);
+         }while((timespecDiffNsec(&now, &deadline) < 0) && !clockChanged(ctx));
+      }
+      else
+      {
+         err = sleepUntil(&deadline);
+         if(0 != err)
+         {
+            return err;
+         }
+         clock_gettime(CLOCK_MONOTONIC, &now);
+      }
+
+      if(!clockChanged(ctx))
+      {
+         break;
+      }
+      //paused or resumed while sleeping, the deadline has moved
+   }
+
+   int64_t drift = timespecDiffNsec(&now, &deadline);
+
+   if((0 == ctx->events) || (drift < ctx->minDrift))
+   {
+      ctx->minDrift = drift;
+   }
+   if((0 == ctx->events) || (drift > ctx->maxDrift))
+   {
+      ctx->maxDrift = drift;
+   }
+   ctx->lastDrift = drift;
+   ctx->sumDrift += drift;
+   ctx->events++;
+
+   int bucket = 0;
+   if(drift >= NSEC_PER_USEC)
+   {
+      bucket = 64 - __builtin_clzll(drift/NSEC_PER_USEC);
+      if(bucket >= PLAYBACK_HISTOGRAM_SIZE)
+      {
+         bucket = PLAYBACK_HISTOGRAM_SIZE - 1;
+      }
+   }
+   ctx->histogram[bucket]++;
+
+   return 0;
+}
+
+/**
+ * Accounts the size of the sent event for the throughput statistics.
+ */
+void playbackClockAccount(playbackClock *ctx, int size)
+{
+   ctx->sentEvents++;
+   ctx->sentBytes += size;
+   clock_gettime(CLOCK_MONOTONIC, &ctx->lastSent);
+}
+
+/**
+ * Prints the drift statistics and the lateness histogram collected since playbackClockInit().
+ */
+void playbackClockReport(playbackClock *ctx, FILE *out)
+{
+   if(0 == ctx->events)
+   {
+      fprintf(out, "No events were played\n");
+      return;
+   }
+
+   double elapsed = timespecDiffNsec(&ctx->lastSent, &ctx->epoch)/1e9;
+   if(elapsed > 0)
+   {
+      fprintf(out, "Sent %llu events(%llu bytes) in %.3f sec: %.0f events/s, %.2f Mbit/s\n"
+              , (unsigned long long)ctx->sentEvents, (unsigned long long)ctx->sentBytes, elapsed
+              , ctx->sentEvents/elapsed, ctx->sentBytes*8/elapsed/1e6);
+   }
+
+   if(PLAYBACK_WAIT_NONE == ctx->mode)
+   {
+      fprintf(out, "Played unthrottled\n");
+      return;
+   }
+
+   fprintf(out, "Waited for %llu deadlines, drift(usec): last %.1f min %.1f max %.1f mean %.1f\n"
+           , (unsigned long long)ctx->events
+           , ctx->lastDrift/1e3, ctx->minDrift/1e3, ctx->maxDrift/1e3
+           , (double)ctx->sumDrift/ctx->events/1e3);
+
+   if(PLAYBACK_WAIT_HYBRID == ctx->mode)
+   {
+      fprintf(out, "Wait mode: hybrid(slack %.1f usec), speed %.2fx\n", ctx->slack/1e3, ctx->base->speed);
+   }
+   else
+   {
+      fprintf(out, "Wait mode: sleep, speed %.2fx\n", ctx->base->speed);
+   }
+
+   fprintf(out, "Lateness histogram(usec):\n");
+   for(int i=0; i<PLAYBACK_HISTOGRAM_SIZE; i++)
+   {
+      if(0 == ctx->histogram[i])
+      {
+         continue;
+      }
+      uint64_t from = (0 == i) ? 0 : (1ull << (i - 1));
+      if(PLAYBACK_HISTOGRAM_SIZE - 1 == i)
+      {
+         fprintf(out, "   [%6llu,    inf): %llu\n", (unsigned long long)from, (unsigned long long)ctx->histogram[i]);
+      }
+      else
+      {
+         fprintf(out, "   [%6llu, %6llu): %llu\n", (unsigned long long)from, 1ull << i, (unsigned long long)ctx->histogram[i]);
+      }
+   }
+}
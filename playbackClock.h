@@ -0,0 +1,163 @@
+#ifndef _PLAYBACK_CLOCK_H
+#define _PLAYBACK_CLOCK_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <time.h>
+#include <sys/time.h>
+#include <pthread.h>
+
+#include <atomic>
+
+/**
+ * The way the playback thread waits for an event deadline:
+ *  SLEEP  - clock_nanosleep() until the deadline;
+ *  HYBRID - clock_nanosleep() until the calibrated wakeup slack before the deadline,
+ *           then busy-poll the clock. Trades CPU time for wakeup precision;
+ *  NONE   - don't wait at all, events are sent as fast as the sockets accept them.
+ */
+enum playbackWaitMode
+{
+   PLAYBACK_WAIT_SLEEP = 0,
+   PLAYBACK_WAIT_HYBRID,
+   PLAYBACK_WAIT_NONE,
+   PLAYBACK_WAIT_MODE_MAX
+};
+
+//lateness histogram buckets: [0,1)us, [1,2)us, [2,4)us, ... [2^(N-2), inf)us
+#define PLAYBACK_HISTOGRAM_SIZE (16)
+
+/**
+ * Common time base of all playback clocks: the log start timestamp is mapped to the
+ * epoch, so all buses schedule their events against the same timeline.
+ * Pause freezes the timeline, resume shifts the epoch by the paused time, so the
+ * playback goes on from the event it was paused at.
+ */
+typedef struct
+{
+   struct timespec epoch;   //CLOCK_MONOTONIC time the first event is scheduled at
+   struct timeval logStart; //timestamp of the first event in the log
+   double speed;            //playback speed factor, 2.0 - log time runs twice as fast
+
+   pthread_mutex_t lock;    //guards the epoch and the pause state
+   pthread_cond_t resumed;
+   bool paused;
+   bool stopped;            //waiting clocks are released and fail
+   struct timespec pauseStart;
+   std::atomic<uint32_t> generation; //incremented on every epoch or pause state change
+}playbackTimebase;
+
+/**
+ * Maps log event timestamps to absolute CLOCK_MONOTONIC deadlines. The epoch is
+ * captured once by the time base, every deadline is computed from it, so the wakeup
+ * error of one event is never carried over to the next one. Each bus owns a clock
+ * and so its own lateness statistics.
+ */
+typedef struct
+{
+   playbackTimebase *base;
+
+   playbackWaitMode mode;
+   int64_t slack;           //HYBRID: time before the deadline to stop sleeping at(nsec)
+   int64_t lead;            //wake up earlier than the deadline, the sender paces itself(nsec)
+
+   //copy of the time base epoch, refreshed once its generation changes
+   struct timespec epoch;
+   uint32_t generation;
+
+   //drift(actual wakeup - deadline) statistics in nanoseconds
+   uint64_t events;
+   int64_t lastDrift;
+   int64_t minDrift;
+   int64_t maxDrift;
+   int64_t sumDrift;
+   uint64_t histogram[PLAYBACK_HISTOGRAM_SIZE];
+
+   //throughput statistics
+   uint64_t sentEvents;
+   uint64_t sentBytes;
+   struct timespec lastSent;
+}playbackClock;
+
+/**
+ * Resets the time base, the epoch is captured by playbackTimebaseStart().
+ */
+void playbackTimebaseInit(playbackTimebase *base, double speed);
+
+/**
+ * Releases the time base synchronization objects.
+ */
+void playbackTimebaseDeinit(playbackTimebase *base);
+
+/**
+ * Maps the given log timestamp to the current CLOCK_MONOTONIC time.
+ */
+void playbackTimebaseStart(playbackTimebase *base, const struct timeval *logStart);
+
+/**
+ * Freezes the timeline: clocks don't return from playbackClockWait() until resume.
+ */
+void playbackTimebasePause(playbackTimebase *base);
+
+/**
+ * Shifts the epoch by the time spent in pause and releases the waiting clocks.
+ */
+void playbackTimebaseResume(playbackTimebase *base);
+
+/**
+ * Releases the waiting clocks for good, playbackClockWait() fails with ECANCELED.
+ */
+void playbackTimebaseStop(playbackTimebase *base);
+
+/**
+ * @return log time(nsec from the log start) the timeline is at, the pause time if paused
+ */
+int64_t playbackTimebaseElapsed(playbackTimebase *base);
+
+/**
+ * Resets the clock statistics and binds the clock to the common time base.
+ */
+void playbackClockInit(playbackClock *ctx, playbackTimebase *base, playbackWaitMode mode);
+
+/**
+ * Measures how late clock_nanosleep() wakes up on this host and uses it
+ * as the HYBRID mode slack. Should be called from the thread which waits on the clock.
+ *
+ * @return the measured slack in nanoseconds
+ */
+int64_t playbackClockCalibrate(playbackClock *ctx);
+
+/**
+ * Converts the event timestamp to the absolute CLOCK_MONOTONIC deadline.
+ */
+void playbackClockDeadline(playbackClock *ctx, const struct timeval *ts, struct timespec *deadline);
+
+/**
+ * Sleeps until the deadline(minus the clock lead) of the given event timestamp and accounts the wakeup drift.
+ * If the time base is paused meanwhile, waits for resume and sleeps until the shifted deadline.
+ *
+ * @return POSIX error code or 0 on success, ECANCELED if the time base is stopped
+ */
+int playbackClockWait(playbackClock *ctx, const struct timeval *ts);
+
+/**
+ * Accounts the size of the sent event for the throughput statistics.
+ */
+void playbackClockAccount(playbackClock *ctx, int size);
+
+/**
+ * Prints the drift statistics and the lateness histogram collected since playbackClockInit().
+ */
+void playbackClockReport(playbackClock *ctx, FILE *out);
+
+/**
+ * Calculate (a - b) time difference in nanoseconds
+ */
+int64_t timespecDiffNsec(const struct timespec *a, const struct timespec *b);
+
+/**
+ * Shift the given time by the given amount of nanoseconds
+ */
+void timespecAddNsec(struct timespec *a, int64_t nsec);
+
+#endif // _PLAYBACK_CLOCK_H
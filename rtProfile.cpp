@@ -0,0 +1,225 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+
+#include <sched.h>
+#include <pthread.h>
+#include <time.h>
+#include <sys/mman.h>
+
+#include "rtProfile.h"
+#include "playbackClock.h"
+
+//stack size of the bus threads, all of it is pre-faulted
+#define RT_THREAD_STACK_SIZE  (256*1024)
+//part of the stack which is touched by the thread itself, the rest is used by the libc
+#define RT_THREAD_STACK_TOUCH (192*1024)
+
+//scheduling latency measurement: amount and length of test sleeps
+#define LATENCY_ROUNDS     (500)
+#define LATENCY_SLEEP_NSEC (100000ll)
+
+/**
+ * Parses comma separated list of core numbers like "2,3".
+ *
+ * @return POSIX error code or 0 on success
+ */
+int rtProfileParseCpus(rtProfile *ctx, const char *list)
+{
+   ctx->cpuCount = 0;
+   const char *p = list;
+   while(*p)
+   {
+      char *end;
+      long cpu = strtol(p, &end, 10);
+      if((end == p) || (cpu < 0) || (cpu >= CPU_SETSIZE) || (ctx->cpuCount >= RT_PROFILE_MAX_CPUS))
+      {
+         return EINVAL;
+      }
+      ctx->cpus[ctx->cpuCount++] = (int)cpu;
+
+      p = end;
+      if(',' == *p)
+      {
+         p++;
+      }
+      else if(*p)
+      {
+         return EINVAL;
+      }
+   }
+
+   return (0 == ctx->cpuCount) ? EINVAL : 0;
+}
+
+/**
+ * Process wide part of the profile, should be called from the main thread before
+ * any other thread is created: locks current and future memory(the future one only
+ * with MCL_ONFAULT) if the real-time priority is requested and moves the calling
+ * thread off the pinned cores if isolation is requested. Threads created later
+ * inherit the calling thread affinity.
+ *
+ * @return POSIX error code or 0 on success
+ */
+int rtProfileProcessInit(const rtProfile *ctx)
+{
+   if(0 != ctx->priority)
+   {
+      //future mappings are locked page by page once touched instead of being populated
+      //at once, so a mapped log isn't read into memory as a whole. The rings and the
+      //bus thread stacks are pre-faulted explicitly.
+      int err = EINVAL;
+#ifdef MCL_ONFAULT
+      err = (-1 == mlockall(MCL_CURRENT | MCL_FUTURE | MCL_ONFAULT)) ? errno : 0;
+#endif
+      if(0 != err)
+      {
+         //MCL_FUTURE alone would populate and lock a mapped log of any size as a whole
+         fprintf(stderr, "mlockall(MCL_ONFAULT) failed(%s), only the current memory is locked\n", strerror(err));
+         if(-1 == mlockall(MCL_CURRENT))
+         {
+            fprintf(stderr, "mlockall() failed(%s)\n", strerror(errno));
+            return errno;
+         }
+      }
+   }
+
+   if(ctx->isolate && (0 != ctx->cpuCount))
+   {
+      cpu_set_t set;
+      int err = pthread_getaffinity_np(pthread_self(), sizeof(set), &set);
+      if(0 != err)
+      {
+         fprintf(stderr, "pthread_getaffinity_np() failed(%s)\n", strerror(err));
+         return err;
+      }
+      for(int i=0; i<ctx->cpuCount; i++)
+      {
+         CPU_CLR(ctx->cpus[i], &set);
+      }
+      if(0 == CPU_COUNT(&set))
+      {
+         fprintf(stderr, "No cores are left for the RTSP server thread\n");
+         return EINVAL;
+      }
+      err = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+      if(0 != err)
+      {
+         fprintf(stderr, "pthread_setaffinity_np() failed(%s)\n", strerror(err));
+         return err;
+      }
+   }
+
+   return 0;
+}
+
+/**
+ * Fills the attributes for the index-th bus thread: SCHED_FIFO priority and
+ * the core it is pinned to.
+ *
+ * @return POSIX error code or 0 on success
+ */
+int rtProfileThreadAttr(const rtProfile *ctx, int index, pthread_attr_t *attr)
+{
+   int err = pthread_attr_setstacksize(attr, RT_THREAD_STACK_SIZE);
+   if(0 != err)
+   {
+      fprintf(stderr, "pthread_attr_setstacksize() failed(%s)\n", strerror(err));
+      return err;
+   }
+
+   if(0 != ctx->priority)
+   {
+      struct sched_param param;
+      memset(&param, 0, sizeof(param));
+      param.sched_priority = ctx->priority;
+
+      err = pthread_attr_setinheritsched(attr, PTHREAD_EXPLICIT_SCHED);
+      if(0 == err)
+      {
+         err = pthread_attr_setschedpolicy(attr, SCHED_FIFO);
+      }
+      if(0 == err)
+      {
+         err = pthread_attr_setschedparam(attr, &param);
+      }
+      if(0 != err)
+      {
+         fprintf(stderr, "SCHED_FIFO(%i) configuration failed(%s)\n", ctx->priority, strerror(err));
+         return err;
+      }
+   }
+
+   if(0 != ctx->cpuCount)
+   {
+      cpu_set_t set;
+      CPU_ZERO(&set);
+      CPU_SET(ctx->cpus[index % ctx->cpuCount], &set);
+      err = pthread_attr_setaffinity_np(attr, sizeof(set), &set);
+      if(0 != err)
+      {
+         fprintf(stderr, "pthread_attr_setaffinity_np() failed(%s)\n", strerror(err));
+         return err;
+      }
+   }
+
+   return 0;
+}
+
+/**
+ * Touches the stack, so no page fault happens once the playback is started.
+ */
+static void prefaultStack()
+{
+   volatile char stack[RT_THREAD_STACK_TOUCH];
+   memset((char *)stack, 0, sizeof(stack));
+}
+
+/**
+ * Called by the bus thread itself: pre-faults its stack, measures the wakeup
+ * latency it observes and prints it together with the effective policy and core.
+ */
+void rtProfileThreadInit(const rtProfile *ctx, const char *name, FILE *out)
+{
+   if((0 == ctx->priority) && (0 == ctx->cpuCount))
+   {
+      return;
+   }
+
+   prefaultStack();
+
+   int64_t minLatency = INT64_MAX;
+   int64_t maxLatency = 0;
+   int64_t sumLatency = 0;
+   for(int i=0; i<LATENCY_ROUNDS; i++)
+   {
+      struct timespec deadline;
+      clock_gettime(CLOCK_MONOTONIC, &deadline);
+      timespecAddNsec(&deadline, LATENCY_SLEEP_NSEC);
+
+      while(EINTR == clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &deadline, NULL));
+
+      struct timespec now;
+      clock_gettime(CLOCK_MONOTONIC, &now);
+      int64_t latency = timespecDiffNsec(&now, &deadline);
+      if(latency < minLatency)
+      {
+         minLatency = latency;
+      }
+      if(latency > maxLatency)
+      {
+         maxLatency = latency;
+      }
+      sumLatency += latency;
+   }
+
+   int policy;
+   struct sched_param param;
+   pthread_getschedparam(pthread_self(), &policy, &param);
+
+   fprintf(out, "%s: %s priority %i on cpu %i, scheduling latency(usec): min %.1f avg %.1f max %.1f\n"
+           , name, (SCHED_FIFO == policy) ? "SCHED_FIFO" : "SCHED_OTHER", param.sched_priority, sched_getcpu()
+           , minLatency/1e3, (double)sumLatency/LATENCY_ROUNDS/1e3, maxLatency/1e3);
+}
@@ -0,0 +1,56 @@
+#ifndef _RT_PROFILE_H
+#define _RT_PROFILE_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <pthread.h>
+
+//max amount of cores the bus threads may be pinned to
+#define RT_PROFILE_MAX_CPUS (16)
+
+/**
+ * Real-time execution profile of the playback(bus sender) threads: scheduling policy,
+ * CPU pinning and memory locking to keep them from being preempted or page-faulting
+ * in the middle of a replay.
+ */
+typedef struct
+{
+   int priority;                  //SCHED_FIFO priority of the bus threads, 0 - default scheduling
+   int cpus[RT_PROFILE_MAX_CPUS]; //cores the bus threads are pinned to(round robin)
+   int cpuCount;                  //0 - no pinning
+   bool isolate;                  //keep the other threads(RTSP server, log reader) off the pinned cores
+}rtProfile;
+
+/**
+ * Parses comma separated list of core numbers like "2,3".
+ *
+ * @return POSIX error code or 0 on success
+ */
+int rtProfileParseCpus(rtProfile *ctx, const char *list);
+
+/**
+ * Process wide part of the profile, should be called from the main thread before
+ * any other thread is created: locks current and future memory(the future one only
+ * with MCL_ONFAULT) if the real-time priority is requested and moves the calling
+ * thread off the pinned cores if isolation is requested. Threads created later
+ * inherit the calling thread affinity.
+ *
+ * @return POSIX error code or 0 on success
+ */
+int rtProfileProcessInit(const rtProfile *ctx);
+
+/**
+ * Fills the attributes for the index-th bus thread: SCHED_FIFO priority and
+ * the core it is pinned to.
+ *
+ * @return POSIX error code or 0 on success
+ */
+int rtProfileThreadAttr(const rtProfile *ctx, int index, pthread_attr_t *attr);
+
+/**
+ * Called by the bus thread itself: pre-faults its stack, measures the wakeup
+ * latency it observes and prints it together with the effective policy and core.
+ */
+void rtProfileThreadInit(const rtProfile *ctx, const char *name, FILE *out);
+
+#endif // _RT_PROFILE_H
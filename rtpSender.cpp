@@ -17,21 +17,288 @@
 #include <arpa/inet.h>
 
 #include <time.h>
+#include <net/if.h>
+
+#include <linux/net_tstamp.h>
+#include <linux/errqueue.h>
+#include <linux/rtnetlink.h>
 
 #include "eventlog.h"
 #include "rtpSender.h"
 
+#define SWAP2(i)           ((((i)& 0x00FF)<<8) | (((i)& 0xFF00)>>8))
 #define SWAP4(i)           (((i)<<24) | (((i)& 0x0000FF00)<<8) | (((i)& 0x00FF0000)>>8) | ((i)>>24) )
 
+//the socket error queue is checked for SO_TXTIME drops once per the given amount of syscalls
+#define TXTIME_ERRQUEUE_PERIOD (64)
+
+/**
+ * Finds the interface the packets to the given address are routed through: the route
+ * is resolved by the kernel with RTM_GETROUTE, like 'ip route get' does, so a local
+ * destination resolves to lo and an address shared by several interfaces doesn't matter.
+ *
+ * @return interface index or 0 on failure
+ */
+static unsigned int egressInterface(const struct sockaddr_in *dst)
+{
+   int fd = socket(AF_NETLINK, SOCK_RAW | SOCK_CLOEXEC, NETLINK_ROUTE);
+   if(-1 == fd)
+   {
+      return 0;
+   }
+
+   struct
+   {
+      struct nlmsghdr hdr;
+      struct rtmsg rtm;
+      char attrs[RTA_SPACE(sizeof(struct in_addr))];
+   }req;
+   memset(&req, 0, sizeof(req));
+   req.hdr.nlmsg_len = NLMSG_LENGTH(sizeof(struct rtmsg));
+   req.hdr.nlmsg_type = RTM_GETROUTE;
+   req.hdr.nlmsg_flags = NLM_F_REQUEST;
+   req.rtm.rtm_family = AF_INET;
+   req.rtm.rtm_dst_len = 32;
+   struct rtattr *rta = (struct rtattr *)((char *)&req + NLMSG_ALIGN(req.hdr.nlmsg_len));
+   rta->rta_type = RTA_DST;
+   rta->rta_len = RTA_LENGTH(sizeof(struct in_addr));
+   memcpy(RTA_DATA(rta), &dst->sin_addr, sizeof(struct in_addr));
+   req.hdr.nlmsg_len = NLMSG_ALIGN(req.hdr.nlmsg_len) + rta->rta_len;
+
+   if(-1 == send(fd, &req, req.hdr.nlmsg_len, 0))
+   {
+      close(fd);
+      return 0;
+   }
+
+   unsigned int index = 0;
+   char buf[4096];
+   int len = recv(fd, buf, sizeof(buf), 0);
+   close(fd);
+   struct nlmsghdr *hdr = (struct nlmsghdr *)buf;
+   if((len <= 0) || !NLMSG_OK(hdr, (unsigned int)len) || (RTM_NEWROUTE != hdr->nlmsg_type))
+   {
+      return 0;
+   }
+
+   struct rtmsg *rtm = (struct rtmsg *)NLMSG_DATA(hdr);
+   int attrLen = RTM_PAYLOAD(hdr);
+   for(rta = RTM_RTA(rtm); RTA_OK(rta, attrLen); rta = RTA_NEXT(rta, attrLen))
+   {
+      if(RTA_OIF == rta->rta_type)
+      {
+         index = *(const uint32_t *)RTA_DATA(rta);
+         break;
+      }
+   }
+   return index;
+}
+
+/**
+ * Dumps the qdiscs of the given interface with rtnetlink and looks for one which
+ * honors SO_TXTIME launch times.
+ *
+ * @return CLOCK_TAI if the etf qdisc is found, CLOCK_MONOTONIC for fq, -1 if none of them
+ */
+static clockid_t txtimeQdiscClock(unsigned int ifindex)
+{
+   int fd = socket(AF_NETLINK, SOCK_RAW | SOCK_CLOEXEC, NETLINK_ROUTE);
+   if(-1 == fd)
+   {
+      return -1;
+   }
+
+   struct
+   {
+      struct nlmsghdr hdr;
+      struct tcmsg tcm;
+   }req;
+   memset(&req, 0, sizeof(req));
+   req.hdr.nlmsg_len = NLMSG_LENGTH(sizeof(struct tcmsg));
+   req.hdr.nlmsg_type = RTM_GETQDISC;
+   req.hdr.nlmsg_flags = NLM_F_REQUEST | NLM_F_DUMP;
+   req.tcm.tcm_family = AF_UNSPEC;
+
+   if(-1 == send(fd, &req, req.hdr.nlmsg_len, 0))
+   {
+      close(fd);
+      return -1;
+   }
+
+   clockid_t clock = -1;
+   bool done = false;
+   char buf[8192];
+   while(!done)
+   {
+      int len = recv(fd, buf, sizeof(buf), 0);
+      if(len <= 0)
+      {
+         break;
+      }
+
+      for(struct nlmsghdr *hdr = (struct nlmsghdr *)buf; NLMSG_OK(hdr, (unsigned int)len); hdr = NLMSG_NEXT(hdr, len))
+      {
+         if((NLMSG_DONE == hdr->nlmsg_type) || (NLMSG_ERROR == hdr->nlmsg_type))
+         {
+            done = true;
+            break;
+         }
+         struct tcmsg *tcm = (struct tcmsg *)NLMSG_DATA(hdr);
+         if((RTM_NEWQDISC != hdr->nlmsg_type) || ((unsigned int)tcm->tcm_ifindex != ifindex))
+         {
+            continue;
+         }
+
+         int attrLen = hdr->nlmsg_len - NLMSG_LENGTH(sizeof(struct tcmsg));
+         for(struct rtattr *attr = (struct rtattr *)((char *)tcm + NLMSG_ALIGN(sizeof(struct tcmsg))); RTA_OK(attr, attrLen); attr = RTA_NEXT(attr, attrLen))
+         {
+            if(TCA_KIND != attr->rta_type)
+            {
+               continue;
+            }
+            const char *kind = (const char *)RTA_DATA(attr);
+            if(0 == strcmp(kind, "etf"))
+            {
+               clock = CLOCK_TAI;
+            }
+            else if((0 == strcmp(kind, "fq")) && (-1 == clock))
+            {
+               clock = CLOCK_MONOTONIC;
+            }
+         }
+      }
+   }
+
+   close(fd);
+   return clock;
+}
+
+/**
+ * Enables SO_TXTIME on the socket if the egress qdisc supports it.
+ *
+ * @return true if launch times will be honored
+ */
+static bool txtimeInit(rtpSender *ctx)
+{
+   unsigned int ifindex = egressInterface(&ctx->sockAddr);
+   if(0 == ifindex)
+   {
+      fprintf(stderr, "SO_TXTIME: unable to find the egress interface, fall back to user space pacing\n");
+      return false;
+   }
+
+   char ifname[IF_NAMESIZE] = "";
+   if_indextoname(ifindex, ifname);
+
+   clockid_t clock = txtimeQdiscClock(ifindex);
+   if(-1 == clock)
+   {
+      fprintf(stderr, "SO_TXTIME: neither etf nor fq qdisc is configured on %s, fall back to user space pacing\n", ifname);
+      return false;
+   }
+
+   struct sock_txtime cfg;
+   cfg.clockid = clock;
+   cfg.flags = SOF_TXTIME_REPORT_ERRORS;
+   if(-1 == setsockopt(ctx->socket, SOL_SOCKET, SO_TXTIME, &cfg, sizeof(cfg)))
+   {
+      fprintf(stderr, "setsockopt(SO_TXTIME) failed(%s), fall back to user space pacing\n", strerror(errno));
+      return false;
+   }
+
+   ctx->txtimeClock = clock;
+   ctx->txtimeOffset = 0;
+   if(CLOCK_MONOTONIC != clock)
+   {
+      struct timespec mono, other;
+      clock_gettime(CLOCK_MONOTONIC, &mono);
+      clock_gettime(clock, &other);
+      ctx->txtimeOffset = (int64_t)(other.tv_sec - mono.tv_sec) * 1000000000ll + (other.tv_nsec - mono.tv_nsec);
+   }
+
+   printf("SO_TXTIME: launch times are handled by %s qdisc on %s\n", (CLOCK_TAI == clock) ? "etf" : "fq", ifname);
+   return true;
+}
+
+/**
+ * Attaches the SCM_TXTIME launch time control message to the message header.
+ */
+static void txtimeSetControl(rtpSender *ctx, struct msghdr *msg, char *control, size_t controlSize
+                             , const struct timespec *launchTime)
+{
+   uint64_t txtime = (uint64_t)launchTime->tv_sec * 1000000000ull + launchTime->tv_nsec + ctx->txtimeOffset;
+
+   msg->msg_control = control;
+   msg->msg_controllen = controlSize;
+
+   struct cmsghdr *cmsg = CMSG_FIRSTHDR(msg);
+   cmsg->cmsg_level = SOL_SOCKET;
+   cmsg->cmsg_type = SCM_TXTIME;
+   cmsg->cmsg_len = CMSG_LEN(sizeof(uint64_t));
+   memcpy(CMSG_DATA(cmsg), &txtime, sizeof(uint64_t));
+}
+
+/**
+ * Drains the socket error queue and counts packets the qdisc dropped because their
+ * launch time was missed or invalid.
+ */
+static void txtimeCheckErrors(rtpSender *ctx)
+{
+   for(;;)
+   {
+      char control[256];
+      char data[64];
+      struct iovec iov = {data, sizeof(data)};
+      struct msghdr msg;
+      memset(&msg, 0, sizeof(msg));
+      msg.msg_iov = &iov;
+      msg.msg_iovlen = 1;
+      msg.msg_control = control;
+      msg.msg_controllen = sizeof(control);
+
+      if(-1 == recvmsg(ctx->socket, &msg, MSG_ERRQUEUE | MSG_DONTWAIT))
+      {
+         return;
+      }
+
+      for(struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg); NULL != cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg))
+      {
+         struct sock_extended_err *err = (struct sock_extended_err *)CMSG_DATA(cmsg);
+         if(SO_EE_ORIGIN_TXTIME == err->ee_origin)
+         {
+            ctx->txtimeDrops++;
+         }
+      }
+   }
+}
+
 /**
  * Initializes UDP socket, convert the addr string to numeric representation.
- * The given TTP:SSRC is used for all sent packet.
+ * The given TTP:SSRC is used for all sent packet. RTP timestamps are scaled
+ * by the given playback speed factor(1.0 - keep the original timestamps).
+ *
+ * If txtime is set the socket is configured for SO_TXTIME launch times, but only when
+ * the egress interface has the etf or fq qdisc which honors them. Otherwise the sender
+ * falls back to immediate transmission and ctx->txtime is cleared.
  *
  * @return POSIX error code or 0 on success
  */
-int rtpSenderInit(rtpSender *ctx, const char* addr, int port, uint32_t ssrc)
+int rtpSenderInit(rtpSender *ctx, const char* addr, int port, uint32_t ssrc, double speed, bool txtime)
 {
    ctx->ssrc = ssrc;
+   ctx->speed = speed;
+   ctx->tsBaseValid = false;
+   ctx->rewound = false;
+   ctx->outValid = false;
+   ctx->seqOffset = 0;
+   ctx->tsOffset = 0;
+   ctx->tsStep = 0;
+   ctx->batched = 0;
+   ctx->syscalls = 0;
+   ctx->packets = 0;
+   memset(ctx->batchHistogram, 0, sizeof(ctx->batchHistogram));
+   ctx->txtime = false;
+   ctx->txtimeDrops = 0;
 
    ctx->socket = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
    if(-1 == ctx->socket)
@@ -51,29 +318,237 @@ int rtpSenderInit(rtpSender *ctx, const char* addr, int port, uint32_t ssrc)
       return errno;
    }
 
+   if(txtime)
+   {
+      ctx->txtime = txtimeInit(ctx);
+   }
+
    return 0;
 }
 
 /**
- * Set the TTP:SSRC to the given ID and send the packet as UDP stream.
- *
- * @return POSIX error code or 0 on success
+ * Accounts a syscall which sent the given amount of packets.
+ */
+static void accountSyscall(rtpSender *ctx, int packets)
+{
+   ctx->syscalls++;
+   ctx->packets += packets;
+
+   if(ctx->txtime && (0 == ctx->syscalls % TXTIME_ERRQUEUE_PERIOD))
+   {
+      txtimeCheckErrors(ctx);
+   }
+
+   int bucket = 31 - __builtin_clz(packets);
+   if(bucket >= RTP_SENDER_BATCH_HISTOGRAM_SIZE)
+   {
+      bucket = RTP_SENDER_BATCH_HISTOGRAM_SIZE - 1;
+   }
+   ctx->batchHistogram[bucket]++;
+}
+
+/**
+ * Set the TTP:SSRC to the given ID, scale the RTP timestamp to the playback speed
+ * and shift the sequence number and timestamp to keep them continuous across loops.
  */
-int rtpSenderSend(rtpSender *ctx, const char *buf, const int size)
+static void prepareHeader(rtpSender *ctx, const char *buf)
 {
    rtpHeader *rtp = (rtpHeader *)buf;
 
    rtp->ssrc = SWAP4(ctx->ssrc);
 
-   int err = sendto(ctx->socket, buf, size, 0, (struct sockaddr *)&ctx->sockAddr, sizeof(sockaddr_in));
+   uint32_t ts = SWAP4(rtp->ts);
+   if(1.0 != ctx->speed)
+   {
+      if(!ctx->tsBaseValid)
+      {
+         ctx->tsBase = ts;
+         ctx->tsPrev = ts;
+         ctx->tsDelta = 0;
+         ctx->tsBaseValid = true;
+      }
+      if(ctx->rewound)
+      {
+         //the jump back to the log start is covered by tsOffset
+         ctx->tsPrev = ts;
+      }
+      ctx->tsDelta += (int32_t)(ts - ctx->tsPrev);
+      ctx->tsPrev = ts;
+
+      ts = ctx->tsBase + (uint32_t)(int64_t)(ctx->tsDelta / ctx->speed);
+   }
+
+   uint16_t seq = SWAP2(rtp->seq);
+   if(ctx->rewound && ctx->outValid)
+   {
+      ctx->seqOffset = ctx->seqLast + 1 - seq;
+      ctx->tsOffset = ctx->tsLast + ctx->tsStep - ts;
+   }
+   ctx->rewound = false;
+
+   seq += ctx->seqOffset;
+   ts += ctx->tsOffset;
+   if(ctx->outValid && ((int32_t)(ts - ctx->tsLast) > 0))
+   {
+      ctx->tsStep = ts - ctx->tsLast;
+   }
+   ctx->seqLast = seq;
+   ctx->tsLast = ts;
+   ctx->outValid = true;
+
+   rtp->seq = SWAP2(seq);
+   rtp->ts = SWAP4(ts);
+}
+
+/**
+ * Set the TTP:SSRC to the given ID, scale the RTP timestamp to the playback speed
+ * and send the packet as UDP stream. If SO_TXTIME is enabled and the launch
+ * time(CLOCK_MONOTONIC) is given the kernel sends the packet at that time.
+ * The packet may be split: buf holds the RTP header and the tail(if not NULL)
+ * the rest of the packet, which is sent as is without copying.
+ *
+ * @return POSIX error code or 0 on success
+ */
+int rtpSenderSend(rtpSender *ctx, const char *buf, const int size, const char *tail, const int tailSize
+                  , const struct timespec *launchTime)
+{
+   prepareHeader(ctx, buf);
+
+   int err;
+   bool paced = ctx->txtime && (NULL != launchTime);
+   if(paced || (NULL != tail))
+   {
+      struct iovec iov[2] = {{(void *)buf, (size_t)size}, {(void *)tail, (size_t)tailSize}};
+      struct msghdr msg;
+      memset(&msg, 0, sizeof(msg));
+      msg.msg_name = &ctx->sockAddr;
+      msg.msg_namelen = sizeof(sockaddr_in);
+      msg.msg_iov = iov;
+      msg.msg_iovlen = (NULL != tail) ? 2 : 1;
+      if(paced)
+      {
+         txtimeSetControl(ctx, &msg, ctx->batchControl[0], sizeof(ctx->batchControl[0]), launchTime);
+      }
+
+      err = sendmsg(ctx->socket, &msg, 0);
+   }
+   else
+   {
+      err = sendto(ctx->socket, buf, size, 0, (struct sockaddr *)&ctx->sockAddr, sizeof(sockaddr_in));
+   }
    if(-1 == err)
    {
-      fprintf(stderr,"sendto() failed(%s)\n", strerror(errno));
+      fprintf(stderr,"send() failed(%s)\n", strerror(errno));
       return errno;
    }
+   accountSyscall(ctx, 1);
    return 0;
 }
 
+/**
+ * Prepare the packet like rtpSenderSend() does and add it to the batch to be sent
+ * with a single syscall by rtpSenderFlush(). The buffers should stay valid until then.
+ *
+ * @return POSIX error code or 0 on success, ENOBUFS if the batch is full
+ */
+int rtpSenderQueue(rtpSender *ctx, const char *buf, const int size, const char *tail, const int tailSize
+                   , const struct timespec *launchTime)
+{
+   if(ctx->batched >= RTP_SENDER_BATCH_MAX)
+   {
+      return ENOBUFS;
+   }
+
+   prepareHeader(ctx, buf);
+
+   struct iovec *iov = ctx->batchIov[ctx->batched];
+   iov[0].iov_base = (void *)buf;
+   iov[0].iov_len = size;
+   iov[1].iov_base = (void *)tail;
+   iov[1].iov_len = tailSize;
+
+   struct mmsghdr *msg = &ctx->batch[ctx->batched];
+   memset(msg, 0, sizeof(struct mmsghdr));
+   msg->msg_hdr.msg_name = &ctx->sockAddr;
+   msg->msg_hdr.msg_namelen = sizeof(sockaddr_in);
+   msg->msg_hdr.msg_iov = iov;
+   msg->msg_hdr.msg_iovlen = (NULL != tail) ? 2 : 1;
+   if(ctx->txtime && (NULL != launchTime))
+   {
+      txtimeSetControl(ctx, &msg->msg_hdr, ctx->batchControl[ctx->batched], sizeof(ctx->batchControl[0]), launchTime);
+   }
+
+   ctx->batched++;
+   return 0;
+}
+
+/**
+ * Send all queued packets with sendmmsg().
+ *
+ * @return POSIX error code or 0 on success
+ */
+int rtpSenderFlush(rtpSender *ctx)
+{
+   int sent = 0;
+   while(sent < ctx->batched)
+   {
+      int err = sendmmsg(ctx->socket, &ctx->batch[sent], ctx->batched - sent, 0);
+      if(-1 == err)
+      {
+         if(EINTR == errno)
+         {
+            continue;
+         }
+         fprintf(stderr,"sendmmsg() failed(%s)\n", strerror(errno));
+         ctx->batched = 0;
+         return errno;
+      }
+      accountSyscall(ctx, err);
+      sent += err;
+   }
+
+   ctx->batched = 0;
+   return 0;
+}
+
+/**
+ * Marks that the log is started over: the next packet continues the sequence
+ * numbers and timestamps of the last sent one, so receivers don't resync.
+ */
+void rtpSenderRewind(rtpSender *ctx)
+{
+   ctx->rewound = true;
+}
+
+/**
+ * Prints the packets per syscall and SO_TXTIME statistics.
+ */
+void rtpSenderReport(rtpSender *ctx, FILE *out)
+{
+   if(0 == ctx->syscalls)
+   {
+      return;
+   }
+
+   fprintf(out, "RTP: %llu packets in %llu syscalls(%.2f packets per syscall)\n"
+           , (unsigned long long)ctx->packets, (unsigned long long)ctx->syscalls
+           , (double)ctx->packets/ctx->syscalls);
+   for(int i=0; i<RTP_SENDER_BATCH_HISTOGRAM_SIZE; i++)
+   {
+      if(0 != ctx->batchHistogram[i])
+      {
+         fprintf(out, "   [%3u, %3u]: %llu\n", 1u << i, (2u << i) - 1, (unsigned long long)ctx->batchHistogram[i]);
+      }
+   }
+
+   if(ctx->txtime)
+   {
+      txtimeCheckErrors(ctx);
+      fprintf(out, "RTP: SO_TXTIME(%s) packets dropped by qdisc: %llu\n"
+              , (CLOCK_TAI == ctx->txtimeClock) ? "etf" : "fq", (unsigned long long)ctx->txtimeDrops);
+   }
+}
+
 /**
  * Close network socket.
  */
@@ -2,7 +2,15 @@
 #define _RTP_SENDER_H
 
 #include <stdint.h>
+#include <stdio.h>
+#include <time.h>
 #include <sys/socket.h>
+#include <sys/uio.h>
+
+//max amount of packets sent with a single sendmmsg() call
+#define RTP_SENDER_BATCH_MAX (64)
+//packets per syscall histogram buckets: 1, 2-3, 4-7, ... RTP_SENDER_BATCH_MAX
+#define RTP_SENDER_BATCH_HISTOGRAM_SIZE (7)
 
 /**
  * Describes internal data necessary for establish RTP over UDP transmitting such as
@@ -13,22 +21,92 @@ typedef struct
    int socket;
    struct sockaddr_in sockAddr;
    uint32_t ssrc; //RTP: Synchronization source identifier uniquely identifies the source of a stream
+
+   //RTP timestamps are rescaled by the playback speed factor relative to the first sent packet
+   double speed;
+   bool tsBaseValid;
+   uint32_t tsBase;
+   uint32_t tsPrev;
+   int64_t tsDelta; //unwrapped distance from tsBase in RTP clock ticks
+
+   //sequence numbers and timestamps are kept continuous when the log is looped
+   bool rewound;       //the next packet starts a new loop of the log
+   bool outValid;      //seqLast and tsLast hold the last sent packet
+   uint16_t seqOffset; //added to the logged sequence number
+   uint16_t seqLast;
+   uint32_t tsOffset;  //added to the(scaled) logged timestamp
+   uint32_t tsLast;
+   uint32_t tsStep;    //last timestamp increment, used as the gap between loops
+
+   //packets queued by rtpSenderQueue() to be sent by rtpSenderFlush()
+   struct mmsghdr batch[RTP_SENDER_BATCH_MAX];
+   struct iovec batchIov[RTP_SENDER_BATCH_MAX][2]; //header(and data) + optional tail
+   int batched;
+
+   //packets per syscall statistics
+   uint64_t syscalls;
+   uint64_t packets;
+   uint64_t batchHistogram[RTP_SENDER_BATCH_HISTOGRAM_SIZE];
+
+   //SO_TXTIME: the kernel(etf or fq qdisc) sends each packet at the given launch time
+   bool txtime;
+   clockid_t txtimeClock;  //CLOCK_TAI for etf, CLOCK_MONOTONIC for fq
+   int64_t txtimeOffset;   //txtimeClock - CLOCK_MONOTONIC(nsec)
+   char batchControl[RTP_SENDER_BATCH_MAX][CMSG_SPACE(sizeof(uint64_t))];
+   uint64_t txtimeDrops;   //packets dropped by the qdisc reported via the socket error queue
 }rtpSender;
 
 /**
  * Initializes UDP socket, convert the addr string to numeric representation.
- * The given TTP:SSRC is used for all sent packet.
+ * The given TTP:SSRC is used for all sent packet. RTP timestamps are scaled
+ * by the given playback speed factor(1.0 - keep the original timestamps).
+ *
+ * If txtime is set the socket is configured for SO_TXTIME launch times, but only when
+ * the egress interface has the etf or fq qdisc which honors them. Otherwise the sender
+ * falls back to immediate transmission and ctx->txtime is cleared.
+ *
+ * @return POSIX error code or 0 on success
+ */
+int rtpSenderInit(rtpSender *ctx, const char* addr, int port, uint32_t ssrc, double speed, bool txtime);
+
+/**
+ * Set the TTP:SSRC to the given ID, scale the RTP timestamp to the playback speed
+ * and send the packet as UDP stream. If SO_TXTIME is enabled and the launch
+ * time(CLOCK_MONOTONIC) is given the kernel sends the packet at that time.
+ * The packet may be split: buf holds the RTP header and the tail(if not NULL)
+ * the rest of the packet, which is sent as is without copying.
  *
  * @return POSIX error code or 0 on success
  */
-int rtpSenderInit(rtpSender *ctx, const char* addr, int port, uint32_t ssrc);
+int rtpSenderSend(rtpSender *ctx, const char *buf, const int size, const char *tail, const int tailSize
+                  , const struct timespec *launchTime);
+
+/**
+ * Prepare the packet like rtpSenderSend() does and add it to the batch to be sent
+ * with a single syscall by rtpSenderFlush(). The buffers should stay valid until then.
+ *
+ * @return POSIX error code or 0 on success, ENOBUFS if the batch is full
+ */
+int rtpSenderQueue(rtpSender *ctx, const char *buf, const int size, const char *tail, const int tailSize
+                   , const struct timespec *launchTime);
 
 /**
- * Set the TTP:SSRC to the given ID and send the packet as UDP stream.
+ * Send all queued packets with sendmmsg().
  *
  * @return POSIX error code or 0 on success
  */
-int rtpSenderSend(rtpSender *ctx, const char *buf, const int size);
+int rtpSenderFlush(rtpSender *ctx);
+
+/**
+ * Marks that the log is started over: the next packet continues the sequence
+ * numbers and timestamps of the last sent one, so receivers don't resync.
+ */
+void rtpSenderRewind(rtpSender *ctx);
+
+/**
+ * Prints the packets per syscall and SO_TXTIME statistics.
+ */
+void rtpSenderReport(rtpSender *ctx, FILE *out);
 
 /**
  * Close network socket.